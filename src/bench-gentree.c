@@ -0,0 +1,86 @@
+/*
+ * Geany プロジェクト一覧 - ベンチマーク用のプロジェクトの木を作る
+ *
+ * Copylight by Sakai Satoru 2018
+ *
+ * endeavor2wako@gmail.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+
+/*
+ * 合成したプロジェクトの木を作るだけのコマンド
+ * 実際のアプリケーションを大きな木で試す時に、走査の起点に指定して使う。
+ *
+ *   make bench-gentree
+ *   ./bench-gentree --count 50000 --depth 3 --size 8192 /tmp/projects
+ */
+
+#ifdef HAVE_CONFIG_H
+#   include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <glib.h>
+
+#include "benchtree.h"
+
+static BenchTreeOptions opt = BENCH_TREE_OPTIONS_INIT;
+
+static GOptionEntry entries[] = {
+    { "count",   'n', 0, G_OPTION_ARG_INT, &opt.count,
+                        "number of projects", "N" },
+    { "depth",   'd', 0, G_OPTION_ARG_INT, &opt.depth,
+                        "directory depth of each project", "N" },
+    { "size",    's', 0, G_OPTION_ARG_INT, &opt.size,
+                        "size of each .geany file in bytes", "BYTES" },
+    { "unicode", 'u', 0, G_OPTION_ARG_INT, &opt.unicode,
+                        "percentage of non-ASCII descriptions", "PERCENT" },
+    { NULL }
+};
+
+int main (int argc, char **argv)
+{
+    GOptionContext *octx;
+    GError *err = NULL;
+    GPtrArray *files;
+
+    octx = g_option_context_new ("DIR - create a synthetic project tree");
+    g_option_context_add_main_entries (octx, entries, NULL);
+    if (g_option_context_parse (octx, &argc, &argv, &err) == FALSE) {
+        g_printerr ("%s\n", err->message);
+        return 1;
+    }
+    g_option_context_free (octx);
+    if (argc != 2 || opt.count < 0 || opt.depth < 1) {
+        g_printerr ("usage: %s [OPTION...] DIR\n", g_get_prgname ());
+        return 1;
+    }
+
+    files = bench_tree_make (argv[1], &opt, &err);
+    if (files == NULL) {
+        g_printerr ("%s\n", err->message);
+        return 1;
+    }
+    printf ("%u projects in %s (depth %d, %d bytes, %d%% non-ASCII)\n",
+                files->len, argv[1], opt.depth, opt.size, opt.unicode);
+    g_ptr_array_unref (files);
+    return 0;
+}
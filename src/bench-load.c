@@ -0,0 +1,340 @@
+/*
+ * Geany プロジェクト一覧 - 読み込みのメモリ使用量
+ *
+ * Copylight by Sakai Satoru 2018
+ *
+ * endeavor2wako@gmail.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+
+/*
+ * プロジェクトの読み込みで使うメモリと確保の回数
+ * 一時ディレクトリにプロジェクトの木を作り、以前の方法 (Projectinfo を
+ * 1件ずつ確保して一覧と走査結果とでコピーを持つ) と、走査の pool と
+ * ProjectModel の文字列 pool を使う方法とで、読み込み後の常駐メモリと
+ * 読み込み中の malloc の回数を比べる。確保の回数は glibc でのみ数える。
+ *
+ *   make bench
+ *   ./bench-load --count 10000
+ */
+
+#ifdef HAVE_CONFIG_H
+#   include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#ifdef __GLIBC__
+#   include <malloc.h>
+#endif
+
+#include <gtk/gtk.h>
+#include <glib/gstdio.h>
+
+#include "projectinfo.h"
+#include "projectmodel.h"
+#include "searchindex.h"
+
+static gint opt_count = 10000;      // プロジェクトの数
+static gint opt_batch = 64;         // UI へ渡す単位 (main.c と同じ)
+
+static GOptionEntry entries[] = {
+    { "count",  'n', 0, G_OPTION_ARG_INT, &opt_count,
+                        "number of projects", "N" },
+    { "batch",  'b', 0, G_OPTION_ARG_INT, &opt_batch,
+                        "projects per batch", "N" },
+    { NULL }
+};
+
+/*
+ * malloc の回数を数える (glibc の実体を呼ぶ)
+ */
+#ifdef __GLIBC__
+extern void *__libc_malloc (size_t size);
+extern void *__libc_calloc (size_t n, size_t size);
+extern void *__libc_realloc (void *p, size_t size);
+extern void __libc_free (void *p);
+
+static gint alloc_count = 0;
+static gint free_count = 0;
+
+void *malloc (size_t size)
+{
+    g_atomic_int_inc (&alloc_count);
+    return __libc_malloc (size);
+}
+
+void *calloc (size_t n, size_t size)
+{
+    g_atomic_int_inc (&alloc_count);
+    return __libc_calloc (n, size);
+}
+
+void *realloc (void *p, size_t size)
+{
+    if (p == NULL) g_atomic_int_inc (&alloc_count);
+    return __libc_realloc (p, size);
+}
+
+void free (void *p)
+{
+    if (p != NULL) g_atomic_int_inc (&free_count);
+    __libc_free (p);
+}
+#   define COUNT_ALLOCS 1
+#endif
+
+typedef struct {
+    gdouble time;           // ms
+    gint allocs, frees;
+    gssize heap;            // 読み込み後に残った heap (bytes)
+    gssize rss;             // 常駐メモリの増分 (bytes)
+} Result;
+
+static gssize heap_in_use (void)
+{
+#if defined(__GLIBC__) && defined(__GLIBC_PREREQ)
+#   if __GLIBC_PREREQ(2, 33)
+    return mallinfo2 ().uordblks;
+#   else
+    return (guint)mallinfo ().uordblks;
+#   endif
+#else
+    return 0;
+#endif
+}
+
+static gssize resident (void)
+{
+    gchar *contents = NULL;
+    long size, rss = 0;
+
+    if (g_file_get_contents ("/proc/self/statm", &contents, NULL, NULL)) {
+        if (sscanf (contents, "%ld %ld", &size, &rss) != 2) rss = 0;
+        g_free (contents);
+    }
+    return (gssize)rss * sysconf (_SC_PAGESIZE);
+}
+
+static void result_begin (Result *r)
+{
+#ifdef COUNT_ALLOCS
+    r->allocs = g_atomic_int_get (&alloc_count);
+    r->frees = g_atomic_int_get (&free_count);
+#endif
+    r->heap = heap_in_use ();
+    r->rss = resident ();
+    r->time = g_get_monotonic_time ();
+}
+
+static void result_end (Result *r)
+{
+    r->time = (g_get_monotonic_time () - r->time) / 1000.0;
+#ifdef COUNT_ALLOCS
+    r->allocs = g_atomic_int_get (&alloc_count) - r->allocs;
+    r->frees = g_atomic_int_get (&free_count) - r->frees;
+#endif
+    r->heap = heap_in_use () - r->heap;
+    r->rss = resident () - r->rss;
+}
+
+/*
+ * geany が書き出すのと同じ形のプロジェクトファイルを作る。
+ * 同じ時刻に作られるので更新日時の多くは同じ値になる。
+ */
+static GPtrArray *make_tree (const gchar *dir)
+{
+    GPtrArray *files = g_ptr_array_new_with_free_func (g_free);
+    gchar *sub, *path, *contents;
+    gint i;
+
+    for (i = 0; i < opt_count; i++) {
+        sub = g_strdup_printf ("%s/group%d/proj%d", dir, i % 50, i);
+        g_mkdir_with_parents (sub, 0700);
+        path = g_strdup_printf ("%s/proj%d.geany", sub, i);
+        contents = g_strdup_printf (
+            "[editor]\nline_wrapping=false\n\n"
+            "[project]\nname=proj%d\ndescription=%s\n"
+            "base_path=%s/\nfile_patterns=\n\n"
+            "[files]\ncurrent_page=0\n", i,
+            (i % 3 == 0) ? "" : "サンプルのプロジェクト", sub);
+        if (g_file_set_contents (path, contents, -1, NULL) == FALSE) {
+            g_printerr ("cannot write %s\n", path);
+            exit (1);
+        }
+        g_free (contents);
+        g_ptr_array_add (files, path);
+        g_free (sub);
+    }
+    return files;
+}
+
+static void remove_tree (const gchar *dir, GPtrArray *files)
+{
+    gchar *sub;
+    guint i;
+
+    for (i = 0; i < files->len; i++) {
+        sub = g_path_get_dirname (g_ptr_array_index (files, i));
+        g_unlink (g_ptr_array_index (files, i));
+        g_rmdir (sub);
+        g_free (sub);
+    }
+    for (i = 0; i < 50; i++) {
+        sub = g_strdup_printf ("%s/group%u", dir, i);
+        g_rmdir (sub);
+        g_free (sub);
+    }
+    g_rmdir (dir);
+}
+
+/*
+ * 以前の方法: 走査結果 (all) と UI へ渡す batch とでコピーを持ち、
+ * 一覧の各行も文字列を個別に持つ。
+ */
+static void load_heap (GPtrArray *files, Result *res)
+{
+    GPtrArray *all, *batch, *rows;
+    SearchIndex *index;
+    Projectinfo *prj;
+    guint i, j;
+
+    result_begin (res);
+    index = search_index_new ();
+    all = g_ptr_array_new_with_free_func ((GDestroyNotify)projectinfo_free);
+    rows = g_ptr_array_new_with_free_func ((GDestroyNotify)projectinfo_free);
+    batch = g_ptr_array_new_with_free_func ((GDestroyNotify)projectinfo_free);
+    for (i = 0; i < files->len; i++) {
+        prj = projectinfo_read_file (g_ptr_array_index (files, i), NULL);
+        g_ptr_array_add (all, prj);
+        g_ptr_array_add (batch, projectinfo_copy (prj));
+        if (batch->len >= (guint)opt_batch || i + 1 == files->len) {
+            for (j = 0; j < batch->len; j++) {
+                prj = projectinfo_copy (g_ptr_array_index (batch, j));
+                search_index_add (index, prj->name, prj->description,
+                                        prj->base_path, prj->mtime);
+                g_ptr_array_add (rows, prj);
+            }
+            g_ptr_array_set_size (batch, 0);
+        }
+    }
+    // 走査が終わると all は解放され、一覧の行だけが残る
+    g_ptr_array_unref (all);
+    g_ptr_array_unref (batch);
+    result_end (res);
+
+    g_ptr_array_unref (rows);
+    search_index_free (index);
+}
+
+/*
+ * 現在の方法: 走査の pool に写し、ProjectModel の pool に写す
+ */
+static void load_pool (GPtrArray *files, Result *res)
+{
+    ProjectinfoPool *pool;
+    ProjectModel *model;
+    SearchIndex *index;
+    GPtrArray *all, *batch;
+    Projectinfo *tmp, *prj;
+    guint i, j;
+
+    result_begin (res);
+    index = search_index_new ();
+    model = project_model_new (index);
+    pool = projectinfo_pool_new ();
+    all = g_ptr_array_new ();
+    batch = g_ptr_array_new ();
+    for (i = 0; i < files->len; i++) {
+        tmp = projectinfo_read_file (g_ptr_array_index (files, i), NULL);
+        prj = projectinfo_pool_copy (pool, tmp);
+        projectinfo_free (tmp);
+        g_ptr_array_add (all, prj);
+        g_ptr_array_add (batch, prj);
+        if (batch->len >= (guint)opt_batch || i + 1 == files->len) {
+            project_model_freeze (model);
+            for (j = 0; j < batch->len; j++) {
+                project_model_set (model, g_ptr_array_index (batch, j));
+            }
+            project_model_thaw (model);
+            g_ptr_array_set_size (batch, 0);
+        }
+    }
+    // 走査が終わると pool ごと解放され、一覧の文字列だけが残る
+    g_ptr_array_unref (all);
+    g_ptr_array_unref (batch);
+    projectinfo_pool_unref (pool);
+    result_end (res);
+
+    g_object_unref (model);
+    search_index_free (index);
+}
+
+static void print_result (const gchar *what, const Result *r)
+{
+    printf ("%-8s %10.1f ms %10d %10d %10.2f MB %10.2f MB\n", what,
+                r->time, r->allocs, r->frees,
+                r->heap / 1048576.0, r->rss / 1048576.0);
+}
+
+int main (int argc, char **argv)
+{
+    GOptionContext *octx;
+    GError *err = NULL;
+    GPtrArray *files;
+    Result before = { 0 }, after = { 0 };
+    gchar *dir;
+
+    octx = g_option_context_new ("- memory used while loading projects");
+    g_option_context_add_main_entries (octx, entries, NULL);
+    if (g_option_context_parse (octx, &argc, &argv, &err) == FALSE) {
+        g_printerr ("%s\n", err->message);
+        return 1;
+    }
+    g_option_context_free (octx);
+
+    dir = g_dir_make_tmp ("geanyproject-bench-XXXXXX", &err);
+    if (dir == NULL) {
+        g_printerr ("%s\n", err->message);
+        return 1;
+    }
+    files = make_tree (dir);
+
+    // 型の登録などの一度きりの確保を先に済ませておく
+    load_pool (files, &after);
+
+    load_heap (files, &before);
+    load_pool (files, &after);
+
+    printf ("projects: %d, batch %d\n", opt_count, opt_batch);
+    printf ("%-8s %13s %10s %10s %13s %13s\n", "", "time", "mallocs",
+                                        "frees", "heap kept", "rss grown");
+    print_result ("before", &before);
+    print_result ("after", &after);
+#ifndef COUNT_ALLOCS
+    printf ("(allocation counts need glibc)\n");
+#endif
+
+    remove_tree (dir, files);
+    g_free (dir);
+    g_ptr_array_unref (files);
+    return 0;
+}
@@ -0,0 +1,320 @@
+/*
+ * Geany プロジェクト一覧 - 一覧モデルのベンチマーク
+ *
+ * Copylight by Sakai Satoru 2018
+ *
+ * endeavor2wako@gmail.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+
+/*
+ * 一覧のモデルの比較
+ * 以前の GtkListStore (+ GtkTreeModelFilter) と ProjectModel に同じ
+ * プロジェクトを入れ、使用メモリと、追加、並べ替え、絞り込み、読み出しの
+ * 時間を測る。どちらも検索索引 (SearchIndex) を併せて使う。
+ *
+ *   make bench
+ *   ./bench-model --count 100000 --repeat 3
+ */
+
+#ifdef HAVE_CONFIG_H
+#   include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef __GLIBC__
+#   include <malloc.h>
+#endif
+
+#include <gtk/gtk.h>
+
+#include "projectinfo.h"
+#include "projectmodel.h"
+#include "searchindex.h"
+
+static gint opt_count = 100000;     // プロジェクトの数
+static gint opt_repeat = 3;         // 計測の繰り返し回数
+static gchar *opt_query = "proj1";  // 絞り込みの検索語
+
+static GOptionEntry entries[] = {
+    { "count",  'n', 0, G_OPTION_ARG_INT, &opt_count,
+                        "number of projects", "N" },
+    { "repeat", 'r', 0, G_OPTION_ARG_INT, &opt_repeat,
+                        "number of timed passes", "N" },
+    { "query",  'q', 0, G_OPTION_ARG_STRING, &opt_query,
+                        "filter query", "TEXT" },
+    { NULL }
+};
+
+typedef struct {
+    gdouble fill, sort, filter, read;   // ms
+    gsize memory;                       // bytes (不明なら 0)
+    guint visible;
+} Result;
+
+static gsize heap_in_use (void)
+{
+#if defined(__GLIBC__) && defined(__GLIBC_PREREQ)
+#   if __GLIBC_PREREQ(2, 33)
+    return mallinfo2 ().uordblks;
+#   else
+    return (gsize)(guint)mallinfo ().uordblks;
+#   endif
+#else
+    return 0;
+#endif
+}
+
+static gdouble elapsed (gint64 start)
+{
+    return (g_get_monotonic_time () - start) / 1000.0;
+}
+
+static GPtrArray *make_projects (void)
+{
+    GPtrArray *projects = g_ptr_array_new_with_free_func (
+                                        (GDestroyNotify)projectinfo_free);
+    Projectinfo *prj;
+    gint i;
+
+    for (i = 0; i < opt_count; i++) {
+        prj = projectinfo_new ();
+        // 並べ替えが意味を持つように名前の順と追加の順をずらす
+        prj->name = g_strdup_printf ("proj%d", (i * 7919) % opt_count);
+        prj->description = g_strdup_printf (
+                    "ベンチマーク用のプロジェクト %d\nsecond line", i);
+        prj->prjfilename = g_strdup_printf (
+                    "/home/user/projects/proj%d/proj%d.geany", i, i);
+        prj->base_path = g_strdup_printf ("/home/user/projects/proj%d/", i);
+        prj->mtime = 1500000000 + (i * 104729) % 100000000;
+        g_ptr_array_add (projects, prj);
+    }
+    return projects;
+}
+
+/*
+ * 以前の実装: 6列の GtkListStore の上に GtkTreeModelFilter
+ */
+static SearchIndex *store_index;
+
+static gboolean store_visible_func (GtkTreeModel *model, GtkTreeIter *iter,
+                                                            gpointer data)
+{
+    guint id;
+
+    gtk_tree_model_get (model, iter, _P_ID, &id, -1);
+    return search_index_is_visible (store_index, id);
+}
+
+static void run_store (GPtrArray *projects, Result *res)
+{
+    GtkListStore *store;
+    GtkTreeModel *filter;
+    GtkTreeIter iter;
+    Projectinfo *prj;
+    gchar *name, *description, *timestamp;
+    gchar buf[PROJECTINFO_MTIME_LEN];
+    gsize heap;
+    gint64 start;
+    guint i, id;
+    gboolean valid;
+
+    heap = heap_in_use ();
+    start = g_get_monotonic_time ();
+    store_index = search_index_new ();
+    store = gtk_list_store_new (_P_N_COLUMNS, G_TYPE_STRING, G_TYPE_STRING,
+                                G_TYPE_STRING, G_TYPE_STRING, G_TYPE_STRING,
+                                G_TYPE_UINT);
+    for (i = 0; i < projects->len; i++) {
+        prj = g_ptr_array_index (projects, i);
+        id = search_index_add (store_index, prj->name, prj->description,
+                                        prj->base_path, prj->mtime);
+        // 以前は読み込み時に更新日時を書式化していた
+        projectinfo_format_mtime (prj->mtime, buf, sizeof(buf));
+        gtk_list_store_insert_with_values (store, &iter, 0,
+                                _P_NAME,        prj->name,
+                                _P_DESCRIPTION, prj->description,
+                                _P_TIMESTAMP,   buf,
+                                _P_PRJFILENAME, prj->prjfilename,
+                                _P_BASE_PATH,   prj->base_path,
+                                _P_ID,          id,
+                                -1);
+    }
+    res->fill = elapsed (start);
+    res->memory = heap_in_use () - heap;
+
+    start = g_get_monotonic_time ();
+    gtk_tree_sortable_set_sort_column_id (GTK_TREE_SORTABLE (store),
+                                            _P_NAME, GTK_SORT_ASCENDING);
+    res->sort = elapsed (start);
+
+    filter = gtk_tree_model_filter_new (GTK_TREE_MODEL (store), NULL);
+    gtk_tree_model_filter_set_visible_func (GTK_TREE_MODEL_FILTER (filter),
+                                        store_visible_func, NULL, NULL);
+    start = g_get_monotonic_time ();
+    search_index_filter (store_index, opt_query,
+                                        SEARCH_TIME_MIN, SEARCH_TIME_MAX);
+    gtk_tree_model_filter_refilter (GTK_TREE_MODEL_FILTER (filter));
+    // フィルタモデルは参照されるまで行を調べないので数えておく
+    res->visible = gtk_tree_model_iter_n_children (filter, NULL);
+    res->filter = elapsed (start);
+    search_index_filter (store_index, NULL,
+                                        SEARCH_TIME_MIN, SEARCH_TIME_MAX);
+
+    // 表示と同じく全行の文字列を読む (コピーが返る)
+    start = g_get_monotonic_time ();
+    valid = gtk_tree_model_get_iter_first (GTK_TREE_MODEL (store), &iter);
+    while (valid) {
+        gtk_tree_model_get (GTK_TREE_MODEL (store), &iter,
+                                _P_NAME,        &name,
+                                _P_DESCRIPTION, &description,
+                                _P_TIMESTAMP,   &timestamp,
+                                -1);
+        g_free (name);
+        g_free (description);
+        g_free (timestamp);
+        valid = gtk_tree_model_iter_next (GTK_TREE_MODEL (store), &iter);
+    }
+    res->read = elapsed (start);
+
+    g_object_unref (filter);
+    g_object_unref (store);
+    search_index_free (store_index);
+}
+
+/*
+ * ProjectModel
+ */
+static void run_model (GPtrArray *projects, Result *res)
+{
+    ProjectModel *model;
+    SearchIndex *index;
+    GtkTreeIter iter;
+    const Projectinfo *info;
+    gsize heap, len = 0;
+    gint64 start;
+    guint i;
+    gboolean valid;
+
+    heap = heap_in_use ();
+    start = g_get_monotonic_time ();
+    index = search_index_new ();
+    model = project_model_new (index);
+    project_model_freeze (model);
+    for (i = 0; i < projects->len; i++) {
+        project_model_set (model, g_ptr_array_index (projects, i));
+    }
+    project_model_thaw (model);
+    res->fill = elapsed (start);
+    res->memory = heap_in_use () - heap;
+
+    start = g_get_monotonic_time ();
+    gtk_tree_sortable_set_sort_column_id (GTK_TREE_SORTABLE (model),
+                                            _P_NAME, GTK_SORT_ASCENDING);
+    res->sort = elapsed (start);
+
+    start = g_get_monotonic_time ();
+    search_index_filter (index, opt_query,
+                                        SEARCH_TIME_MIN, SEARCH_TIME_MAX);
+    project_model_refilter (model);
+    res->visible = gtk_tree_model_iter_n_children (GTK_TREE_MODEL (model),
+                                                                    NULL);
+    res->filter = elapsed (start);
+    search_index_filter (index, NULL,
+                                        SEARCH_TIME_MIN, SEARCH_TIME_MAX);
+    project_model_refilter (model);
+
+    // 文字列はコピーせずに読む。更新日時は数値のまま
+    start = g_get_monotonic_time ();
+    valid = gtk_tree_model_get_iter_first (GTK_TREE_MODEL (model), &iter);
+    while (valid) {
+        info = project_model_get_info (model, &iter);
+        len += strlen (info->name) + strlen (info->description) +
+                                            (info->mtime != 0);
+        valid = gtk_tree_model_iter_next (GTK_TREE_MODEL (model), &iter);
+    }
+    res->read = elapsed (start);
+    if (len == 0) g_printerr ("no rows read\n");
+
+    g_object_unref (model);
+    search_index_free (index);
+}
+
+static void best_of (Result *best, const Result *r, gboolean first)
+{
+    if (first) {
+        *best = *r;
+        return;
+    }
+    best->fill = MIN (best->fill, r->fill);
+    best->sort = MIN (best->sort, r->sort);
+    best->filter = MIN (best->filter, r->filter);
+    best->read = MIN (best->read, r->read);
+}
+
+static void print_row (const gchar *what, gdouble store, gdouble model)
+{
+    printf ("%-14s %12.3f ms %12.3f ms %8.2f x\n", what, store, model,
+                                        (model > 0.0) ? store / model : 0.0);
+}
+
+int main (int argc, char **argv)
+{
+    GOptionContext *octx;
+    GError *err = NULL;
+    GPtrArray *projects;
+    Result store, model, r;
+    gint i;
+
+    octx = g_option_context_new ("- compare GtkListStore and ProjectModel");
+    g_option_context_add_main_entries (octx, entries, NULL);
+    if (g_option_context_parse (octx, &argc, &argv, &err) == FALSE) {
+        g_printerr ("%s\n", err->message);
+        return 1;
+    }
+    g_option_context_free (octx);
+
+    projects = make_projects ();
+    for (i = 0; i < opt_repeat; i++) {
+        run_store (projects, &r);
+        best_of (&store, &r, i == 0);
+        run_model (projects, &r);
+        best_of (&model, &r, i == 0);
+    }
+
+    printf ("projects: %d, query \"%s\", best of %d passes\n",
+                                        opt_count, opt_query, opt_repeat);
+    printf ("%-14s %15s %15s %10s\n", "", "GtkListStore", "ProjectModel",
+                                                            "speedup");
+    print_row ("fill", store.fill, model.fill);
+    print_row ("sort by name", store.sort, model.sort);
+    print_row ("filter", store.filter, model.filter);
+    print_row ("read all rows", store.read, model.read);
+    if (store.memory != 0 && model.memory != 0) {
+        printf ("%-14s %12.1f MB %12.1f MB %8.2f x\n", "memory",
+                        store.memory / 1048576.0, model.memory / 1048576.0,
+                        (gdouble)store.memory / model.memory);
+    }
+    printf ("visible rows: %u / %u\n", store.visible, model.visible);
+
+    g_ptr_array_unref (projects);
+    return (store.visible == model.visible) ? 0 : 1;
+}
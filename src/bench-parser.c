@@ -0,0 +1,188 @@
+/*
+ * Geany プロジェクト一覧 - パーサのベンチマーク
+ *
+ * Copylight by Sakai Satoru 2018
+ *
+ * endeavor2wako@gmail.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+
+/*
+ * .geany の読み込み方法の比較
+ * [files] と [build-menu] の長いプロジェクトファイルを一時ディレクトリに
+ * 作り、GKeyFile で全体を読む場合と [project] だけを読む場合の時間を測る。
+ *
+ *   make bench
+ *   ./bench-parser --count 200 --files 1000 --repeat 5
+ */
+
+#ifdef HAVE_CONFIG_H
+#   include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "projectinfo.h"
+
+static gint opt_count = 200;        // プロジェクトファイルの数
+static gint opt_files = 500;        // [files] の項目数
+static gint opt_repeat = 5;         // 計測の繰り返し回数
+
+static GOptionEntry entries[] = {
+    { "count",  'n', 0, G_OPTION_ARG_INT, &opt_count,
+                        "number of project files", "N" },
+    { "files",  'f', 0, G_OPTION_ARG_INT, &opt_files,
+                        "entries in the [files] section", "N" },
+    { "repeat", 'r', 0, G_OPTION_ARG_INT, &opt_repeat,
+                        "number of timed passes", "N" },
+    { NULL }
+};
+
+/*
+ * geany が書き出すのと同じ並びのプロジェクトファイルを作る
+ */
+static gchar *make_project_file (const gchar *dir, gint n)
+{
+    GString *s = g_string_new (NULL);
+    gchar *filename;
+    gint i;
+
+    g_string_append (s,
+        "[editor]\nline_wrapping=false\nline_break_column=72\n"
+        "auto_continue_multiline=true\n\n"
+        "[file_prefs]\nfinal_new_line=true\nensure_convert_new_lines=false\n"
+        "strip_trailing_spaces=false\nreplace_tabs=false\n\n"
+        "[indentation]\nindent_width=4\nindent_type=0\nindent_hard_tab_width=8\n"
+        "detect_indent=false\ndetect_indent_width=false\nindent_mode=2\n\n");
+    g_string_append_printf (s,
+        "[project]\nname=bench%d\n"
+        "description=ベンチマーク用のプロジェクト %d\\nsecond line\n"
+        "base_path=%s/bench%d/\n"
+        "file_patterns=\n\n"
+        "[long line marker]\nlong_line_behaviour=1\nlong_line_column=72\n\n"
+        "[files]\ncurrent_page=0\n", n, n, dir, n);
+    for (i = 0; i < opt_files; i++) {
+        g_string_append_printf (s,
+            "FILE_NAME_%d=%d;C;0;EUTF-8;1;1;0;%%2Fhome%%2Fuser%%2Fprojects"
+            "%%2Fbench%d%%2Fsrc%%2Fmodule%d.c;0;4\n", i, i * 37, n, i);
+    }
+    g_string_append (s, "\n[VTE]\nlast_dir=/home/user\n\n[build-menu]\n");
+    for (i = 0; i < opt_files / 4; i++) {
+        g_string_append_printf (s,
+            "filetypes=C;\nCFT_%02dLB=_Build %d\nCFT_%02dCM=gcc -Wall -c \"%%f\"\n"
+            "CFT_%02dWD=\n", i, i, i, i);
+    }
+
+    filename = g_strdup_printf ("%s/bench%d.geany", dir, n);
+    if (g_file_set_contents (filename, s->str, s->len, NULL) == FALSE) {
+        g_printerr ("cannot write %s\n", filename);
+        exit (1);
+    }
+    g_string_free (s, TRUE);
+    return filename;
+}
+
+static gdouble run (GPtrArray *files,
+                    Projectinfo *(*reader) (const gchar *, const struct stat *))
+{
+    gint64 start, best = G_MAXINT64;
+    Projectinfo *prj;
+    gint r;
+    guint i;
+
+    for (r = 0; r < opt_repeat; r++) {
+        start = g_get_monotonic_time ();
+        for (i = 0; i < files->len; i++) {
+            prj = reader (g_ptr_array_index (files, i), NULL);
+            projectinfo_free (prj);
+        }
+        best = MIN (best, g_get_monotonic_time () - start);
+    }
+    return best / 1000.0;
+}
+
+int main (int argc, char **argv)
+{
+    GOptionContext *octx;
+    GError *err = NULL;
+    GPtrArray *files;
+    Projectinfo *a, *b;
+    gchar *dir;
+    gdouble t_keyfile, t_header;
+    guint i, mismatch = 0, fallback = 0;
+
+    octx = g_option_context_new ("- compare .geany parsers");
+    g_option_context_add_main_entries (octx, entries, NULL);
+    if (g_option_context_parse (octx, &argc, &argv, &err) == FALSE) {
+        g_printerr ("%s\n", err->message);
+        return 1;
+    }
+    g_option_context_free (octx);
+
+    dir = g_dir_make_tmp ("geanyproject-bench-XXXXXX", &err);
+    if (dir == NULL) {
+        g_printerr ("%s\n", err->message);
+        return 1;
+    }
+    files = g_ptr_array_new_with_free_func (g_free);
+    for (i = 0; i < (guint)opt_count; i++) {
+        g_ptr_array_add (files, make_project_file (dir, i));
+    }
+
+    // 両者の結果が一致することを確かめる
+    for (i = 0; i < files->len; i++) {
+        a = projectinfo_read_file_keyfile (g_ptr_array_index (files, i), NULL);
+        b = projectinfo_read_header (g_ptr_array_index (files, i), NULL);
+        if (b == NULL) {
+            fallback++;
+        }
+        else if (g_strcmp0 (a->name, b->name) ||
+                 g_strcmp0 (a->description, b->description) ||
+                 g_strcmp0 (a->base_path, b->base_path)) {
+            mismatch++;
+        }
+        projectinfo_free (a);
+        projectinfo_free (b);
+    }
+
+    t_keyfile = run (files, projectinfo_read_file_keyfile);
+    t_header = run (files, projectinfo_read_header);
+
+    printf ("files: %d x %d entries, best of %d passes\n",
+                                    opt_count, opt_files, opt_repeat);
+    printf ("GKeyFile:        %10.3f ms  (%.1f us/file)\n",
+                                t_keyfile, t_keyfile * 1000.0 / opt_count);
+    printf ("[project] only:  %10.3f ms  (%.1f us/file)\n",
+                                t_header, t_header * 1000.0 / opt_count);
+    printf ("speedup:         %10.2f x\n", t_keyfile / t_header);
+    printf ("fallback: %u  mismatch: %u\n", fallback, mismatch);
+
+    for (i = 0; i < files->len; i++) {
+        g_unlink (g_ptr_array_index (files, i));
+    }
+    g_rmdir (dir);
+    g_free (dir);
+    g_ptr_array_unref (files);
+
+    return (mismatch == 0) ? 0 : 1;
+}
@@ -0,0 +1,534 @@
+/*
+ * Geany プロジェクト一覧 - 性能測定
+ *
+ * Copylight by Sakai Satoru 2018
+ *
+ * endeavor2wako@gmail.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+
+/*
+ * 合成したプロジェクトの木で、読み込みから絞り込みまでの時間を測る。
+ *
+ *   scan_cold      キャッシュ無しの走査 (全ファイルを読む。ページキャッシュは
+ *                  事前に捨てるが、ディレクトリのキャッシュは残る)
+ *   scan_warm      キャッシュ有りの走査 (stat が一致するので読まない)
+ *   cache_load     プロジェクト一覧のキャッシュの読み込み
+ *   parse          .geany の読み込みのみ
+ *   model_fill     ProjectModel への追加 (UI と同じ単位でまとめる)
+ *   filter_key     検索語を1文字ずつ入力した時の1打鍵ごとの絞り込み
+ *
+ * 結果は JSON か CSV で出力する。--output に CSV を指定すると追記するので、
+ * 同じファイルに溜めていけば変化を追える。
+ *
+ *   make bench
+ *   ./bench-suite --count 10000 --depth 2 --format json
+ *   ./bench-suite --tree ~/projects --depth 3 --format csv --output bench.csv
+ */
+
+#ifdef HAVE_CONFIG_H
+#   include "config.h"
+#endif
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <gtk/gtk.h>
+#include <glib/gstdio.h>
+
+#include "benchtree.h"
+#include "prjcache.h"
+#include "projectinfo.h"
+#include "projectmodel.h"
+#include "scanner.h"
+#include "searchindex.h"
+
+#define BATCH_SIZE  64              // UI へ渡す単位 (main.c と同じ)
+
+static BenchTreeOptions opt = BENCH_TREE_OPTIONS_INIT;
+static gint opt_repeat = 5;         // 計測の繰り返し回数
+static gint opt_threads = 0;        // 走査スレッド数 (0 ならプロセッサ数)
+static gchar *opt_tree = NULL;      // 既存の木を使う
+static gchar *opt_format = NULL;    // json か csv
+static gchar *opt_output = NULL;
+
+static GOptionEntry entries[] = {
+    { "count",   'n', 0, G_OPTION_ARG_INT, &opt.count,
+                        "number of generated projects", "N" },
+    { "depth",   'd', 0, G_OPTION_ARG_INT, &opt.depth,
+                        "directory depth of each project", "N" },
+    { "size",    's', 0, G_OPTION_ARG_INT, &opt.size,
+                        "size of each .geany file in bytes", "BYTES" },
+    { "unicode", 'u', 0, G_OPTION_ARG_INT, &opt.unicode,
+                        "percentage of non-ASCII descriptions", "PERCENT" },
+    { "repeat",  'r', 0, G_OPTION_ARG_INT, &opt_repeat,
+                        "number of timed passes", "N" },
+    { "threads", 't', 0, G_OPTION_ARG_INT, &opt_threads,
+                        "scanner threads (0 for the number of CPUs)", "N" },
+    { "tree",    0,   0, G_OPTION_ARG_FILENAME, &opt_tree,
+                        "measure an existing tree instead", "DIR" },
+    { "format",  'f', 0, G_OPTION_ARG_STRING, &opt_format,
+                        "json (default) or csv", "FORMAT" },
+    { "output",  'o', 0, G_OPTION_ARG_FILENAME, &opt_output,
+                        "write (csv: append) to FILE", "FILE" },
+    { NULL }
+};
+
+/*
+ * 1打鍵ずつ入力する検索語。一致の多いもの、ASCII 以外、一致しないもの
+ */
+static const gchar *queries[] = {
+    "alpha bravo", "プロジェクト", "café", "zqxjk", "since:2020 echo",
+};
+
+typedef struct {
+    const gchar *name;
+    GArray *samples;            // 1回ごとの時間 (ms, gdouble)
+} Bench;
+
+typedef struct {
+    GMutex lock;
+    GHashTable *cache;          // 前回の結果 (stat が同じなら読まない)
+    ProjectinfoPool *pool;
+    GPtrArray *all;
+} Scan;
+
+static GPtrArray *benches;
+
+static Bench *bench_new (const gchar *name)
+{
+    Bench *b = g_new (Bench, 1);
+
+    b->name = name;
+    b->samples = g_array_new (FALSE, FALSE, sizeof (gdouble));
+    g_ptr_array_add (benches, b);
+    return b;
+}
+
+static void bench_free (gpointer data)
+{
+    Bench *b = data;
+
+    g_array_free (b->samples, TRUE);
+    g_free (b);
+}
+
+static void bench_add (Bench *b, gint64 start)
+{
+    gdouble ms = (g_get_monotonic_time () - start) / 1000.0;
+
+    g_array_append_val (b->samples, ms);
+}
+
+static gint compare_double (gconstpointer a, gconstpointer b)
+{
+    gdouble x = *(const gdouble *)a, y = *(const gdouble *)b;
+
+    return (x < y) ? -1 : (x > y);
+}
+
+/*
+ * ページキャッシュから捨てる。書いたばかりのページは捨てられないので
+ * 先に書き出しておく。
+ */
+static void drop_page_cache (GPtrArray *files)
+{
+#ifdef POSIX_FADV_DONTNEED
+    guint i;
+    int fd;
+
+    for (i = 0; i < files->len; i++) {
+        fd = g_open (g_ptr_array_index (files, i), O_RDONLY, 0);
+        if (fd < 0) continue;
+        fdatasync (fd);
+        posix_fadvise (fd, 0, 0, POSIX_FADV_DONTNEED);
+        close (fd);
+    }
+#endif
+}
+
+static void scan_add (const gchar *path, const GStatBuf *st, gpointer data)
+{
+    Scan *s = data;
+    Projectinfo *prj = NULL, *tmp;
+
+    g_mutex_lock (&s->lock);
+    if (s->cache != NULL) {
+        prj = g_hash_table_lookup (s->cache, path);
+        if (prj != NULL && projectinfo_stat_equal (prj, st) == TRUE) {
+            g_ptr_array_add (s->all, prj);
+            g_mutex_unlock (&s->lock);
+            return;
+        }
+    }
+    g_mutex_unlock (&s->lock);
+
+    tmp = projectinfo_read_file (path, st);
+
+    g_mutex_lock (&s->lock);
+    g_ptr_array_add (s->all, projectinfo_pool_copy (s->pool, tmp));
+    g_mutex_unlock (&s->lock);
+    projectinfo_free (tmp);
+}
+
+/*
+ * main.c の走査と同じく、スレッドで木をたどって読む
+ */
+static GPtrArray *scan (const gchar *dir, ScanOptions *so,
+                            GHashTable *cache, ProjectinfoPool *pool)
+{
+    GPtrArray *roots;
+    Scan s;
+
+    g_mutex_init (&s.lock);
+    s.cache = cache;
+    s.pool = pool;
+    s.all = g_ptr_array_new ();
+    roots = g_ptr_array_new_with_free_func ((GDestroyNotify)scan_dir_free);
+    g_ptr_array_add (roots, scan_dir_new (dir, 0));
+    scanner_walk (so, roots, scan_add, NULL, &s, NULL);
+    g_ptr_array_unref (roots);
+    g_mutex_clear (&s.lock);
+    return s.all;
+}
+
+static GHashTable *make_cache (GPtrArray *all)
+{
+    GHashTable *cache = g_hash_table_new (g_str_hash, g_str_equal);
+    guint i;
+
+    for (i = 0; i < all->len; i++) {
+        Projectinfo *prj = g_ptr_array_index (all, i);
+        g_hash_table_insert (cache, prj->prjfilename, prj);
+    }
+    return cache;
+}
+
+static void run_scan (const gchar *dir, GPtrArray *files, ScanOptions *so)
+{
+    Bench *cold = bench_new ("scan_cold");
+    Bench *warm = bench_new ("scan_warm");
+    ProjectinfoPool *pool, *wpool;
+    GHashTable *cache;
+    GPtrArray *all, *again;
+    gint64 start;
+    gint r;
+
+    for (r = 0; r < opt_repeat; r++) {
+        drop_page_cache (files);
+        pool = projectinfo_pool_new ();
+        start = g_get_monotonic_time ();
+        all = scan (dir, so, NULL, pool);
+        bench_add (cold, start);
+
+        cache = make_cache (all);
+        wpool = projectinfo_pool_new ();
+        start = g_get_monotonic_time ();
+        again = scan (dir, so, cache, wpool);
+        bench_add (warm, start);
+
+        g_ptr_array_unref (again);
+        projectinfo_pool_unref (wpool);
+        g_hash_table_unref (cache);
+        g_ptr_array_unref (all);
+        projectinfo_pool_unref (pool);
+    }
+}
+
+static void run_cache_load (const gchar *dir, GPtrArray *projects)
+{
+    Bench *b = bench_new ("cache_load");
+    ProjectinfoPool *pool;
+    GHashTable *cache;
+    GError *err = NULL;
+    gint64 start;
+    gint r;
+
+    if (prjcache_save (dir, projects, &err) == FALSE) {
+        g_printerr ("%s\n", err->message);
+        g_error_free (err);
+        return;
+    }
+    for (r = 0; r < opt_repeat; r++) {
+        pool = projectinfo_pool_new ();
+        start = g_get_monotonic_time ();
+        cache = prjcache_load (dir, pool);
+        bench_add (b, start);
+        if (cache != NULL) g_hash_table_unref (cache);
+        projectinfo_pool_unref (pool);
+    }
+}
+
+static void run_parse (GPtrArray *files)
+{
+    Bench *b = bench_new ("parse");
+    gint64 start;
+    guint i;
+    gint r;
+
+    for (r = 0; r < opt_repeat; r++) {
+        start = g_get_monotonic_time ();
+        for (i = 0; i < files->len; i++) {
+            projectinfo_free (projectinfo_read_file (
+                                    g_ptr_array_index (files, i), NULL));
+        }
+        bench_add (b, start);
+    }
+}
+
+static ProjectModel *fill_model (GPtrArray *projects, SearchIndex *index)
+{
+    ProjectModel *model = project_model_new (index);
+    guint i, j;
+
+    for (i = 0; i < projects->len; i += BATCH_SIZE) {
+        project_model_freeze (model);
+        for (j = i; j < MIN (i + BATCH_SIZE, projects->len); j++) {
+            project_model_set (model, g_ptr_array_index (projects, j));
+        }
+        project_model_thaw (model);
+    }
+    return model;
+}
+
+static void run_model_fill (GPtrArray *projects)
+{
+    Bench *b = bench_new ("model_fill");
+    ProjectModel *model;
+    SearchIndex *index;
+    gint64 start;
+    gint r;
+
+    for (r = 0; r < opt_repeat; r++) {
+        start = g_get_monotonic_time ();
+        index = search_index_new ();
+        model = fill_model (projects, index);
+        bench_add (b, start);
+        g_object_unref (model);
+        search_index_free (index);
+    }
+}
+
+/*
+ * 検索欄と同じく、検索中は点数順に並べたまま1文字ずつ絞り込む。
+ * 日付の指定は main.c と同じく検索語から取り除いて期間にする
+ * (ここでは年の始まりだけを扱う)。
+ */
+static void run_filter (GPtrArray *projects)
+{
+    Bench *b = bench_new ("filter_key");
+    ProjectModel *model;
+    SearchIndex *index;
+    GString *typed = g_string_new (NULL);
+    gint64 start, since;
+    const gchar *q, *p;
+    gchar *query;
+    guint i;
+    gint r, year;
+
+    index = search_index_new ();
+    model = fill_model (projects, index);
+    gtk_tree_sortable_set_sort_column_id (GTK_TREE_SORTABLE (model),
+                            PROJECT_MODEL_SORT_SCORE, GTK_SORT_ASCENDING);
+    for (r = 0; r < opt_repeat; r++) {
+        for (i = 0; i < G_N_ELEMENTS (queries); i++) {
+            since = SEARCH_TIME_MIN;
+            q = queries[i];
+            if (sscanf (q, "since:%d ", &year) == 1) {
+                GDateTime *dt = g_date_time_new_local (year, 1, 1, 0, 0, 0);
+                since = g_date_time_to_unix (dt);
+                g_date_time_unref (dt);
+                q = strchr (q, ' ') + 1;
+            }
+            g_string_truncate (typed, 0);
+            for (p = q; *p != '\0'; p = g_utf8_next_char (p)) {
+                g_string_append_len (typed, p, g_utf8_next_char (p) - p);
+                query = g_strdup (typed->str);
+                start = g_get_monotonic_time ();
+                search_index_filter (index, query, since, SEARCH_TIME_MAX);
+                project_model_refilter (model);
+                bench_add (b, start);
+                g_free (query);
+            }
+            search_index_filter (index, NULL, SEARCH_TIME_MIN,
+                                                    SEARCH_TIME_MAX);
+            project_model_refilter (model);
+        }
+    }
+    g_string_free (typed, TRUE);
+    g_object_unref (model);
+    search_index_free (index);
+}
+
+static void print_results (FILE *fp, gboolean csv, gboolean header,
+                                    guint n_projects, const gchar *date)
+{
+    guint i;
+
+    if (csv && header) {
+        fprintf (fp, "date,version,benchmark,projects,depth,size,unicode,"
+                            "runs,min_ms,median_ms,mean_ms,max_ms\n");
+    }
+    if (!csv) {
+        fprintf (fp, "{\n  \"date\": \"%s\",\n  \"version\": \"%s\",\n"
+                    "  \"projects\": %u,\n  \"depth\": %d,\n  \"size\": %d,\n"
+                    "  \"unicode\": %d,\n  \"tree\": %s,\n"
+                    "  \"results\": [", date, PACKAGE_VERSION, n_projects,
+                    opt.depth, opt.size, opt.unicode,
+                    (opt_tree != NULL) ? "\"existing\"" : "\"generated\"");
+    }
+    for (i = 0; i < benches->len; i++) {
+        Bench *b = g_ptr_array_index (benches, i);
+        GArray *s = b->samples;
+        gdouble sum = 0, min = 0, median = 0, max = 0;
+        guint j;
+
+        if (s->len != 0) {
+            g_array_sort (s, compare_double);
+            for (j = 0; j < s->len; j++) sum += g_array_index (s, gdouble, j);
+            min = g_array_index (s, gdouble, 0);
+            max = g_array_index (s, gdouble, s->len - 1);
+            median = g_array_index (s, gdouble, s->len / 2);
+            if (s->len % 2 == 0) {
+                median = (median + g_array_index (s, gdouble,
+                                                    s->len / 2 - 1)) / 2;
+            }
+        }
+        if (csv) {
+            fprintf (fp, "%s,%s,%s,%u,%d,%d,%d,%u,%.3f,%.3f,%.3f,%.3f\n",
+                        date, PACKAGE_VERSION, b->name, n_projects,
+                        opt.depth, opt.size, opt.unicode, s->len, min,
+                        median, (s->len != 0) ? sum / s->len : 0, max);
+        }
+        else {
+            fprintf (fp, "%s\n    { \"name\": \"%s\", \"runs\": %u, "
+                    "\"min_ms\": %.3f, \"median_ms\": %.3f, "
+                    "\"mean_ms\": %.3f, \"max_ms\": %.3f }",
+                    (i == 0) ? "" : ",", b->name, s->len, min, median,
+                    (s->len != 0) ? sum / s->len : 0, max);
+        }
+    }
+    if (!csv) fprintf (fp, "\n  ]\n}\n");
+}
+
+int main (int argc, char **argv)
+{
+    GOptionContext *octx;
+    GError *err = NULL;
+    GPtrArray *files = NULL, *projects;
+    ProjectinfoPool *pool;
+    ScanOptions *so;
+    GDateTime *now;
+    gchar *dir, *cachedir, *date;
+    gboolean csv, header = TRUE;
+    FILE *fp = stdout;
+    gint status = 0;
+
+    octx = g_option_context_new ("- time scanning, parsing and filtering");
+    g_option_context_add_main_entries (octx, entries, NULL);
+    if (g_option_context_parse (octx, &argc, &argv, &err) == FALSE) {
+        g_printerr ("%s\n", err->message);
+        return 1;
+    }
+    g_option_context_free (octx);
+    csv = (opt_format != NULL && !g_ascii_strcasecmp (opt_format, "csv"));
+    if (opt_format != NULL && !csv && g_ascii_strcasecmp (opt_format, "json")) {
+        g_printerr ("unknown format: %s\n", opt_format);
+        return 1;
+    }
+    if (opt.depth < 1 || opt_repeat < 1) {
+        g_printerr ("depth and repeat must be positive\n");
+        return 1;
+    }
+
+    // 利用者のキャッシュを書き換えないよう、一時ディレクトリに置く
+    cachedir = g_dir_make_tmp ("geanyproject-cache-XXXXXX", &err);
+    if (cachedir == NULL) {
+        g_printerr ("%s\n", err->message);
+        return 1;
+    }
+    g_setenv ("XDG_CACHE_HOME", cachedir, TRUE);
+
+    if (opt_tree != NULL) {
+        dir = g_canonicalize_filename (opt_tree, NULL);
+    }
+    else {
+        dir = g_dir_make_tmp ("geanyproject-bench-XXXXXX", &err);
+        if (dir == NULL) {
+            g_printerr ("%s\n", err->message);
+            return 1;
+        }
+        files = bench_tree_make (dir, &opt, &err);
+        if (files == NULL) {
+            g_printerr ("%s\n", err->message);
+            bench_tree_remove (dir);
+            return 1;
+        }
+    }
+
+    so = scan_options_new (opt.depth, MAX (opt_threads, 0), NULL);
+    pool = projectinfo_pool_new ();
+    projects = scan (dir, so, NULL, pool);
+    if (files == NULL) {
+        // 既存の木では走査で見つかったものを測る
+        guint i;
+        files = g_ptr_array_new_with_free_func (g_free);
+        for (i = 0; i < projects->len; i++) {
+            Projectinfo *prj = g_ptr_array_index (projects, i);
+            g_ptr_array_add (files, g_strdup (prj->prjfilename));
+        }
+    }
+
+    benches = g_ptr_array_new_with_free_func (bench_free);
+    run_scan (dir, files, so);
+    run_cache_load (dir, projects);
+    run_parse (files);
+    run_model_fill (projects);
+    run_filter (projects);
+
+    if (opt_output != NULL) {
+        header = !(csv && g_file_test (opt_output, G_FILE_TEST_EXISTS));
+        fp = fopen (opt_output, csv ? "a" : "w");
+        if (fp == NULL) {
+            g_printerr ("cannot write %s\n", opt_output);
+            fp = stdout;
+            status = 1;
+        }
+    }
+    now = g_date_time_new_now_local ();
+    date = g_date_time_format (now, "%Y-%m-%dT%H:%M:%S%z");
+    print_results (fp, csv, header, projects->len, date);
+    if (fp != stdout) fclose (fp);
+    g_date_time_unref (now);
+    g_free (date);
+
+    g_ptr_array_unref (benches);
+    g_ptr_array_unref (projects);
+    projectinfo_pool_unref (pool);
+    scan_options_free (so);
+    if (opt_tree == NULL) bench_tree_remove (dir);
+    bench_tree_remove (cachedir);
+    g_ptr_array_unref (files);
+    g_free (dir);
+    g_free (cachedir);
+    return status;
+}
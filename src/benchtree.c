@@ -0,0 +1,182 @@
+/*
+ * Geany プロジェクト一覧 - ベンチマーク用のプロジェクトの木
+ *
+ * Copylight by Sakai Satoru 2018
+ *
+ * endeavor2wako@gmail.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+
+/*
+ * 性能測定のための合成したプロジェクトの木
+ * geany が書き出すのと同じ形の .geany を、指定した数、深さ、大きさで作る。
+ * 名前は単語の組み合わせ、説明文の一部は日本語などの ASCII 以外の文字にし、
+ * 更新日時は古いものから新しいものまでばらつかせる。
+ */
+
+#ifdef HAVE_CONFIG_H
+#   include "config.h"
+#endif
+
+#include <sys/stat.h>
+#include <utime.h>
+#include <time.h>
+#include <errno.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "benchtree.h"
+
+static const gchar *words[] = {
+    "alpha", "bravo", "charlie", "delta", "echo", "foxtrot", "golf",
+    "hotel", "india", "juliet", "kilo", "lima", "mike", "november",
+    "oscar", "papa", "quebec", "romeo", "sierra", "tango", "uniform",
+    "victor", "whiskey", "xray", "yankee", "zulu",
+};
+
+static const gchar *unicode_descriptions[] = {
+    "サンプルのプロジェクト",
+    "日本語の説明文を持つプロジェクト\\n二行目",
+    "Café, résumé, naïve と façade",
+    "Ελληνικά κείμενα",
+    "Проект с описанием на русском",
+    "絵文字 🚀 を含む説明",
+    "中文项目描述",
+};
+
+/*
+ * i 番目のプロジェクトのディレクトリ。途中の階層は 16 に分ける
+ */
+static gchar *project_dir (const gchar *dir, const BenchTreeOptions *opt,
+                                                    gint i)
+{
+    GString *s = g_string_new (dir);
+    gint k;
+
+    for (k = 0; k < opt->depth - 1; k++) {
+        g_string_append_printf (s, "/g%u", ((guint)i >> (4 * k)) % 16);
+    }
+    g_string_append_printf (s, "/%s-%s-%d", words[i % G_N_ELEMENTS (words)],
+                words[(i / G_N_ELEMENTS (words)) % G_N_ELEMENTS (words)], i);
+    return g_string_free (s, FALSE);
+}
+
+static gchar *project_contents (const BenchTreeOptions *opt,
+                                        const gchar *sub, gint i)
+{
+    GString *s = g_string_new (NULL);
+    gchar *base, *desc;
+    gint n;
+
+    base = g_path_get_basename (sub);
+    if (i % 100 < opt->unicode) {
+        desc = g_strdup (unicode_descriptions[
+                                i % G_N_ELEMENTS (unicode_descriptions)]);
+    }
+    else {
+        desc = (i % 3 == 0) ? g_strdup ("") :
+                    g_strdup_printf ("Sample project number %d", i);
+    }
+    g_string_append_printf (s,
+        "[editor]\nline_wrapping=false\nline_break_column=72\n\n"
+        "[file_prefs]\nfinal_new_line=true\nstrip_trailing_spaces=false\n\n"
+        "[indentation]\nindent_width=4\nindent_type=0\n\n"
+        "[project]\nname=%s\ndescription=%s\nbase_path=%s/\n"
+        "file_patterns=\n\n"
+        "[long line marker]\nlong_line_behaviour=1\nlong_line_column=72\n\n"
+        "[files]\ncurrent_page=0\n", base, desc, sub);
+    for (n = 0; (gint)s->len < opt->size; n++) {
+        g_string_append_printf (s,
+            "FILE_NAME_%d=%d;C;0;EUTF-8;1;1;0;%%2Fsrc%%2Fmodule%d.c;0;4\n",
+            n, n * 37, n);
+    }
+    g_string_append (s, "\n[VTE]\nlast_dir=/home/user\n");
+    g_free (desc);
+    g_free (base);
+    return g_string_free (s, FALSE);
+}
+
+/*
+ * dir の下に木を作り、作ったプロジェクトファイル名の配列を返す
+ */
+GPtrArray *bench_tree_make (const gchar *dir, const BenchTreeOptions *opt,
+                                                        GError **error)
+{
+    GPtrArray *files = g_ptr_array_new_with_free_func (g_free);
+    struct utimbuf ut;
+    gchar *sub, *path, *contents, *base;
+    time_t now = time (NULL);
+    gint i;
+
+    for (i = 0; i < opt->count; i++) {
+        sub = project_dir (dir, opt, i);
+        if (g_mkdir_with_parents (sub, 0700) != 0) {
+            g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno),
+                                                "cannot create %s", sub);
+            g_free (sub);
+            g_ptr_array_unref (files);
+            return NULL;
+        }
+        base = g_path_get_basename (sub);
+        path = g_strdup_printf ("%s/%s.geany", sub, base);
+        contents = project_contents (opt, sub, i);
+        g_free (base);
+        g_free (sub);
+        if (g_file_set_contents (path, contents, -1, error) == FALSE) {
+            g_free (contents);
+            g_free (path);
+            g_ptr_array_unref (files);
+            return NULL;
+        }
+        g_free (contents);
+        // 更新日時は数時間おきに過去へ遡らせる
+        ut.actime = ut.modtime = now - (time_t)i * 7 * 3600;
+        g_utime (path, &ut);
+        g_ptr_array_add (files, path);
+    }
+    return files;
+}
+
+/*
+ * dir 以下を全て消す。シンボリックリンクはたどらない。
+ */
+void bench_tree_remove (const gchar *dir)
+{
+    const gchar *name;
+    GStatBuf st;
+    gchar *path;
+    GDir *d;
+
+    d = g_dir_open (dir, 0, NULL);
+    if (d != NULL) {
+        while ((name = g_dir_read_name (d)) != NULL) {
+            path = g_build_filename (dir, name, NULL);
+            if (g_lstat (path, &st) == 0 && S_ISDIR (st.st_mode)) {
+                bench_tree_remove (path);
+            }
+            else {
+                g_unlink (path);
+            }
+            g_free (path);
+        }
+        g_dir_close (d);
+    }
+    g_rmdir (dir);
+}
@@ -0,0 +1,47 @@
+/*
+ * Geany プロジェクト一覧 - ベンチマーク用のプロジェクトの木
+ *
+ * Copylight by Sakai Satoru 2018
+ *
+ * endeavor2wako@gmail.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+
+#ifndef BENCHTREE_H
+#define BENCHTREE_H
+
+#include <glib.h>
+
+/*
+ * 作るプロジェクトの木の形
+ */
+typedef struct {
+    gint count;                 // プロジェクトの数
+    gint depth;                 // 起点からプロジェクトのディレクトリまでの深さ
+    gint size;                  // .geany の大きさ (bytes, [files] で埋める)
+    gint unicode;               // 説明文が ASCII 以外のプロジェクトの割合 (%)
+} BenchTreeOptions;
+
+#define BENCH_TREE_OPTIONS_INIT     { 10000, 1, 2048, 50 }
+
+GPtrArray *bench_tree_make (const gchar *dir, const BenchTreeOptions *opt,
+                                                        GError **error);
+void bench_tree_remove (const gchar *dir);
+
+#endif /* BENCHTREE_H */
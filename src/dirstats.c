@@ -0,0 +1,628 @@
+/*
+ * Geany プロジェクト一覧 - ディレクトリの大きさ
+ *
+ * Copylight by Sakai Satoru 2018
+ *
+ * endeavor2wako@gmail.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+
+/*
+ * プロジェクトのベースパス以下の大きさ、ファイル数、一番新しく
+ * 更新したファイルを集計する。
+ *
+ * 木を全て辿るのは重いので、一覧に表示されている行 (選択中の行を
+ * 先に) の分だけをワーカースレッドで集計する。同時に辿るプロジェクト
+ * の数は max_dirs までで、idle_io なら I/O の優先度を idle にする。
+ * 表示範囲から外れたものは途中でやめる。
+ *
+ * ディレクトリごとに直下のファイルの集計とサブディレクトリの名前を
+ * 覚えてファイルに保存しておく。更新日時が変わっていないディレクトリは
+ * 読み直さないので、2回目からは stat だけで済む。ただしファイルの
+ * 書き換えはディレクトリの更新日時を変えないので、古くなった記録は
+ * 読み直す (STATS_MAX_AGE)。.git や node_modules の下も1ディレクトリ
+ * ごとに覚えるので、記録は STATS_MAX_RECORDS までとし、超えたら
+ * 長く使っていないものから捨てる (捨てたものは次に辿る時に読み直す)。
+ */
+
+#ifdef HAVE_CONFIG_H
+#   include "config.h"
+#endif
+
+#define _GNU_SOURCE
+
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <gio/gio.h>
+
+#include "dirstats.h"
+
+#define STATS_DIR           "geanyproject"
+#define STATS_FILE          "dirstats.cache"
+#define STATS_VERSION       1
+#define STATS_TYPE          "(ua(sxxttxsas))"
+#define STATS_MAX_AGE       (24 * 3600)         // これより古い記録は読み直す
+#define STATS_EXPIRE        (30 * 24 * 3600)    // これより古い記録は捨てる
+#define STATS_REFRESH       (10 * 60)           // 表示中の集計をやり直す間隔
+#define STATS_MAX_RECORDS   50000               // 覚えておくディレクトリの数
+
+/*
+ * ディレクトリ1つの記録 (直下のファイルの分だけ)
+ */
+typedef struct {
+    gint64 mtime;                   // ディレクトリの更新日時 (μ秒)
+    gint64 checked;                 // 読んだ時刻 (秒)
+    guint64 size;
+    guint64 files;
+    gint64 newest_mtime;            // 直下で一番新しいファイル (秒)
+    gchar *newest_name;
+    gchar **subdirs;                // サブディレクトリの名前
+    gint64 used;                    // 最後に集計に使った時刻 (秒。保存しない)
+} DirRecord;
+
+enum {
+    STATS_ENTRY_NONE,
+    STATS_ENTRY_PENDING,
+    STATS_ENTRY_DONE
+};
+
+typedef struct {
+    gchar *path;
+    gint state;
+    gboolean has_stats;
+    gboolean urgent;                // 急ぎで頼んである
+    gint seen;                      // 最後に表示されていた回 (generation)
+    gint claimed;                   // ワーカーが集計を始めた
+    guint n_jobs;                   // 結果の来ていない仕事の数
+    gint64 done_time;               // 集計した時刻 (秒)
+    DirStats stats;
+} StatsEntry;
+
+struct _DirStatsCache {
+    gint ref;
+    gboolean closed;
+    GMainContext *context;
+    GThreadPool *pool;
+    GCancellable *cancellable;
+    const ScanOptions *opt;         // 走査しないディレクトリ (呼び出し側が持つ)
+    gboolean idle_io;
+    gchar *filename;
+    GMutex lock;                    // 以下の3つを守る
+    GHashTable *dirs;               // パス → DirRecord
+    gboolean loaded;
+    gboolean dirty;                 // 保存していない変更がある
+    GHashTable *entries;            // パス → StatsEntry (メインループだけ)
+    gint generation;                // dir_stats_cache_begin_pass() の回数
+    guint seq;                      // 頼んだ順
+    DirStatsChangedFunc changed;
+    gpointer user_data;
+};
+
+typedef struct {
+    DirStatsCache *cache;
+    StatsEntry *entry;              // メインループでだけ書き換える
+    gchar *path;
+    gboolean urgent;
+    guint seq;
+    // 以下はワーカーが書く結果
+    gboolean claimed;               // この仕事が集計を始めた
+    gboolean skipped;               // 集計しなかった、あるいは途中でやめた
+    DirStats stats;
+} StatsJob;
+
+static void dir_record_free (gpointer data)
+{
+    DirRecord *rec = data;
+
+    g_free (rec->newest_name);
+    g_strfreev (rec->subdirs);
+    g_free (rec);
+}
+
+static void dir_stats_clear (DirStats *stats)
+{
+    g_free (stats->newest_file);
+    memset (stats, 0, sizeof (*stats));
+}
+
+static void stats_entry_free (gpointer data)
+{
+    StatsEntry *e = data;
+
+    dir_stats_clear (&e->stats);
+    g_free (e->path);
+    g_free (e);
+}
+
+static DirStatsCache *dir_stats_cache_ref (DirStatsCache *cache)
+{
+    g_atomic_int_inc (&cache->ref);
+    return cache;
+}
+
+static void dir_stats_cache_unref (DirStatsCache *cache)
+{
+    if (g_atomic_int_dec_and_test (&cache->ref)) {
+        g_hash_table_unref (cache->entries);
+        g_hash_table_unref (cache->dirs);
+        g_mutex_clear (&cache->lock);
+        g_object_unref (cache->cancellable);
+        g_main_context_unref (cache->context);
+        g_free (cache->filename);
+        g_free (cache);
+    }
+}
+
+static void stats_job_free (StatsJob *job)
+{
+    dir_stats_clear (&job->stats);
+    dir_stats_cache_unref (job->cache);
+    g_free (job->path);
+    g_free (job);
+}
+
+/*
+ * 保存した記録を読む。ロックしたまま呼ぶ。
+ */
+static void stats_load (DirStatsCache *cache)
+{
+    GMappedFile *mf;
+    GBytes *bytes;
+    GVariant *v, *records;
+    GVariantIter iter;
+    DirRecord *rec;
+    const gchar *path, *name;
+    gint64 now = g_get_real_time () / G_USEC_PER_SEC;
+    guint32 version;
+
+    mf = g_mapped_file_new (cache->filename, FALSE, NULL);
+    if (mf == NULL) return;
+    bytes = g_mapped_file_get_bytes (mf);
+    g_mapped_file_unref (mf);
+    v = g_variant_new_from_bytes (G_VARIANT_TYPE (STATS_TYPE), bytes, FALSE);
+    g_bytes_unref (bytes);
+
+    g_variant_get_child (v, 0, "u", &version);
+    if (version == STATS_VERSION) {
+        records = g_variant_get_child_value (v, 1);
+        g_variant_iter_init (&iter, records);
+        rec = g_new0 (DirRecord, 1);
+        while (g_variant_iter_next (&iter, "(&sxxttx&s^as)", &path,
+                        &rec->mtime, &rec->checked, &rec->size, &rec->files,
+                        &rec->newest_mtime, &name, &rec->subdirs)) {
+            if (now - rec->checked > STATS_EXPIRE) {
+                g_strfreev (rec->subdirs);
+                continue;
+            }
+            rec->newest_name = (*name != '\0') ? g_strdup (name) : NULL;
+            rec->used = rec->checked;
+            g_hash_table_insert (cache->dirs, g_strdup (path), rec);
+            rec = g_new0 (DirRecord, 1);
+        }
+        g_free (rec);
+        g_variant_unref (records);
+    }
+    g_variant_unref (v);
+}
+
+static void stats_save (DirStatsCache *cache)
+{
+    GVariantBuilder b;
+    GHashTableIter iter;
+    GVariant *v;
+    GError *err = NULL;
+    gpointer key, value;
+    gchar *dir;
+
+    g_variant_builder_init (&b, G_VARIANT_TYPE ("a(sxxttxsas)"));
+    g_hash_table_iter_init (&iter, cache->dirs);
+    while (g_hash_table_iter_next (&iter, &key, &value)) {
+        DirRecord *rec = value;
+        g_variant_builder_add (&b, "(sxxttxs^as)", key, rec->mtime,
+                    rec->checked, rec->size, rec->files, rec->newest_mtime,
+                    (rec->newest_name != NULL) ? rec->newest_name : "",
+                    rec->subdirs);
+    }
+    v = g_variant_ref_sink (g_variant_new ("(u@a(sxxttxsas))",
+                            STATS_VERSION, g_variant_builder_end (&b)));
+
+    dir = g_path_get_dirname (cache->filename);
+    g_mkdir_with_parents (dir, 0700);
+    g_free (dir);
+    if (g_file_set_contents (cache->filename, g_variant_get_data (v),
+                                g_variant_get_size (v), &err) == FALSE) {
+        g_warning ("%s", err->message);
+        g_error_free (err);
+    }
+    g_variant_unref (v);
+}
+
+static gint stats_compare_time (gconstpointer a, gconstpointer b)
+{
+    gint64 x = *(const gint64 *)a, y = *(const gint64 *)b;
+
+    return (x > y) - (x < y);
+}
+
+/*
+ * 記録が STATS_MAX_RECORDS を超えていれば、長く使っていないものから
+ * 捨てて 3/4 まで減らす。ロックしたまま呼ぶ。
+ */
+static void stats_trim (DirStatsCache *cache)
+{
+    GHashTableIter iter;
+    GArray *times;
+    gpointer value;
+    gint64 limit;
+    guint i, n, n_equal, keep = STATS_MAX_RECORDS / 4 * 3;
+
+    n = g_hash_table_size (cache->dirs);
+    if (n <= STATS_MAX_RECORDS) return;
+
+    times = g_array_sized_new (FALSE, FALSE, sizeof (gint64), n);
+    g_hash_table_iter_init (&iter, cache->dirs);
+    while (g_hash_table_iter_next (&iter, NULL, &value)) {
+        g_array_append_val (times, ((DirRecord *)value)->used);
+    }
+    g_array_sort (times, stats_compare_time);
+    // limit より前を全てと、limit と同じものを n_equal 個だけ捨てる
+    limit = g_array_index (times, gint64, n - keep);
+    i = n - keep;
+    while (i > 0 && g_array_index (times, gint64, i - 1) == limit) i--;
+    n_equal = n - keep - i;
+    g_array_unref (times);
+
+    g_hash_table_iter_init (&iter, cache->dirs);
+    while (g_hash_table_iter_next (&iter, NULL, &value)) {
+        DirRecord *rec = value;
+        if (rec->used < limit || (rec->used == limit && n_equal > 0)) {
+            if (rec->used == limit) n_equal--;
+            g_hash_table_iter_remove (&iter);
+        }
+    }
+    cache->dirty = TRUE;
+}
+
+/*
+ * path とその下の記録を消す。ロックしたまま呼ぶ。
+ */
+static void stats_forget (DirStatsCache *cache, const gchar *path)
+{
+    DirRecord *rec = g_hash_table_lookup (cache->dirs, path);
+    gchar **name, *child;
+
+    if (rec == NULL) return;
+    for (name = rec->subdirs; *name != NULL; name++) {
+        child = g_build_filename (path, *name, NULL);
+        stats_forget (cache, child);
+        g_free (child);
+    }
+    g_hash_table_remove (cache->dirs, path);
+}
+
+/*
+ * ディレクトリの直下を読む。
+ * d_type で分かるサブディレクトリは stat しない。
+ */
+static DirRecord *stats_read_dir (const gchar *path, gint64 mtime)
+{
+    DirRecord *rec = g_new0 (DirRecord, 1);
+    GPtrArray *subdirs = g_ptr_array_new ();
+    struct dirent *ent;
+    struct stat st;
+    DIR *dir = NULL;
+    gint fd;
+
+    rec->mtime = mtime;
+    rec->checked = g_get_real_time () / G_USEC_PER_SEC;
+    fd = open (path, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd >= 0) dir = fdopendir (fd);
+    if (dir == NULL && fd >= 0) close (fd);
+
+    while (dir != NULL && (ent = readdir (dir)) != NULL) {
+        const gchar *name = ent->d_name;
+        if (name[0] == '.' && (name[1] == '\0' ||
+                                (name[1] == '.' && name[2] == '\0'))) {
+            continue;
+        }
+        if (ent->d_type == DT_DIR) {
+            g_ptr_array_add (subdirs, g_strdup (name));
+            continue;
+        }
+        if (fstatat (fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) continue;
+        if (S_ISDIR (st.st_mode)) {
+            g_ptr_array_add (subdirs, g_strdup (name));
+            continue;
+        }
+        rec->size += (guint64)st.st_blocks * 512;
+        if (S_ISREG (st.st_mode) == FALSE) continue;
+        rec->files++;
+        if (st.st_mtime > rec->newest_mtime) {
+            rec->newest_mtime = st.st_mtime;
+            g_free (rec->newest_name);
+            rec->newest_name = g_strdup (name);
+        }
+    }
+    if (dir != NULL) closedir (dir);
+    g_ptr_array_add (subdirs, NULL);
+    rec->subdirs = (gchar **)g_ptr_array_free (subdirs, FALSE);
+    return rec;
+}
+
+static gboolean stats_aborted (StatsJob *job)
+{
+    DirStatsCache *cache = job->cache;
+
+    if (g_cancellable_is_cancelled (cache->cancellable)) return TRUE;
+    return job->urgent == FALSE &&
+            g_atomic_int_get (&job->entry->seen) !=
+                                g_atomic_int_get (&cache->generation);
+}
+
+/*
+ * path 以下を集計して out に加える。やめたら FALSE。
+ * source が FALSE なら一番新しいファイルの候補にしない。
+ */
+static gboolean stats_walk (StatsJob *job, const gchar *path,
+                                        gboolean source, DirStats *out)
+{
+    DirStatsCache *cache = job->cache;
+    DirRecord *rec, *old;
+    struct stat st;
+    gint64 mtime, now;
+    gchar **subdirs, **name, *child;
+    gboolean ok = TRUE;
+
+    if (stats_aborted (job)) return FALSE;
+    if (lstat (path, &st) != 0 || S_ISDIR (st.st_mode) == FALSE) return TRUE;
+    mtime = (gint64)st.st_mtim.tv_sec * G_USEC_PER_SEC +
+                                        st.st_mtim.tv_nsec / 1000;
+    now = g_get_real_time () / G_USEC_PER_SEC;
+
+    g_mutex_lock (&cache->lock);
+    rec = g_hash_table_lookup (cache->dirs, path);
+    if (rec == NULL || rec->mtime != mtime ||
+                                    now - rec->checked > STATS_MAX_AGE) {
+        g_mutex_unlock (&cache->lock);
+        rec = stats_read_dir (path, mtime);
+        g_mutex_lock (&cache->lock);
+
+        // 無くなったサブディレクトリの記録を消す
+        old = g_hash_table_lookup (cache->dirs, path);
+        for (name = (old != NULL) ? old->subdirs : NULL;
+                                name != NULL && *name != NULL; name++) {
+            if (g_strv_contains ((const gchar * const *)rec->subdirs,
+                                                        *name) == FALSE) {
+                child = g_build_filename (path, *name, NULL);
+                stats_forget (cache, child);
+                g_free (child);
+            }
+        }
+        // 大きな木を辿っている途中でも増えすぎないようにする
+        stats_trim (cache);
+        g_hash_table_insert (cache->dirs, g_strdup (path), rec);
+        cache->dirty = TRUE;
+    }
+    rec->used = now;
+    out->size += rec->size;
+    out->files += rec->files;
+    if (source && rec->newest_name != NULL &&
+                                rec->newest_mtime > out->newest_mtime) {
+        out->newest_mtime = rec->newest_mtime;
+        g_free (out->newest_file);
+        out->newest_file = g_build_filename (path, rec->newest_name, NULL);
+    }
+    subdirs = g_strdupv (rec->subdirs);
+    g_mutex_unlock (&cache->lock);
+
+    for (name = subdirs; ok && *name != NULL; name++) {
+        child = g_build_filename (path, *name, NULL);
+        ok = stats_walk (job, child, source && **name != '.' &&
+                            scan_options_skip (cache->opt, *name) == FALSE,
+                            out);
+        g_free (child);
+    }
+    g_strfreev (subdirs);
+    return ok;
+}
+
+/*
+ * このスレッドの I/O の優先度を idle にする (Linux のみ)
+ */
+static void stats_set_idle_io (void)
+{
+#ifdef SYS_ioprio_set
+    const gint who_process = 1, class_idle = 3, class_shift = 13;
+
+    syscall (SYS_ioprio_set, who_process, 0, class_idle << class_shift);
+#endif
+}
+
+static gboolean cb_stats_job_done (gpointer data)
+{
+    StatsJob *job = data;
+    DirStatsCache *cache = job->cache;
+    StatsEntry *e = job->entry;
+
+    if (cache->closed) return G_SOURCE_REMOVE;
+
+    e->n_jobs--;
+    if (job->urgent) e->urgent = FALSE;
+    if (job->claimed) g_atomic_int_set (&e->claimed, 0);
+    if (job->skipped == FALSE) {
+        dir_stats_clear (&e->stats);
+        e->stats = job->stats;
+        memset (&job->stats, 0, sizeof (job->stats));
+        e->has_stats = TRUE;
+        e->state = STATS_ENTRY_DONE;
+        e->done_time = g_get_real_time () / G_USEC_PER_SEC;
+        if (cache->changed != NULL) cache->changed (e->path, cache->user_data);
+    }
+    else if (e->n_jobs == 0 && e->state == STATS_ENTRY_PENDING) {
+        e->state = STATS_ENTRY_NONE;
+    }
+    return G_SOURCE_REMOVE;
+}
+
+static void stats_worker (gpointer data, gpointer user_data)
+{
+    StatsJob *job = data;
+    DirStatsCache *cache = job->cache;
+
+    // 急ぎで頼み直した時は同じ行の仕事が2つあるので、先の方だけ集計する
+    if (stats_aborted (job) ||
+        g_atomic_int_compare_and_exchange (&job->entry->claimed, 0, 1) == FALSE) {
+        job->skipped = TRUE;
+    }
+    else {
+        job->claimed = TRUE;
+        if (cache->idle_io) stats_set_idle_io ();
+        g_mutex_lock (&cache->lock);
+        if (cache->loaded == FALSE) {
+            stats_load (cache);
+            stats_trim (cache);
+            cache->loaded = TRUE;
+        }
+        g_mutex_unlock (&cache->lock);
+        job->skipped = !stats_walk (job, job->path, TRUE, &job->stats);
+    }
+    g_main_context_invoke_full (cache->context, G_PRIORITY_LOW,
+                cb_stats_job_done, job, (GDestroyNotify)stats_job_free);
+}
+
+/*
+ * 急ぎのものを先に、後は頼んだ順
+ */
+static gint stats_job_compare (gconstpointer a, gconstpointer b,
+                                                        gpointer data)
+{
+    const StatsJob *x = a, *y = b;
+
+    if (x->urgent != y->urgent) return x->urgent ? -1 : 1;
+    return (x->seq > y->seq) - (x->seq < y->seq);
+}
+
+/*
+ * opt は走査しないディレクトリ名に使う。cache より長く持っておくこと。
+ */
+DirStatsCache *dir_stats_cache_new (const ScanOptions *opt, gint max_dirs,
+                                    gboolean idle_io,
+                                    DirStatsChangedFunc changed,
+                                    gpointer user_data)
+{
+    DirStatsCache *cache = g_new0 (DirStatsCache, 1);
+
+    cache->ref = 1;
+    cache->context = g_main_context_ref_thread_default ();
+    cache->cancellable = g_cancellable_new ();
+    cache->opt = opt;
+    cache->idle_io = idle_io;
+    cache->filename = g_build_filename (g_get_user_cache_dir (),
+                                            STATS_DIR, STATS_FILE, NULL);
+    g_mutex_init (&cache->lock);
+    cache->dirs = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                            g_free, dir_record_free);
+    cache->entries = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                            NULL, stats_entry_free);
+    // I/O の優先度はスレッドごとなので、他と共有しないスレッドを使う
+    cache->pool = g_thread_pool_new (stats_worker, cache,
+                                        MAX (max_dirs, 1), TRUE, NULL);
+    g_thread_pool_set_sort_function (cache->pool, stats_job_compare, NULL);
+    cache->changed = changed;
+    cache->user_data = user_data;
+    return cache;
+}
+
+/*
+ * 集計中のものはやめて、記録を保存する
+ */
+void dir_stats_cache_free (DirStatsCache *cache)
+{
+    if (cache == NULL) return;
+
+    cache->closed = TRUE;
+    g_cancellable_cancel (cache->cancellable);
+    g_thread_pool_free (cache->pool, FALSE, TRUE);
+    if (cache->dirty) stats_save (cache);
+    dir_stats_cache_unref (cache);
+}
+
+/*
+ * 表示範囲を調べ直す前に呼ぶ。この後に頼まれなかったものは
+ * 集計をやめる。
+ */
+void dir_stats_cache_begin_pass (DirStatsCache *cache)
+{
+    g_atomic_int_inc (&cache->generation);
+}
+
+/*
+ * path が表示されているので、集計していないか古ければ集計する。
+ * urgent (選択中の行) なら他より先に行い、表示範囲から外れてもやめない。
+ */
+void dir_stats_cache_request (DirStatsCache *cache, const gchar *path,
+                                                    gboolean urgent)
+{
+    StatsEntry *e;
+    StatsJob *job;
+    gint64 now = g_get_real_time () / G_USEC_PER_SEC;
+
+    e = g_hash_table_lookup (cache->entries, path);
+    if (e == NULL) {
+        e = g_new0 (StatsEntry, 1);
+        e->path = g_strdup (path);
+        g_hash_table_insert (cache->entries, e->path, e);
+    }
+    g_atomic_int_set (&e->seen, g_atomic_int_get (&cache->generation));
+    if (e->state == STATS_ENTRY_DONE && now - e->done_time < STATS_REFRESH) {
+        return;
+    }
+    if (e->state == STATS_ENTRY_PENDING && (urgent == FALSE || e->urgent)) {
+        return;
+    }
+
+    job = g_new0 (StatsJob, 1);
+    job->cache = dir_stats_cache_ref (cache);
+    job->entry = e;
+    job->path = g_strdup (path);
+    job->urgent = urgent;
+    job->seq = cache->seq++;
+    e->state = STATS_ENTRY_PENDING;
+    e->urgent |= urgent;
+    e->n_jobs++;
+    g_thread_pool_push (cache->pool, job, NULL);
+}
+
+/*
+ * 集計した結果を返す。まだなら NULL (集計し直している間は前の結果)。
+ */
+const DirStats *dir_stats_cache_peek (DirStatsCache *cache,
+                                                    const gchar *path)
+{
+    StatsEntry *e = g_hash_table_lookup (cache->entries, path);
+
+    return (e != NULL && e->has_stats) ? &e->stats : NULL;
+}
@@ -0,0 +1,61 @@
+/*
+ * Geany プロジェクト一覧 - ディレクトリの大きさ
+ *
+ * Copylight by Sakai Satoru 2018
+ *
+ * endeavor2wako@gmail.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+
+#ifndef DIRSTATS_H
+#define DIRSTATS_H
+
+#include <glib.h>
+
+#include "scanner.h"
+
+/*
+ * ディレクトリ以下のファイルの集計
+ */
+typedef struct {
+    guint64 size;               // ディスク上の大きさ (バイト)
+    guint64 files;              // ファイルの数
+    gint64 newest_mtime;        // 一番新しく更新したファイル。隠し
+    gchar *newest_file;         // ディレクトリと走査しないディレクトリは除く
+} DirStats;
+
+typedef struct _DirStatsCache DirStatsCache;
+
+/*
+ * 集計が終わった時にメインループで呼ばれる
+ */
+typedef void (*DirStatsChangedFunc) (const gchar *path, gpointer user_data);
+
+DirStatsCache *dir_stats_cache_new (const ScanOptions *opt, gint max_dirs,
+                                    gboolean idle_io,
+                                    DirStatsChangedFunc changed,
+                                    gpointer user_data);
+void dir_stats_cache_free (DirStatsCache *cache);
+void dir_stats_cache_begin_pass (DirStatsCache *cache);
+void dir_stats_cache_request (DirStatsCache *cache, const gchar *path,
+                                                    gboolean urgent);
+const DirStats *dir_stats_cache_peek (DirStatsCache *cache,
+                                                    const gchar *path);
+
+#endif /* DIRSTATS_H */
@@ -0,0 +1,338 @@
+/*
+ * Geany プロジェクト一覧 - 読み込みのファジング
+ *
+ * Copylight by Sakai Satoru 2018
+ *
+ * endeavor2wako@gmail.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+
+/*
+ * 外から来るファイルを読む部分 (.geany、プロジェクトのキャッシュ、
+ * 全文検索の索引) に壊れた入力を与える。入力の先頭1バイトで対象を選び、
+ * 残りをファイルに書いて読ませる。
+ *
+ * libFuzzer で使う時は、中核部分も含めて計装して作る。
+ *
+ *   ./configure CC=clang CFLAGS="-g -O1 -fsanitize=fuzzer-no-link,address"
+ *   make -C src fuzz-loaders FUZZ_CFLAGS=-DFUZZ_LIBFUZZER \
+ *                            FUZZ_LDFLAGS=-fsanitize=fuzzer
+ *   ./src/fuzz-loaders corpus/
+ *
+ * FUZZ_LIBFUZZER を定義しなければ、引数のファイルを1つずつ与える。
+ * 引数が無ければ正しい入力を作り、切り詰めたものと書き換えたものを
+ * 決まった乱数列で与える (make check で実行する)。
+ */
+
+#ifdef HAVE_CONFIG_H
+#   include "config.h"
+#endif
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "prjcache.h"
+#include "projectinfo.h"
+#include "textindex.h"
+
+#define FUZZ_ROOT       "/fuzz"     // キャッシュのヘッダに書く走査の起点
+#define FUZZ_MUTATIONS  500         // 1つの対象に与える書き換えの数
+
+enum {
+    FUZZ_PROJECT,                   // .geany
+    FUZZ_PRJCACHE,
+    FUZZ_TEXTINDEX,
+    FUZZ_N_TARGETS
+};
+
+static gchar *fuzz_dir = NULL;
+
+/*
+ * 一時ディレクトリを作り、キャッシュもその下に置く。
+ * g_get_user_cache_dir() を初めて呼ぶ前に行うこと。
+ */
+static void fuzz_init (void)
+{
+    gchar *cache;
+
+    if (fuzz_dir != NULL) return;
+    fuzz_dir = g_dir_make_tmp ("geanyproject-fuzz-XXXXXX", NULL);
+    g_assert (fuzz_dir != NULL);
+    cache = g_build_filename (fuzz_dir, "cache", NULL);
+    g_setenv ("XDG_CACHE_HOME", cache, TRUE);
+    g_free (cache);
+}
+
+/*
+ * 何度も書くので g_file_set_contents() の fsync を避ける
+ */
+static void fuzz_write (const gchar *filename, const guint8 *data, gsize size)
+{
+    gchar *dir = g_path_get_dirname (filename);
+    FILE *fp;
+
+    g_mkdir_with_parents (dir, 0700);
+    g_free (dir);
+    fp = fopen (filename, "wb");
+    if (fp == NULL || fwrite (data, 1, size, fp) != size || fclose (fp) != 0) {
+        g_error ("cannot write %s", filename);
+    }
+}
+
+static void fuzz_project (const guint8 *data, gsize size)
+{
+    gchar *filename = g_build_filename (fuzz_dir, "input.geany", NULL);
+    Projectinfo *prj;
+
+    fuzz_write (filename, data, size);
+    prj = projectinfo_read_file (filename, NULL);
+    if (prj != NULL) {
+        g_free (projectinfo_get_base_dir (prj));
+        projectinfo_free (prj);
+    }
+    g_strfreev (projectinfo_read_session_files (filename));
+    g_free (projectinfo_read_session_text (filename));
+    g_free (filename);
+}
+
+static void fuzz_prjcache (const guint8 *data, gsize size)
+{
+    gchar *filename = prjcache_get_filename ();
+    ProjectinfoPool *pool = projectinfo_pool_new ();
+    GHashTable *table;
+
+    fuzz_write (filename, data, size);
+    table = prjcache_load (FUZZ_ROOT, pool);
+    if (table != NULL) g_hash_table_unref (table);
+    projectinfo_pool_unref (pool);
+    g_free (filename);
+}
+
+static void fuzz_textindex (const guint8 *data, gsize size)
+{
+    static const gchar *queries[] = { "a", "ab", "parser.c", "設計 メモ", NULL };
+    gchar *filename = g_build_filename (fuzz_dir, "input.index", NULL);
+    GPtrArray *projects = g_ptr_array_new ();
+    Projectinfo extra = { NULL };
+    GHashTable *found;
+    TextIndex *idx;
+    const gchar **q;
+
+    fuzz_write (filename, data, size);
+    idx = text_index_open (filename);
+    for (q = queries; *q != NULL; q++) {
+        found = text_index_query (idx, *q);
+        if (found != NULL) g_hash_table_unref (found);
+    }
+    // 索引に無いプロジェクトを加えて、残りの文書を全て写させる
+    extra.name = "extra";
+    extra.prjfilename = "/nonexistent/extra.geany";
+    g_ptr_array_add (projects, &extra);
+    text_index_update (idx, projects, FALSE, NULL);
+    text_index_close (idx);
+    g_ptr_array_unref (projects);
+    g_free (filename);
+}
+
+int LLVMFuzzerTestOneInput (const uint8_t *data, size_t size);
+
+int LLVMFuzzerTestOneInput (const uint8_t *data, size_t size)
+{
+    fuzz_init ();
+    if (size == 0) return 0;
+
+    switch (data[0] % FUZZ_N_TARGETS) {
+    case FUZZ_PROJECT:      fuzz_project (data + 1, size - 1);      break;
+    case FUZZ_PRJCACHE:     fuzz_prjcache (data + 1, size - 1);     break;
+    case FUZZ_TEXTINDEX:    fuzz_textindex (data + 1, size - 1);    break;
+    }
+    return 0;
+}
+
+#ifndef FUZZ_LIBFUZZER
+
+static void fuzz_run (gint target, const guint8 *data, gsize size)
+{
+    guint8 *input = g_malloc (size + 1);
+
+    input[0] = target;
+    memcpy (input + 1, data, size);
+    LLVMFuzzerTestOneInput (input, size + 1);
+    g_free (input);
+}
+
+/*
+ * 正しい入力を、切り詰めたり書き換えたりして与える
+ */
+static void fuzz_mutate (gint target, GBytes *seed, GRand *rand)
+{
+    gsize size, len, pos;
+    const guint8 *data = g_bytes_get_data (seed, &size);
+    guint8 *buf = g_malloc (size + 1);
+    gint i, j, n;
+
+    fuzz_run (target, data, size);
+    for (len = 0; len < size; len += size / 64 + 1) {
+        fuzz_run (target, data, len);
+    }
+    for (i = 0; i < FUZZ_MUTATIONS && size > 0; i++) {
+        memcpy (buf, data, size);
+        n = g_rand_int_range (rand, 1, 9);
+        for (j = 0; j < n; j++) {
+            pos = g_rand_int_range (rand, 0, size);
+            switch (g_rand_int_range (rand, 0, 3)) {
+            case 0: buf[pos] ^= 1 << g_rand_int_range (rand, 0, 8); break;
+            case 1: buf[pos] = g_rand_int_range (rand, 0, 256);     break;
+            case 2: buf[pos] = 0xff;                                break;
+            }
+        }
+        fuzz_run (target, buf, size);
+    }
+    g_free (buf);
+}
+
+static GBytes *read_bytes (const gchar *filename)
+{
+    gchar *contents;
+    gsize len;
+
+    if (!g_file_get_contents (filename, &contents, &len, NULL)) {
+        g_error ("cannot read %s", filename);
+    }
+    return g_bytes_new_take (contents, len);
+}
+
+/*
+ * それぞれの対象の正しい入力を作る
+ */
+static GBytes *seed_project (void)
+{
+    static const gchar project[] =
+        "[editor]\nline_wrapping=false\n\n"
+        "[project]\nname=fuzz\ndescription=説明\\n2行目\\s\n"
+        "base_path=./src/\n\n"
+        "[files]\ncurrent_page=0\n"
+        "FILE_NAME_0=0;C;0;EUTF-8;0;1;0;src%2Fparser.c;0;4\n"
+        "FILE_NAME_1=0;None;0;EUTF-8;0;1;0;%2Ftmp%2F%E8%A8%AD%E8%A8%88.txt;0;4\n\n"
+        "[build-menu]\nEX_00_LB=_Run\nEX_00_CM=make run\n";
+
+    return g_bytes_new_static (project, sizeof (project) - 1);
+}
+
+static GBytes *seed_prjcache (const gchar *project)
+{
+    GPtrArray *projects = g_ptr_array_new_with_free_func (
+                                        (GDestroyNotify)projectinfo_free);
+    gchar *filename;
+    GBytes *seed;
+
+    g_ptr_array_add (projects, projectinfo_read_file (project, NULL));
+    g_ptr_array_add (projects, projectinfo_read_file (project, NULL));
+    g_free (((Projectinfo *)projects->pdata[1])->prjfilename);
+    ((Projectinfo *)projects->pdata[1])->prjfilename =
+                            g_strdup ("/fuzz/日本語\tタブ\n改行.geany");
+    if (!prjcache_save (FUZZ_ROOT, projects, NULL)) g_error ("prjcache_save");
+    filename = prjcache_get_filename ();
+    seed = read_bytes (filename);
+    g_free (filename);
+    g_ptr_array_unref (projects);
+    return seed;
+}
+
+static GBytes *seed_textindex (const gchar *project)
+{
+    GPtrArray *projects = g_ptr_array_new_with_free_func (
+                                        (GDestroyNotify)projectinfo_free);
+    gchar *filename = g_build_filename (fuzz_dir, "seed.index", NULL);
+    TextIndex *idx = text_index_open (filename);
+    GBytes *seed;
+
+    g_ptr_array_add (projects, projectinfo_read_file (project, NULL));
+    if (!text_index_update (idx, projects, TRUE, NULL)) g_error ("text index");
+    text_index_close (idx);
+    seed = read_bytes (filename);
+    g_free (filename);
+    g_ptr_array_unref (projects);
+    return seed;
+}
+
+static void remove_tree (const gchar *path)
+{
+    GDir *dir = g_dir_open (path, 0, NULL);
+    const gchar *name;
+
+    while (dir != NULL && (name = g_dir_read_name (dir)) != NULL) {
+        gchar *child = g_build_filename (path, name, NULL);
+        if (g_file_test (child, G_FILE_TEST_IS_DIR) &&
+                !g_file_test (child, G_FILE_TEST_IS_SYMLINK)) {
+            remove_tree (child);
+        }
+        else {
+            g_unlink (child);
+        }
+        g_free (child);
+    }
+    if (dir != NULL) g_dir_close (dir);
+    g_rmdir (path);
+}
+
+int main (int argc, char *argv[])
+{
+    GBytes *seeds[FUZZ_N_TARGETS];
+    GRand *rand;
+    gchar *project;
+    gint i;
+
+    fuzz_init ();
+    if (argc > 1) {
+        for (i = 1; i < argc; i++) {
+            GBytes *input = read_bytes (argv[i]);
+            gsize size;
+            const guint8 *data = g_bytes_get_data (input, &size);
+
+            LLVMFuzzerTestOneInput (data, size);
+            g_bytes_unref (input);
+        }
+    }
+    else {
+        seeds[FUZZ_PROJECT] = seed_project ();
+        project = g_build_filename (fuzz_dir, "seed.geany", NULL);
+        fuzz_write (project, g_bytes_get_data (seeds[FUZZ_PROJECT], NULL),
+                            g_bytes_get_size (seeds[FUZZ_PROJECT]));
+        seeds[FUZZ_PRJCACHE] = seed_prjcache (project);
+        seeds[FUZZ_TEXTINDEX] = seed_textindex (project);
+        g_free (project);
+
+        rand = g_rand_new_with_seed (1);
+        for (i = 0; i < FUZZ_N_TARGETS; i++) {
+            fuzz_mutate (i, seeds[i], rand);
+            g_bytes_unref (seeds[i]);
+        }
+        g_rand_free (rand);
+    }
+    remove_tree (fuzz_dir);
+    g_free (fuzz_dir);
+    return 0;
+}
+
+#endif /* FUZZ_LIBFUZZER */
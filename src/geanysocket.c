@@ -0,0 +1,154 @@
+/*
+ * Geany プロジェクト一覧 - 起動中の geany との通信
+ *
+ * Copylight by Sakai Satoru 2018
+ *
+ * endeavor2wako@gmail.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+
+/*
+ * 起動中の geany にファイルを開かせる。
+ * geany は設定ディレクトリに geany_socket_<ホスト名>_<ディスプレイ名> という
+ * UNIX ドメインソケットを作り、次の形のコマンドを受け付ける。
+ *
+ *   open
+ *   /path/to/file
+ *   .
+ *
+ * .geany を渡すとプロジェクトとして開く (開いていたプロジェクトは閉じる)。
+ * 応答は無い。ソケットのディレクトリは環境変数
+ * GEANYPROJECT_GEANY_SOCKET_DIR で変えられるので、同じ形で受け付ける
+ * 代わりのプログラムを置いて試せる。
+ */
+
+#ifdef HAVE_CONFIG_H
+#   include "config.h"
+#endif
+
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <glib.h>
+
+#include "geanysocket.h"
+
+#define SOCKET_TIMEOUT  2       // 接続と送信の時間切れ (秒)
+
+/*
+ * geany と同じ規則でソケットのファイル名を作る。
+ * display はディスプレイ名 (":0.0" など)。画面番号は除き、: は _ にする。
+ */
+gchar *geany_socket_get_path (const gchar *display)
+{
+    const gchar *dir = g_getenv ("GEANYPROJECT_GEANY_SOCKET_DIR");
+    gchar *name, *p, *q, *path, *confdir = NULL;
+
+    if (dir == NULL || *dir == '\0') {
+        confdir = g_build_filename (g_get_user_config_dir (), "geany", NULL);
+        dir = confdir;
+    }
+    name = g_strdup ((display != NULL && *display != '\0') ?
+                                                display : "NODISPLAY");
+    p = strrchr (name, '.');
+    q = strrchr (name, ':');
+    if (p != NULL && q != NULL && p > q) *p = '\0';
+    for (p = name; (p = strchr (p, ':')) != NULL; ) *p = '_';
+
+    path = g_strdup_printf ("%s%cgeany_socket_%s_%s", dir, G_DIR_SEPARATOR,
+                                                g_get_host_name (), name);
+    g_free (name);
+    g_free (confdir);
+    return path;
+}
+
+static gboolean socket_write_all (int fd, const gchar *buf, gsize len,
+                                                        GError **error)
+{
+    ssize_t n;
+
+    // 相手が閉じていても SIGPIPE で終了しないようにする
+    while (len > 0) {
+        n = send (fd, buf, len, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno),
+                                        "%s", g_strerror (errno));
+            return FALSE;
+        }
+        buf += n;
+        len -= n;
+    }
+    return TRUE;
+}
+
+/*
+ * path のソケットに files を開くよう送る。geany が動いていなければ
+ * (ソケットが無いか古いもの) FALSE を返すので、呼び出し側で起動すること。
+ */
+gboolean geany_socket_open_files (const gchar *path,
+                            const gchar * const *files, GError **error)
+{
+    struct sockaddr_un addr;
+    struct timeval tv = { SOCKET_TIMEOUT, 0 };
+    GString *cmd;
+    gboolean ok;
+    int fd, e;
+
+    if (strlen (path) >= sizeof (addr.sun_path)) {
+        g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_NAMETOOLONG,
+                                    "socket path too long: %s", path);
+        return FALSE;
+    }
+    memset (&addr, 0, sizeof (addr));
+    addr.sun_family = AF_UNIX;
+    strcpy (addr.sun_path, path);
+
+    fd = socket (AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        e = errno;
+        g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (e),
+                                        "%s", g_strerror (e));
+        return FALSE;
+    }
+    // 応答しない geany で UI を止めないよう時間を限る
+    setsockopt (fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof (tv));
+    if (connect (fd, (struct sockaddr *)&addr, sizeof (addr)) != 0) {
+        e = errno;
+        g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (e),
+                                        "%s: %s", path, g_strerror (e));
+        close (fd);
+        return FALSE;
+    }
+
+    cmd = g_string_new ("open\n");
+    for (; files != NULL && *files != NULL; files++) {
+        g_string_append (cmd, *files);
+        g_string_append_c (cmd, '\n');
+    }
+    g_string_append (cmd, ".\n");
+    ok = socket_write_all (fd, cmd->str, cmd->len, error);
+    g_string_free (cmd, TRUE);
+    close (fd);
+    return ok;
+}
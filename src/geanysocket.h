@@ -0,0 +1,35 @@
+/*
+ * Geany プロジェクト一覧 - 起動中の geany との通信
+ *
+ * Copylight by Sakai Satoru 2018
+ *
+ * endeavor2wako@gmail.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+
+#ifndef GEANYSOCKET_H
+#define GEANYSOCKET_H
+
+#include <glib.h>
+
+gchar *geany_socket_get_path (const gchar *display);
+gboolean geany_socket_open_files (const gchar *path,
+                            const gchar * const *files, GError **error);
+
+#endif /* GEANYSOCKET_H */
@@ -0,0 +1,563 @@
+/*
+ * Geany プロジェクト一覧 - git の状態
+ *
+ * Copylight by Sakai Satoru 2018
+ *
+ * endeavor2wako@gmail.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+
+/*
+ * プロジェクトのディレクトリの git の状態 (ブランチ、変更の有無、
+ * upstream との差) を求めて覚えておく。
+ *
+ * git の実行は重いので、一覧に表示されている行の分だけを
+ * git_status_cache_request() で頼み、少数のワーカースレッドで順に
+ * 求める。描画では git_status_cache_peek() で覚えている結果を見るだけで、
+ * 待つことはない。頼んだ後に表示範囲から外れたものは実行せずに捨てる。
+ *
+ * 結果は .git/HEAD と .git/index の更新日時と共に覚え、どちらも
+ * 変わっていなければ git を実行し直さない。.git と作業ディレクトリは
+ * 監視し、変化があれば次に表示された時に求め直す。作業ディレクトリの
+ * 変更は index を変えないので、その時は更新日時に関わらず実行する。
+ * 作業ディレクトリの監視は最上段だけで、サブディレクトリの中の
+ * ファイルの変更は届かないので、表示中のものは GIT_STATUS_REFRESH ごとに
+ * 更新日時に関わらず求め直す。git の作業ディレクトリでなかったものも
+ * 同じ間隔で .git を探し直す (後から git init されることがある)。
+ *
+ * 監視と結果は最近表示したものから順に GIT_MONITOR_MAX と
+ * GIT_ENTRY_MAX までにする。監視をやめたものは変化を見逃している
+ * かもしれないので、次に表示された時に求め直す。
+ */
+
+#ifdef HAVE_CONFIG_H
+#   include "config.h"
+#endif
+
+#include <sys/stat.h>
+#include <string.h>
+#include <stdio.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <gio/gio.h>
+
+#include "gitstatus.h"
+
+#define GIT_STATUS_THREADS  2       // 同時に実行する git の数
+#define GIT_MONITOR_MAX     100     // 監視する作業ディレクトリの数
+#define GIT_ENTRY_MAX       1000    // 結果を覚えておく作業ディレクトリの数
+
+enum {
+    GIT_ENTRY_NONE,                 // まだ求めていない (あるいは取りやめた)
+    GIT_ENTRY_PENDING,              // ワーカーに頼んである
+    GIT_ENTRY_DONE
+};
+
+typedef struct {
+    gchar *path;
+    gint state;
+    gboolean has_status;            // status は一度でも求めたもの
+    gboolean stale;                 // 求めた後に変化があった
+    gboolean force;                 // 作業ディレクトリが変わった
+    gint seen;                      // 最後に表示されていた回 (generation)
+    gint64 done_time;               // 最後に求め終えた時刻 (秒)
+    GitStatus status;
+    gint64 head_mtime;              // status を求めた時の .git/HEAD
+    gint64 index_mtime;             // 同じく .git/index
+    GFileMonitor *git_monitor;
+    GFileMonitor *work_monitor;
+    gboolean monitored;             // 上のどちらかがある
+    GList *link;                    // lru での位置
+} GitEntry;
+
+struct _GitStatusCache {
+    gint ref;
+    gboolean closed;
+    GMainContext *context;
+    GThreadPool *pool;
+    GCancellable *cancellable;
+    GHashTable *entries;            // パス → GitEntry
+    GQueue lru;                     // GitEntry。最近頼まれたものが先頭
+    guint n_monitored;
+    gint generation;                // git_status_cache_begin_pass() の回数
+    GitStatusChangedFunc changed;
+    gpointer user_data;
+};
+
+typedef struct {
+    GitStatusCache *cache;
+    GitEntry *entry;                // メインループでだけ書き換える
+    gchar *path;
+    gboolean has_status;
+    gboolean force;
+    gint64 head_mtime, index_mtime;
+    // 以下はワーカーが書く結果
+    gboolean skipped;               // 表示範囲から外れたので実行しなかった
+    gboolean unchanged;             // 前回から変わっていない
+    gchar *gitdir;
+    GitStatus status;
+} GitJob;
+
+static void git_status_clear (GitStatus *status)
+{
+    g_free (status->branch);
+    memset (status, 0, sizeof (*status));
+}
+
+static void git_entry_cancel_monitors (GitEntry *e)
+{
+    if (e->git_monitor != NULL) {
+        g_file_monitor_cancel (e->git_monitor);
+        g_clear_object (&e->git_monitor);
+    }
+    if (e->work_monitor != NULL) {
+        g_file_monitor_cancel (e->work_monitor);
+        g_clear_object (&e->work_monitor);
+    }
+}
+
+static void git_entry_free (gpointer data)
+{
+    GitEntry *e = data;
+
+    git_entry_cancel_monitors (e);
+    git_status_clear (&e->status);
+    g_free (e->path);
+    g_free (e);
+}
+
+static GitStatusCache *git_status_cache_ref (GitStatusCache *cache)
+{
+    g_atomic_int_inc (&cache->ref);
+    return cache;
+}
+
+static void git_status_cache_unref (GitStatusCache *cache)
+{
+    if (g_atomic_int_dec_and_test (&cache->ref)) {
+        g_queue_clear (&cache->lru);
+        g_hash_table_unref (cache->entries);
+        g_object_unref (cache->cancellable);
+        g_main_context_unref (cache->context);
+        g_free (cache);
+    }
+}
+
+static void git_job_free (GitJob *job)
+{
+    git_status_clear (&job->status);
+    git_status_cache_unref (job->cache);
+    g_free (job->gitdir);
+    g_free (job->path);
+    g_free (job);
+}
+
+static gint64 git_file_mtime (const gchar *dir, const gchar *name)
+{
+    gchar *path = g_build_filename (dir, name, NULL);
+    GStatBuf st;
+    gint64 t = 0;
+
+    if (g_stat (path, &st) == 0) {
+        t = (gint64)st.st_mtim.tv_sec * G_USEC_PER_SEC +
+                                        st.st_mtim.tv_nsec / 1000;
+    }
+    g_free (path);
+    return t;
+}
+
+/*
+ * path あるいはその親にある .git を探す。
+ * .git がファイル (worktree や submodule) なら書かれている gitdir を返す。
+ */
+static gchar *git_find_gitdir (const gchar *path)
+{
+    gchar *dir = g_strdup (path), *dotgit, *contents, *parent;
+
+    for (;;) {
+        dotgit = g_build_filename (dir, ".git", NULL);
+        if (g_file_test (dotgit, G_FILE_TEST_IS_DIR)) {
+            g_free (dir);
+            return dotgit;
+        }
+        if (g_file_get_contents (dotgit, &contents, NULL, NULL)) {
+            gchar *gitdir = NULL;
+            if (g_str_has_prefix (contents, "gitdir:")) {
+                gchar *p = g_strstrip (contents + 7);
+                gitdir = g_canonicalize_filename (p, dir);
+            }
+            g_free (contents);
+            g_free (dotgit);
+            g_free (dir);
+            return gitdir;
+        }
+        g_free (dotgit);
+
+        parent = g_path_get_dirname (dir);
+        if (!strcmp (parent, dir)) {
+            g_free (parent);
+            g_free (dir);
+            return NULL;
+        }
+        g_free (dir);
+        dir = parent;
+    }
+}
+
+/*
+ * git status --porcelain=v2 --branch の出力を読む
+ */
+static void git_parse_status (const gchar *out, GitStatus *status)
+{
+    gchar **lines, **l, *oid = NULL, *head = NULL;
+
+    lines = g_strsplit (out, "\n", -1);
+    for (l = lines; *l != NULL; l++) {
+        if (g_str_has_prefix (*l, "# branch.oid ")) {
+            oid = *l + 13;
+        }
+        else if (g_str_has_prefix (*l, "# branch.head ")) {
+            head = *l + 14;
+        }
+        else if (g_str_has_prefix (*l, "# branch.upstream ")) {
+            status->has_upstream = TRUE;
+        }
+        else if (g_str_has_prefix (*l, "# branch.ab ")) {
+            sscanf (*l + 12, "+%d -%d", &status->ahead, &status->behind);
+        }
+        else if (**l != '#' && **l != '\0') {
+            status->dirty = TRUE;
+        }
+    }
+    status->is_repo = TRUE;
+    if (head != NULL && strcmp (head, "(detached)") != 0) {
+        status->branch = g_strdup (head);
+    }
+    else if (oid != NULL) {
+        status->branch = g_strndup (oid, 7);
+    }
+    g_strfreev (lines);
+}
+
+static gboolean git_run_status (GitJob *job, GCancellable *cancellable)
+{
+    static gint warned = FALSE;
+    GSubprocess *proc;
+    GError *err = NULL;
+    gchar *out = NULL;
+    gboolean ok;
+
+    // index を書き換えないよう (書き換えると監視で求め直すことになる)
+    // --no-optional-locks を付ける
+    proc = g_subprocess_new (G_SUBPROCESS_FLAGS_STDOUT_PIPE |
+                             G_SUBPROCESS_FLAGS_STDERR_SILENCE, &err,
+                             "git", "--no-optional-locks", "-C", job->path,
+                             "status", "--porcelain=v2", "--branch",
+                             "--untracked-files=no", NULL);
+    if (proc == NULL) {
+        if (g_atomic_int_compare_and_exchange (&warned, FALSE, TRUE)) {
+            g_warning ("git: %s", err->message);
+        }
+        g_error_free (err);
+        return FALSE;
+    }
+    ok = g_subprocess_communicate_utf8 (proc, NULL, cancellable,
+                                                    &out, NULL, &err);
+    if (ok == FALSE) {
+        g_subprocess_force_exit (proc);
+        g_error_free (err);
+    }
+    else if (g_subprocess_get_successful (proc) == FALSE) {
+        ok = FALSE;
+    }
+    else {
+        git_parse_status (out, &job->status);
+    }
+    g_free (out);
+    g_object_unref (proc);
+    return ok;
+}
+
+static void cb_git_changed (GFileMonitor *monitor, GFile *file,
+                            GFile *other, GFileMonitorEvent event,
+                            gpointer data);
+
+/*
+ * ワーカーの結果を反映する (メインループ)
+ */
+static gboolean cb_git_job_done (gpointer data)
+{
+    GitJob *job = data;
+    GitStatusCache *cache = job->cache;
+    GitEntry *e = job->entry;
+    GFile *file;
+
+    if (cache->closed) return G_SOURCE_REMOVE;
+
+    if (job->skipped) {
+        e->state = GIT_ENTRY_NONE;
+        e->force |= job->force;
+        return G_SOURCE_REMOVE;
+    }
+    e->state = GIT_ENTRY_DONE;
+    e->done_time = g_get_real_time () / G_USEC_PER_SEC;
+    if (job->unchanged) return G_SOURCE_REMOVE;
+
+    git_status_clear (&e->status);
+    e->status = job->status;
+    memset (&job->status, 0, sizeof (job->status));
+    e->has_status = TRUE;
+    e->head_mtime = job->head_mtime;
+    e->index_mtime = job->index_mtime;
+
+    // 変化を監視する。監視できなくても表示はできる
+    if (job->gitdir != NULL && e->git_monitor == NULL) {
+        file = g_file_new_for_path (job->gitdir);
+        e->git_monitor = g_file_monitor_directory (file,
+                                    G_FILE_MONITOR_NONE, NULL, NULL);
+        if (e->git_monitor != NULL) {
+            g_signal_connect (e->git_monitor, "changed",
+                                G_CALLBACK (cb_git_changed), cache);
+            g_object_set_data (G_OBJECT (e->git_monitor), "entry", e);
+        }
+        g_object_unref (file);
+
+        file = g_file_new_for_path (e->path);
+        e->work_monitor = g_file_monitor_directory (file,
+                                    G_FILE_MONITOR_NONE, NULL, NULL);
+        if (e->work_monitor != NULL) {
+            g_signal_connect (e->work_monitor, "changed",
+                                G_CALLBACK (cb_git_changed), cache);
+            g_object_set_data (G_OBJECT (e->work_monitor), "entry", e);
+        }
+        g_object_unref (file);
+        e->monitored = (e->git_monitor != NULL || e->work_monitor != NULL);
+        if (e->monitored) cache->n_monitored++;
+    }
+    if (cache->changed != NULL) cache->changed (e->path, cache->user_data);
+    return G_SOURCE_REMOVE;
+}
+
+static void git_worker (gpointer data, gpointer user_data)
+{
+    GitJob *job = data;
+    GitStatusCache *cache = job->cache;
+
+    if (g_cancellable_is_cancelled (cache->cancellable) ||
+            g_atomic_int_get (&job->entry->seen) !=
+                                g_atomic_int_get (&cache->generation)) {
+        // もう表示されていない
+        job->skipped = TRUE;
+    }
+    else {
+        job->gitdir = git_find_gitdir (job->path);
+        if (job->gitdir != NULL) {
+            gint64 head = git_file_mtime (job->gitdir, "HEAD");
+            gint64 index = git_file_mtime (job->gitdir, "index");
+
+            if (job->has_status && !job->force &&
+                    head == job->head_mtime && index == job->index_mtime) {
+                job->unchanged = TRUE;
+            }
+            else {
+                job->head_mtime = head;
+                job->index_mtime = index;
+                if (git_run_status (job, cache->cancellable) == FALSE) {
+                    git_status_clear (&job->status);
+                }
+            }
+        }
+    }
+    g_main_context_invoke_full (cache->context, G_PRIORITY_LOW,
+                    cb_git_job_done, job, (GDestroyNotify)git_job_free);
+}
+
+static void cb_git_changed (GFileMonitor *monitor, GFile *file,
+                            GFile *other, GFileMonitorEvent event,
+                            gpointer data)
+{
+    GitStatusCache *cache = data;
+    GitEntry *e = g_object_get_data (G_OBJECT (monitor), "entry");
+
+    switch (event) {
+    case G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT:
+    case G_FILE_MONITOR_EVENT_CREATED:
+    case G_FILE_MONITOR_EVENT_DELETED:
+    case G_FILE_MONITOR_EVENT_MOVED_IN:
+    case G_FILE_MONITOR_EVENT_MOVED_OUT:
+    case G_FILE_MONITOR_EVENT_RENAMED:
+        break;
+    default:
+        return;
+    }
+    if (e == NULL || cache->closed) return;
+
+    e->stale = TRUE;
+    if (monitor == e->work_monitor) e->force = TRUE;
+    if (cache->changed != NULL) cache->changed (e->path, cache->user_data);
+}
+
+/*
+ * changed は結果が変わった時と、監視で変化を見つけた時に呼ばれる。
+ * どちらも表示を更新し、表示範囲の行について改めて頼めばよい。
+ */
+GitStatusCache *git_status_cache_new (GitStatusChangedFunc changed,
+                                                    gpointer user_data)
+{
+    GitStatusCache *cache = g_new0 (GitStatusCache, 1);
+
+    cache->ref = 1;
+    cache->context = g_main_context_ref_thread_default ();
+    cache->cancellable = g_cancellable_new ();
+    cache->entries = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                NULL, git_entry_free);
+    cache->pool = g_thread_pool_new (git_worker, cache,
+                                        GIT_STATUS_THREADS, FALSE, NULL);
+    cache->changed = changed;
+    cache->user_data = user_data;
+    return cache;
+}
+
+/*
+ * 実行中の git は中断し、残りの仕事は実行せずに終える
+ */
+void git_status_cache_free (GitStatusCache *cache)
+{
+    if (cache == NULL) return;
+
+    cache->closed = TRUE;
+    g_cancellable_cancel (cache->cancellable);
+    g_thread_pool_free (cache->pool, FALSE, TRUE);
+    git_status_cache_unref (cache);
+}
+
+/*
+ * 表示範囲を調べ直す前に呼ぶ。この後に頼まれなかったものは
+ * まだ実行していなければ取りやめる。
+ */
+void git_status_cache_begin_pass (GitStatusCache *cache)
+{
+    GList *l, *prev;
+    GitEntry *e;
+
+    g_atomic_int_inc (&cache->generation);
+
+    // 長く表示されていないものから監視をやめる
+    for (l = cache->lru.tail; l != NULL &&
+                    cache->n_monitored > GIT_MONITOR_MAX; l = prev) {
+        prev = l->prev;
+        e = l->data;
+        if (e->monitored == FALSE) continue;
+        git_entry_cancel_monitors (e);
+        e->monitored = FALSE;
+        e->stale = TRUE;
+        e->force = TRUE;
+        cache->n_monitored--;
+    }
+
+    // 結果も忘れる。ワーカーに頼んであるものはワーカーが参照している
+    while (cache->lru.length > GIT_ENTRY_MAX) {
+        e = g_queue_peek_tail (&cache->lru);
+        if (e->state == GIT_ENTRY_PENDING) break;
+        g_queue_pop_tail (&cache->lru);
+        if (e->monitored) cache->n_monitored--;
+        g_hash_table_remove (cache->entries, e->path);
+    }
+}
+
+/*
+ * path (作業ディレクトリ) が表示されているので、状態が分からないか
+ * 古ければ求める
+ */
+void git_status_cache_request (GitStatusCache *cache, const gchar *path)
+{
+    GitEntry *e;
+    GitJob *job;
+    gint64 now = g_get_real_time () / G_USEC_PER_SEC;
+
+    e = g_hash_table_lookup (cache->entries, path);
+    if (e == NULL) {
+        e = g_new0 (GitEntry, 1);
+        e->path = g_strdup (path);
+        g_hash_table_insert (cache->entries, e->path, e);
+        g_queue_push_head (&cache->lru, e);
+        e->link = cache->lru.head;
+    }
+    else if (e->link != cache->lru.head) {
+        g_queue_unlink (&cache->lru, e->link);
+        g_queue_push_head_link (&cache->lru, e->link);
+    }
+    g_atomic_int_set (&e->seen, g_atomic_int_get (&cache->generation));
+    if (e->state == GIT_ENTRY_PENDING) return;
+    if (e->state == GIT_ENTRY_DONE && e->stale == FALSE &&
+                                now - e->done_time < GIT_STATUS_REFRESH) {
+        return;
+    }
+    // 監視の届かない変更もあるので、間隔が空けば更新日時に関わらず実行する
+    if (e->state == GIT_ENTRY_DONE &&
+                    now - e->done_time >= GIT_STATUS_REFRESH) {
+        e->force = TRUE;
+    }
+
+    job = g_new0 (GitJob, 1);
+    job->cache = git_status_cache_ref (cache);
+    job->entry = e;
+    job->path = g_strdup (path);
+    job->has_status = e->has_status;
+    job->force = e->force;
+    job->head_mtime = e->head_mtime;
+    job->index_mtime = e->index_mtime;
+    e->state = GIT_ENTRY_PENDING;
+    e->stale = FALSE;
+    e->force = FALSE;
+    g_thread_pool_push (cache->pool, job, NULL);
+}
+
+/*
+ * 覚えている状態を返す。まだ求めていなければ NULL
+ * (求め直している間は前の結果を返す)。
+ */
+const GitStatus *git_status_cache_peek (GitStatusCache *cache,
+                                                    const gchar *path)
+{
+    GitEntry *e = g_hash_table_lookup (cache->entries, path);
+
+    return (e != NULL && e->has_status) ? &e->status : NULL;
+}
+
+/*
+ * "main *  ↑1 ↓2" の形にする。git の作業ディレクトリでなければ NULL
+ */
+gchar *git_status_format (const GitStatus *status)
+{
+    GString *s;
+
+    if (status == NULL || status->is_repo == FALSE) return NULL;
+
+    s = g_string_new ((status->branch != NULL) ? status->branch : "?");
+    if (status->dirty) g_string_append (s, " *");
+    if (status->has_upstream && status->ahead > 0) {
+        g_string_append_printf (s, "  ↑%d", status->ahead);
+    }
+    if (status->has_upstream && status->behind > 0) {
+        g_string_append_printf (s, "  ↓%d", status->behind);
+    }
+    return g_string_free (s, FALSE);
+}
@@ -0,0 +1,60 @@
+/*
+ * Geany プロジェクト一覧 - git の状態
+ *
+ * Copylight by Sakai Satoru 2018
+ *
+ * endeavor2wako@gmail.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+
+#ifndef GITSTATUS_H
+#define GITSTATUS_H
+
+#include <glib.h>
+
+/*
+ * 作業ディレクトリの git の状態
+ */
+typedef struct {
+    gboolean is_repo;           // git の作業ディレクトリか
+    gchar *branch;              // ブランチ名。HEAD が分離していれば commit id
+    gboolean dirty;             // 変更がある (追跡していないファイルは除く)
+    gboolean has_upstream;
+    gint ahead, behind;         // upstream との差の commit 数
+} GitStatus;
+
+typedef struct _GitStatusCache GitStatusCache;
+
+#define GIT_STATUS_REFRESH  60      // 表示中の状態を求め直す間隔 (秒)
+
+/*
+ * 状態が変わった時にメインループで呼ばれる
+ */
+typedef void (*GitStatusChangedFunc) (const gchar *path, gpointer user_data);
+
+GitStatusCache *git_status_cache_new (GitStatusChangedFunc changed,
+                                                    gpointer user_data);
+void git_status_cache_free (GitStatusCache *cache);
+void git_status_cache_begin_pass (GitStatusCache *cache);
+void git_status_cache_request (GitStatusCache *cache, const gchar *path);
+const GitStatus *git_status_cache_peek (GitStatusCache *cache,
+                                                    const gchar *path);
+gchar *git_status_format (const GitStatus *status);
+
+#endif /* GITSTATUS_H */
@@ -31,6 +31,7 @@
 #include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <time.h>
 #include <errno.h>
@@ -42,30 +43,21 @@
 #include <gdk/gdkkeysyms.h>
 #include <gtk/gtk.h>
 
-#define CONFIGFILE  "geany/geany.conf"
-#define PROJECTNAME "_GEANYPROJECT_NAME"
-
-/*
- * プロジェクトの情報
- */
-typedef struct {
-    gchar *name;            // プロジェクト名
-    gchar *description;     // プロジェクトの説明
-    gchar *prjfilename;     // プロジェクトファイルの絶対パス
-    gchar *base_path;       // プロジェクトのベースパス
-    gchar *timestamp;       // プロジェクトファイルの最終更新日時
-} Projectinfo;
+#include "projectinfo.h"
+#include "geanysocket.h"
+#include "dirstats.h"
+#include "gitstatus.h"
+#include "ownerindex.h"
+#include "prjcache.h"
+#include "profile.h"
+#include "scanner.h"
+#include "searchindex.h"
+#include "textindex.h"
+#include "usage.h"
+#include "projectmodel.h"
 
-/*
- * GtkTreeViewでのカラム位置
- */
-enum {
-    _P_NAME = 0,
-    _P_DESCRIPTION,
-    _P_TIMESTAMP,
-    _P_PRJFILENAME,
-    _P_BASE_PATH,
-};
+#define CONFIGFILE  "geany/geany.conf"
+#define APPCONFIGFILE "geanyproject/geanyproject.conf"
 
 /*
  * geany設定の格納場所
@@ -73,112 +65,234 @@ enum {
 gchar *prjpath = NULL;
 gchar *terminal_cmd = NULL;
 
+/*
+ * このプログラム自体の設定 (APPCONFIGFILE)
+ */
+static gchar **scan_roots = NULL;           // 走査の起点 (既定は prjpath)
+static gchar *scan_roots_key = NULL;        // キャッシュの識別用
+static ScanOptions *scan_options = NULL;
+static gboolean reuse_geany = FALSE;        // 起動中の geany で開く
+static gboolean resident = FALSE;           // ウィンドウを閉じても終わらない
+static gboolean fixed_rows = FALSE;         // 行の高さを揃えて速く描く
+static gint stats_max_dirs = 1;             // 同時に集計するプロジェクトの数
+static gboolean stats_idle_io = TRUE;       // 集計の I/O 優先度を idle にする
+
 enum {
     _LAUNCH_GEANY = 1,
     _LAUNCH_TERMINAL,
     _LAUNCH_GITG,
 };
 
-Projectinfo *projectinfo_new ()
+/*
+ * バックグラウンドでのプロジェクト読み込み
+ * 走査はワーカースレッドで行い、結果はまとめてメインループへ渡す。
+ */
+#define SCAN_BATCH_SIZE      64         // 一度に UI へ渡す最大件数
+#define SCAN_BATCH_INTERVAL  100000     // 件数に満たなくてもこの間隔(μs)で渡す
+typedef struct {
+    gchar *root;                // 走査の起点 (キャッシュの識別に使う)
+    gboolean incremental;       // ファイル監視による部分的な読み直し
+    GMutex lock;                // 以下は走査スレッド間で共有する
+    GPtrArray *roots;           // 走査するディレクトリ (ScanDir)
+    GPtrArray *paths;           // 確認するプロジェクトファイル (部分読み直し用)
+    GCancellable *cancellable;
+    ProjectinfoPool *pool;      // この走査で読んだ Projectinfo の置き場所
+    GPtrArray *batch;           // UI へ未送信の Projectinfo
+    gint64 last_flush;          // 最後に UI へ渡した時刻
+    guint count;                // 読み込んだプロジェクトの件数
+    GHashTable *cache;          // 前回のキャッシュ (見つかったものから取り出す)
+    GPtrArray *all;             // 見つかった全プロジェクト (キャッシュ保存用)
+    GPtrArray *dirs;            // 走査したディレクトリ (ScanDir, 監視用)
+    GPtrArray *gone;            // 無くなっていたディレクトリ
+    gint64 profile_start;       // 計測用の開始時刻
+} ScanContext;
+
+typedef struct {
+    ProjectinfoPool *pool;      // batch の Projectinfo の置き場所
+    GPtrArray *batch;           // 追加あるいは更新された Projectinfo
+    GPtrArray *removed;         // 無くなったプロジェクトファイル名
+    guint count;
+    gboolean incremental;
+    GCancellable *cancellable;
+} ScanBatch;
+
+static gboolean cb_scan_batch (gpointer data);
+
+static void scan_batch_free (gpointer data)
 {
-    Projectinfo *prj = g_malloc (sizeof(Projectinfo));
-    if (prj != NULL) {
-        prj->name = NULL;
-        prj->description = NULL;
-        prj->prjfilename = NULL;
-        prj->base_path = NULL;
-        prj->timestamp = NULL;
-    }
-    return prj;
+    ScanBatch *b = data;
+
+    g_ptr_array_unref (b->batch);
+    projectinfo_pool_unref (b->pool);
+    if (b->removed != NULL) g_ptr_array_unref (b->removed);
+    g_object_unref (b->cancellable);
+    g_free (b);
 }
 
-void projectinfo_free (Projectinfo *prj)
+/*
+ * 溜まった Projectinfo をメインループへ送る
+ */
+static void scan_flush (ScanContext *ctx, GPtrArray *removed)
 {
-    if (prj != NULL) {
-        g_free (prj->name);
-        g_free (prj->description);
-        g_free (prj->prjfilename);
-        g_free (prj->base_path);
-        g_free (prj->timestamp);
-        g_free (prj);
-    }
+    ScanBatch *b;
+
+    ctx->last_flush = g_get_monotonic_time ();
+    if (ctx->batch->len == 0 && removed == NULL) return;
+
+    b = g_new (ScanBatch, 1);
+    b->pool = projectinfo_pool_ref (ctx->pool);
+    b->batch = ctx->batch;
+    b->removed = removed;
+    b->count = ctx->count;
+    b->incremental = ctx->incremental;
+    b->cancellable = g_object_ref (ctx->cancellable);
+    g_main_context_invoke_full (NULL, G_PRIORITY_DEFAULT,
+                                cb_scan_batch, b, scan_batch_free);
+
+    ctx->batch = g_ptr_array_new ();
 }
 
 /*
- * 指定したファイルからプロジェクトの情報を得る
- * 返されたProjectinfoは使用後開放すること。
+ * 見つかったプロジェクトファイルを処理する。
+ * キャッシュと stat 情報が一致すれば読まずに済ませる (UI には表示済み)。
+ * 複数の走査スレッドから呼ばれる。
+ * 読んだ内容は走査の pool に写すので、個別の確保と解放は読み込みの間だけ。
  */
-Projectinfo *projectinfo_read_file (gchar *file)
+static void scan_add (const gchar *path, const GStatBuf *st, gpointer data)
 {
-    GKeyFile *kprjconf;
-    Projectinfo *prj;
-    struct stat st;
-    gchar buf[20];  // yyyy-mm-dd  hh:mm
-
-    kprjconf = g_key_file_new ();
-    prj = projectinfo_new ();
-    if (g_key_file_load_from_file (
-            kprjconf, file, G_KEY_FILE_NONE, NULL) == TRUE) {
-        prj->name = g_strdup (g_key_file_get_string (kprjconf,
-                                "project", "name", NULL));
-        prj->description = g_strdup (g_key_file_get_string (kprjconf,
-                                "project", "description", NULL));
-        prj->base_path = g_strdup (g_key_file_get_string (kprjconf,
-                                "project", "base_path", NULL));
-        prj->prjfilename = g_strdup (file);
-        lstat (prj->prjfilename, &st);
-        strftime (buf, sizeof(buf), "%F  %R", localtime (&st.st_mtime));
-        prj->timestamp = g_strdup (buf);
+    ScanContext *ctx = data;
+    Projectinfo *prj = NULL, *tmp;
+
+    g_mutex_lock (&ctx->lock);
+    ctx->count++;
+    if (ctx->cache != NULL) {
+        prj = g_hash_table_lookup (ctx->cache, path);
+        if (prj != NULL) {
+            g_hash_table_steal (ctx->cache, path);
+            if (projectinfo_stat_equal (prj, st) == TRUE) {
+                g_ptr_array_add (ctx->all, prj);
+                g_mutex_unlock (&ctx->lock);
+                return;
+            }
+        }
     }
-
-    g_key_file_free (kprjconf);
-    return prj;
+    g_mutex_unlock (&ctx->lock);
+
+    // 読み込みはロックの外で行い、他のスレッドを待たせない
+    // (キャッシュの Projectinfo は pool にあるので解放しない)
+    tmp = projectinfo_read_file (path, st);
+
+    g_mutex_lock (&ctx->lock);
+    prj = projectinfo_pool_copy (ctx->pool, tmp);
+    g_ptr_array_add (ctx->all, prj);
+    g_ptr_array_add (ctx->batch, prj);
+    if (ctx->batch->len >= SCAN_BATCH_SIZE ||
+        g_get_monotonic_time () - ctx->last_flush >= SCAN_BATCH_INTERVAL) {
+        scan_flush (ctx, NULL);
+    }
+    g_mutex_unlock (&ctx->lock);
+    projectinfo_free (tmp);
 }
 
-static void projectview_set_projectinfo (Projectinfo *prj);
-
 /*
- * 指定されたディレクトリの中で [hoge].geanyファイルを探して表示関数に渡す
+ * 走査したディレクトリを記録する (ファイル監視に使う)
  */
-static void read_project_all (gchar *dir, gint level)
+static void scan_add_dir (const gchar *path, gint level, gpointer data)
 {
-    GDir *project_dir;
-    const gchar *file;
-    gchar *path, *ext;
-    Projectinfo *prj;
-    gint i;
+    ScanContext *ctx = data;
 
-    /* サブディレクトリは1段しかチェックしない */
-    if (level > 1) return;
+    g_mutex_lock (&ctx->lock);
+    g_ptr_array_add (ctx->dirs, scan_dir_new (path, level));
+    g_mutex_unlock (&ctx->lock);
+}
 
-    project_dir = g_dir_open (dir, 0, NULL);
+static void scan_context_free (gpointer data)
+{
+    ScanContext *ctx = data;
+
+    g_free (ctx->root);
+    g_object_unref (ctx->cancellable);
+    g_ptr_array_unref (ctx->roots);
+    g_ptr_array_unref (ctx->paths);
+    g_ptr_array_unref (ctx->batch);
+    g_ptr_array_unref (ctx->all);
+    projectinfo_pool_unref (ctx->pool);
+    g_ptr_array_unref (ctx->dirs);
+    g_ptr_array_unref (ctx->gone);
+    if (ctx->cache != NULL) g_hash_table_unref (ctx->cache);
+    g_mutex_clear (&ctx->lock);
+    g_free (ctx);
+}
 
-    if (project_dir == NULL) {
-        g_error (_("Fail to open directory."));
-        return;
+static void scan_thread_func (GTask *task, gpointer source_object,
+                                gpointer task_data, GCancellable *cancellable)
+{
+    ScanContext *ctx = task_data;
+    GPtrArray *removed = NULL;
+    GHashTableIter iter;
+    gpointer key;
+    GError *err = NULL;
+    GPtrArray *roots;
+    GStatBuf st;
+    ScanDir *d;
+    gchar *path;
+    guint i;
+
+    ctx->last_flush = g_get_monotonic_time ();
+    roots = g_ptr_array_new ();
+    for (i = 0; i < ctx->roots->len; i++) {
+        d = g_ptr_array_index (ctx->roots, i);
+        if (g_stat (d->path, &st) == 0 && S_ISDIR (st.st_mode)) {
+            g_ptr_array_add (roots, d);
+        }
+        else {
+            g_ptr_array_add (ctx->gone, g_strdup (d->path));
+        }
     }
-
-    while ((file = g_dir_read_name (project_dir)) != NULL) {
-        path = g_strdup_printf ("%s/%s", dir, file);
-        if (g_file_test (path, G_FILE_TEST_IS_DIR) == TRUE) {
-            // ディレクトリなのでその中に .geany がないか探す
-            read_project_all (path, level+1);
+    // 指定されたディレクトリ以下を並列に走査する
+    scanner_walk (scan_options, roots, scan_add, scan_add_dir,
+                                                    ctx, cancellable);
+    g_ptr_array_unref (roots);
+
+    // 個別に指定されたプロジェクトファイル。無ければ一覧から外す
+    for (i = 0; i < ctx->paths->len; i++) {
+        path = g_ptr_array_index (ctx->paths, i);
+        if (g_stat (path, &st) == 0 && S_ISREG (st.st_mode)) {
+            scan_add (path, &st, ctx);
         }
         else {
-            /* 拡張子が geany なら内容を読む */
-            ext = g_strrstr (file, ".geany");
-            if (ext != NULL) {
-                /* ファイル名の途中に.geanyが含まれている場合は扱わない */
-                if (!g_strcmp0 (ext, ".geany")) {
-                    prj = projectinfo_read_file (path);
-                    projectview_set_projectinfo (prj);
-                    projectinfo_free (prj);
-                }
+            if (removed == NULL) {
+                removed = g_ptr_array_new_with_free_func (g_free);
             }
+            g_ptr_array_add (removed, g_strdup (path));
         }
-        g_free (path);
     }
-    g_dir_close (project_dir);
+
+    if (ctx->incremental == FALSE &&
+                g_cancellable_is_cancelled (cancellable) == FALSE) {
+        // キャッシュに残ったものは見つからなかった (削除された) プロジェクト
+        if (ctx->cache != NULL && g_hash_table_size (ctx->cache) != 0) {
+            if (removed == NULL) {
+                removed = g_ptr_array_new_with_free_func (g_free);
+            }
+            g_hash_table_iter_init (&iter, ctx->cache);
+            while (g_hash_table_iter_next (&iter, &key, NULL)) {
+                g_ptr_array_add (removed, g_strdup (key));
+            }
+        }
+        // 全体を走査し終えた時だけキャッシュを書き換える
+        gint64 start = PROFILE_BEGIN ();
+        if (prjcache_save (ctx->root, ctx->all, &err) == FALSE) {
+            g_warning ("%s", err->message);
+            g_error_free (err);
+        }
+        PROFILE_END ("cache save", start);
+    }
+    g_mutex_lock (&ctx->lock);
+    scan_flush (ctx, removed);
+    g_mutex_unlock (&ctx->lock);
+
+    g_task_return_boolean (task, TRUE);
 }
 
 /*
@@ -211,155 +325,1485 @@ GKeyFile *load_geany_config (void)
     return kf;
 }
 
+/*
+ * このプログラムの設定を読む。ファイルが無ければ既定値を使う。
+ *
+ * [scan]
+ * roots=~/projects;/srv/work     走査の起点 (既定は geany の project_file_path)
+ * max_depth=1                    サブディレクトリを何段まで調べるか
+ * skip=.git;node_modules;build   走査しないディレクトリ名 (*, ? が使える)
+ * threads=0                      走査スレッド数 (0 ならプロセッサ数)
+ *
+ * [launch]
+ * reuse_geany=false              起動中の geany があればそれでプロジェクトを
+ *                                開く (無ければ geany を起動する)
+ *
+ * [window]
+ * resident=false                 ウィンドウを閉じても隠すだけで常駐する
+ *                                (--resident と同じ)
+ * fixed_rows=false               行の高さと列の幅を固定して速く描く。説明文は
+ *                                1行に切り詰め、選択したものを下に全て表示する
+ *
+ * [stats]
+ * max_dirs=1                     大きさの集計で同時に辿るプロジェクトの数
+ * idle_io=true                   集計の I/O を他に譲る (ionice -c3 と同じ)
+ */
+static void load_app_config (void)
+{
+    static const gchar *default_skip[] = {
+        ".git", ".hg", ".svn", "node_modules", "build", "_build", NULL
+    };
+    GKeyFile *kf;
+    gchar *filename, **roots, **skip;
+    GPtrArray *v;
+    gint max_depth, threads;
+
+    filename = g_build_filename (g_get_user_config_dir(), APPCONFIGFILE, NULL);
+    kf = g_key_file_new ();
+    g_key_file_load_from_file (kf, filename, G_KEY_FILE_NONE, NULL);
+    g_free (filename);
+
+    // 起点は監視で得るパスと一致させるため正規化しておく
+    v = g_ptr_array_new ();
+    roots = g_key_file_get_string_list (kf, "scan", "roots", NULL, NULL);
+    if (roots != NULL) {
+        gchar **r;
+        for (r = roots; *r != NULL; r++) {
+            gchar *root = g_strstrip (*r);
+            if (*root == '\0') continue;
+            if (root[0] == '~' && (root[1] == '/' || root[1] == '\0')) {
+                gchar *tmp = g_build_filename (g_get_home_dir (), root + 1, NULL);
+                g_ptr_array_add (v, g_canonicalize_filename (tmp, NULL));
+                g_free (tmp);
+            }
+            else {
+                g_ptr_array_add (v, g_canonicalize_filename (root, NULL));
+            }
+        }
+        g_strfreev (roots);
+    }
+    if (v->len == 0 && prjpath != NULL) {
+        g_ptr_array_add (v, g_strdup (prjpath));
+    }
+    g_ptr_array_add (v, NULL);
+    scan_roots = (gchar **)g_ptr_array_free (v, FALSE);
+    scan_roots_key = g_strjoinv (";", scan_roots);
+
+    max_depth = g_key_file_has_key (kf, "scan", "max_depth", NULL) ?
+            g_key_file_get_integer (kf, "scan", "max_depth", NULL) : 1;
+    threads = g_key_file_get_integer (kf, "scan", "threads", NULL);
+    skip = g_key_file_get_string_list (kf, "scan", "skip", NULL, NULL);
+    scan_options = scan_options_new (max_depth, MAX (threads, 0),
+                            (skip != NULL) ? skip : (gchar **)default_skip);
+    g_strfreev (skip);
+
+    reuse_geany = g_key_file_get_boolean (kf, "launch", "reuse_geany", NULL);
+
+    resident = g_key_file_get_boolean (kf, "window", "resident", NULL);
+    fixed_rows = g_key_file_get_boolean (kf, "window", "fixed_rows", NULL);
+
+    if (g_key_file_has_key (kf, "stats", "max_dirs", NULL)) {
+        stats_max_dirs = MAX (g_key_file_get_integer (kf, "stats",
+                                                    "max_dirs", NULL), 1);
+    }
+    if (g_key_file_has_key (kf, "stats", "idle_io", NULL)) {
+        stats_idle_io = g_key_file_get_boolean (kf, "stats", "idle_io", NULL);
+    }
+
+    g_key_file_free (kf);
+}
+
+/*
+ * プロジェクトを開いた履歴。開けなければ記録も並べ替えもしない。
+ */
+static UsageStore *usage = NULL;
+
+static UsageStore *usage_get (void)
+{
+    static gboolean tried = FALSE;
+    GError *err = NULL;
+
+    if (tried == FALSE) {
+        tried = TRUE;
+        usage = usage_store_open (NULL, &err);
+        if (usage == NULL) {
+            g_warning ("%s", err->message);
+            g_error_free (err);
+        }
+    }
+    return usage;
+}
+
+static void usage_record (const gchar *prjfilename)
+{
+    if (prjfilename == NULL || usage_get () == NULL) return;
+    usage_store_record (usage, prjfilename,
+                                g_get_real_time () / G_USEC_PER_SEC);
+}
+
+static gdouble project_frecency (const Projectinfo *prj, gpointer data)
+{
+    return usage_store_get (usage, prj->prjfilename,
+                                g_get_real_time () / G_USEC_PER_SEC);
+}
+
 /*
  * UI
  */
 static GtkWidget *ui;
-static GtkListStore *projectlist;
+static ProjectModel *projectlist;
+static SearchIndex *searchindex;
+
+static GtkWidget *search_entry;
+static gchar *searchvalue;          // 現在の検索語 (コピーを持つ)
+static guint refilter_tick = 0;     // 絞り込みの予約 (tick callback)
+static GCancellable *scan_cancellable = NULL;   // 読み込み中なら非 NULL
+static gint user_sort_id = PROJECT_MODEL_SORT_FRECENCY;
+static GtkSortType user_sort_order = GTK_SORT_ASCENDING;
+static gboolean sorted_by_score = FALSE;
+
+/*
+ * 検索中は点数順に並べ、検索語が空になったら元の並びに戻す
+ */
+static void projectview_sort_by_score (gboolean active)
+{
+    GtkTreeSortable *sortable = GTK_TREE_SORTABLE (projectlist);
+
+    if (active && !sorted_by_score) {
+        gtk_tree_sortable_get_sort_column_id (sortable,
+                                        &user_sort_id, &user_sort_order);
+        gtk_tree_sortable_set_sort_column_id (sortable,
+                            PROJECT_MODEL_SORT_SCORE, GTK_SORT_ASCENDING);
+        sorted_by_score = TRUE;
+    }
+    else if (!active && sorted_by_score) {
+        gtk_tree_sortable_set_sort_column_id (sortable,
+                                        user_sort_id, user_sort_order);
+        sorted_by_score = FALSE;
+    }
+}
+
+/*
+ * yyyy, yyyy-mm, yyyy-mm-dd の形の日付を地方時の UNIX 時刻にする。
+ * end が TRUE ならその年、月、日の最後の秒を返す。
+ */
+static gboolean parse_date (const gchar *s, gboolean end, gint64 *t)
+{
+    GDateTime *dt, *next;
+    gint y, m = 0, d = 0, n = 0, i;
+
+    for (i = 0; i < 4; i++) {
+        if (!g_ascii_isdigit (s[i])) return FALSE;
+    }
+    if (sscanf (s, "%4d%n-%2d%n-%2d%n", &y, &n, &m, &n, &d, &n) < 1 ||
+                                            s[n] != '\0' || n < 4) {
+        return FALSE;
+    }
+    dt = g_date_time_new_local (y, MAX (m, 1), MAX (d, 1), 0, 0, 0);
+    if (dt == NULL) return FALSE;
+    if (end == TRUE) {
+        next = (d != 0) ? g_date_time_add_days (dt, 1) :
+               (m != 0) ? g_date_time_add_months (dt, 1) :
+                          g_date_time_add_years (dt, 1);
+        *t = g_date_time_to_unix (next) - 1;
+        g_date_time_unref (next);
+    }
+    else {
+        *t = g_date_time_to_unix (dt);
+    }
+    g_date_time_unref (dt);
+    return TRUE;
+}
+
+/*
+ * 検索語から since:日付 と until:日付 を取り出し、残りの検索語を返す。
+ * 入力途中の日付のように読めないものは無視する。
+ */
+static gchar *parse_date_range (const gchar *text,
+                                    gint64 *since, gint64 *until)
+{
+    GString *rest = g_string_new (NULL);
+    gchar **words, **w;
+
+    *since = SEARCH_TIME_MIN;
+    *until = SEARCH_TIME_MAX;
+    words = g_strsplit_set (text, " \t", -1);
+    for (w = words; *w != NULL; w++) {
+        if (g_str_has_prefix (*w, "since:")) {
+            parse_date (*w + 6, FALSE, since);
+        }
+        else if (g_str_has_prefix (*w, "until:")) {
+            parse_date (*w + 6, TRUE, until);
+        }
+        else if (**w != '\0') {
+            if (rest->len != 0) g_string_append_c (rest, ' ');
+            g_string_append (rest, *w);
+        }
+    }
+    g_strfreev (words);
+    return g_string_free (rest, FALSE);
+}
+
+/*
+ * 検索語から owner:PATH を取り出し、残りを返す。
+ * PATH は ~ を展開して正規化する。
+ */
+static gchar *parse_owner (const gchar *text, gchar **owner)
+{
+    GString *rest = g_string_new (NULL);
+    gchar **words, **w, *path;
+
+    *owner = NULL;
+    words = g_strsplit_set (text, " \t", -1);
+    for (w = words; *w != NULL; w++) {
+        if (g_str_has_prefix (*w, "owner:") && (*w)[6] != '\0') {
+            path = *w + 6;
+            g_free (*owner);
+            if (path[0] == '~' && (path[1] == '/' || path[1] == '\0')) {
+                gchar *tmp = g_build_filename (g_get_home_dir (), path + 1, NULL);
+                *owner = g_canonicalize_filename (tmp, NULL);
+                g_free (tmp);
+            }
+            else {
+                *owner = g_canonicalize_filename (path, NULL);
+            }
+        }
+        else if (**w != '\0') {
+            if (rest->len != 0) g_string_append_c (rest, ' ');
+            g_string_append (rest, *w);
+        }
+    }
+    g_strfreev (words);
+    return g_string_free (rest, FALSE);
+}
 
-static const gchar *searchvalue;
+/*
+ * ファイルの持ち主の索引。走査の後にワーカーで作ったものに差し替える
+ * (index_sync_start())。それまでは前回保存したものを owner: で初めて
+ * 使う時に読む。メインループでは引くだけで、書き換えない。
+ */
+static OwnerIndex *ownerindex = NULL;
 
-static gboolean
-visible_func (GtkTreeModel *model,
-              GtkTreeIter  *iter,
-              gpointer      data)
+/*
+ * 検索語から text:WORD を取り出し、残りを返す。
+ * 複数あれば空白で繋げて *words に入れる。無ければ NULL。
+ */
+static gchar *parse_text (const gchar *text, gchar **words)
 {
-    gchar *description, *name, *timestamp;
-    gboolean f = TRUE;
+    GString *rest = g_string_new (NULL);
+    GString *found = NULL;
+    gchar **split, **w;
+
+    split = g_strsplit_set (text, " \t", -1);
+    for (w = split; *w != NULL; w++) {
+        if (g_str_has_prefix (*w, "text:") && (*w)[5] != '\0') {
+            if (found == NULL) found = g_string_new (NULL);
+            else g_string_append_c (found, ' ');
+            g_string_append (found, *w + 5);
+        }
+        else if (**w != '\0') {
+            if (rest->len != 0) g_string_append_c (rest, ' ');
+            g_string_append (rest, *w);
+        }
+    }
+    g_strfreev (split);
+    *words = (found != NULL) ? g_string_free (found, FALSE) : NULL;
+    return g_string_free (rest, FALSE);
+}
 
-    gtk_tree_model_get (model, iter, _P_NAME, &name, -1);
-    gtk_tree_model_get (model, iter, _P_DESCRIPTION, &description, -1);
-    gtk_tree_model_get (model, iter, _P_TIMESTAMP, &timestamp, -1);
-    if (strlen (searchvalue) != 0) {
-        // 検索文字列が名前及び説明文に含まれない場合は表示しない
-        if (g_strrstr (description, searchvalue) == NULL &&
-            g_strrstr (name, searchvalue) == NULL &&
-            g_strrstr (timestamp, searchvalue) == NULL) f = FALSE;
+/*
+ * path を持つプロジェクトのファイル名の集合
+ */
+static GHashTable *projectview_lookup_owner (const gchar *path)
+{
+    GHashTable *only;
+    GPtrArray *owners;
+    guint i;
+
+    if (ownerindex == NULL) ownerindex = owner_index_new (NULL);
+    owners = owner_index_lookup (ownerindex, path);
+    only = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+    for (i = 0; i < owners->len; i++) {
+        g_hash_table_add (only, g_strdup (g_ptr_array_index (owners, i)));
     }
-    g_free (description);
+    g_ptr_array_unref (owners);
+    return only;
+}
+
+/*
+ * 全文検索の索引。ownerindex と同じく、走査の後にワーカーで更新した
+ * ものに差し替える。それまでは前回のものを text: で初めて使う時に開く。
+ */
+static TextIndex *textindex = NULL;
 
-    return f;
+/*
+ * words を全て含むプロジェクトのファイル名の集合。語が無ければ NULL
+ */
+static GHashTable *projectview_lookup_text (const gchar *words)
+{
+    if (textindex == NULL) textindex = text_index_open (NULL);
+    return text_index_query (textindex, words);
 }
 
+static gboolean cb_only_remove (gpointer key, gpointer value, gpointer data)
+{
+    return !g_hash_table_contains ((GHashTable *)data, key);
+}
 
-static void projectview_set_projectinfo (Projectinfo *prj)
+/*
+ * path を持ち、words を全て含むプロジェクトだけを表示する。
+ * どちらも NULL なら全て。
+ */
+static void projectview_set_only (const gchar *path, const gchar *words)
 {
-    GtkTreeIter iter;
-    if (prj == NULL) return;
-    gtk_list_store_insert (projectlist, &iter, 0);
-    gtk_list_store_set (projectlist, &iter,
-                            _P_NAME,        prj->name,
-                            _P_DESCRIPTION, prj->description,
-                            _P_TIMESTAMP,   prj->timestamp,
-                            _P_PRJFILENAME, prj->prjfilename,
-                            _P_BASE_PATH,   prj->base_path,
-                            -1);
+    GHashTable *only = NULL, *found = NULL;
+
+    if (path != NULL) only = projectview_lookup_owner (path);
+    if (words != NULL) found = projectview_lookup_text (words);
+    if (only == NULL) {
+        only = found;
+    }
+    else if (found != NULL) {
+        g_hash_table_foreach_remove (only, cb_only_remove, found);
+        g_hash_table_unref (found);
+    }
+    project_model_set_only (projectlist, only);
+    if (only != NULL) g_hash_table_unref (only);
+}
+
+/*
+ * 検索語が変わったので表示する行を選び直す
+ */
+static void projectview_refilter (const gchar *text)
+{
+    gint64 since, until, start;
+    gchar *query, *rest, *rest2, *owner, *words;
+
+    if (!g_strcmp0 (searchvalue, text)) return;
+    start = PROFILE_BEGIN ();
+    g_free (searchvalue);
+    searchvalue = g_strdup (text);
+    // 検索語の文字が名前、説明文及びパスにこの順で現れない場合と、
+    // 更新日時が期間外の場合は表示しない。検索語が伸びただけなら、
+    // 今表示している行だけが調べられる
+    // 点数が変わるので、点数順の時は並べ替えも行われる
+    // owner:PATH があれば、そのファイルを持つプロジェクトに限る
+    // text:WORD があれば、開いていたファイルやビルドコマンドも含めて
+    // WORD を含むプロジェクトに限る
+    rest = parse_owner (searchvalue, &owner);
+    rest2 = parse_text (rest, &words);
+    query = parse_date_range (rest2, &since, &until);
+    projectview_set_only (owner, words);
+    search_index_filter (searchindex, query, since, until);
+    projectview_sort_by_score (*query != '\0');
+    project_model_refilter (projectlist);
+    g_free (query);
+    g_free (rest2);
+    g_free (rest);
+    g_free (words);
+    g_free (owner);
+    PROFILE_END ("refilter", start);
+}
+
+/*
+ * 索引が新しくなったので、owner: と text: の絞り込みをやり直す
+ */
+static void projectview_reapply_only (void)
+{
+    gchar *rest, *rest2, *owner, *words;
+
+    if (searchvalue == NULL) return;
+    rest = parse_owner (searchvalue, &owner);
+    rest2 = parse_text (rest, &words);
+    if (owner != NULL || words != NULL) {
+        projectview_set_only (owner, words);
+        project_model_refilter (projectlist);
+    }
+    g_free (rest2);
+    g_free (rest);
+    g_free (words);
+    g_free (owner);
+}
+
+static gboolean cb_refilter_tick (GtkWidget *widget,
+                                    GdkFrameClock *clock, gpointer data)
+{
+    GtkEntryBuffer *buffer = GTK_ENTRY_BUFFER (data);
+
+    refilter_tick = 0;
+    projectview_refilter (gtk_entry_buffer_get_text (buffer));
+    return G_SOURCE_REMOVE;
+}
+
+/*
+ * 絞り込みを次のフレームの描画前に行うよう予約する。
+ * IME の確定や貼り付けで続けて届く変更は1回の絞り込みにまとまる。
+ */
+static void projectview_queue_refilter (GtkEntryBuffer *buffer)
+{
+    if (refilter_tick != 0) return;
+    if (ui != NULL && gtk_widget_get_mapped (ui)) {
+        refilter_tick = gtk_widget_add_tick_callback (ui, cb_refilter_tick,
+                                                        buffer, NULL);
+    }
+    else {
+        cb_refilter_tick (NULL, NULL, buffer);
+    }
+}
+
+
+/*
+ * 読み込みの進捗表示
+ */
+static GtkWidget *scan_header;
+static GtkWidget *scan_spinner;
+static GtkWidget *btn_scan_stop;
+
+static void scan_set_progress (guint count, gboolean running)
+{
+    gchar *msg;
+
+    if (scan_header == NULL) return;
+    msg = g_strdup_printf (running ? _("Loading projects... %u") :
+                                     _("%u projects"), count);
+    gtk_header_bar_set_subtitle (GTK_HEADER_BAR (scan_header), msg);
+    g_free (msg);
+
+    if (running) {
+        gtk_spinner_start (GTK_SPINNER (scan_spinner));
+    }
+    else {
+        gtk_spinner_stop (GTK_SPINNER (scan_spinner));
+    }
+    gtk_widget_set_visible (scan_spinner, running);
+    gtk_widget_set_visible (btn_scan_stop, running);
+}
+
+/*
+ * ワーカースレッドから届いたプロジェクトを一覧に追加する (メインループ)
+ */
+static gboolean cb_scan_batch (gpointer data)
+{
+    ScanBatch *b = data;
+    gint64 start;
+    guint i;
+
+    // 中断後に届いたものは捨てる (ウィンドウが既に無い場合がある)
+    if (g_cancellable_is_cancelled (b->cancellable)) return G_SOURCE_REMOVE;
+
+    start = PROFILE_BEGIN ();
+    // 並びの作り直しと通知はまとめて1回にする
+    project_model_freeze (projectlist);
+    for (i = 0; i < b->batch->len; i++) {
+        project_model_set (projectlist, g_ptr_array_index (b->batch, i));
+    }
+    for (i = 0; b->removed != NULL && i < b->removed->len; i++) {
+        project_model_remove (projectlist, g_ptr_array_index (b->removed, i));
+    }
+    project_model_thaw (projectlist);
+    if (b->incremental == FALSE) {
+        scan_set_progress (b->count, TRUE);
+    }
+    PROFILE_END ("batch insert", start);
+
+    return G_SOURCE_REMOVE;
+}
+
+static ScanContext *scan_context_new (const gchar *root,
+                                            GCancellable *cancellable)
+{
+    ScanContext *ctx = g_new0 (ScanContext, 1);
+
+    g_mutex_init (&ctx->lock);
+    ctx->root = g_strdup (root);
+    ctx->cancellable = g_object_ref (cancellable);
+    ctx->roots = g_ptr_array_new_with_free_func (
+                                (GDestroyNotify)scan_dir_free);
+    ctx->paths = g_ptr_array_new_with_free_func (g_free);
+    ctx->pool = projectinfo_pool_new ();
+    ctx->batch = g_ptr_array_new ();
+    ctx->all = g_ptr_array_new ();
+    ctx->dirs = g_ptr_array_new_with_free_func (
+                                (GDestroyNotify)scan_dir_free);
+    ctx->gone = g_ptr_array_new_with_free_func (g_free);
+    return ctx;
+}
+
+static void scan_run (ScanContext *ctx, GAsyncReadyCallback callback)
+{
+    GTask *task;
+
+    ctx->profile_start = PROFILE_BEGIN ();
+    task = g_task_new (NULL, ctx->cancellable, callback, NULL);
+    g_task_set_task_data (task, ctx, scan_context_free);
+    g_task_run_in_thread (task, scan_thread_func);
+    g_object_unref (task);
+}
+
+/*
+ * ファイルの持ち主と全文検索の索引の更新
+ * 走査とファイル監視での読み直しが終わる度に、一覧のプロジェクトを
+ * ワーカースレッドで索引と突き合わせる。索引は保存してあるものから
+ * 作り、変わったプロジェクトだけを読み直して保存してから差し替える。
+ */
+typedef struct {
+    ProjectinfoPool *pool;
+    GPtrArray *projects;        // 一覧の写し (文字列は pool にある)
+    OwnerIndex *owners;         // 作った索引
+    TextIndex *text;
+} IndexSync;
+
+static GCancellable *index_cancellable = NULL;
+static gboolean index_busy = FALSE;     // 更新の実行中
+static gboolean index_again = FALSE;    // 実行中に一覧が変わった
+
+static void index_sync_free (gpointer data)
+{
+    IndexSync *s = data;
+
+    owner_index_free (s->owners);
+    text_index_close (s->text);
+    g_ptr_array_unref (s->projects);
+    projectinfo_pool_unref (s->pool);
+    g_free (s);
+}
+
+static void cb_index_collect (const Projectinfo *prj, gpointer data)
+{
+    IndexSync *s = data;
+
+    g_ptr_array_add (s->projects, projectinfo_pool_copy (s->pool, prj));
+}
+
+static void index_thread_func (GTask *task, gpointer source_object,
+                                gpointer task_data, GCancellable *cancellable)
+{
+    IndexSync *s = task_data;
+    GError *err = NULL;
+    gint64 start = PROFILE_BEGIN ();
+    guint i;
+
+    s->owners = owner_index_new (NULL);
+    owner_index_begin_sync (s->owners);
+    for (i = 0; i < s->projects->len; i++) {
+        if (g_task_return_error_if_cancelled (task)) return;
+        owner_index_update (s->owners, g_ptr_array_index (s->projects, i));
+    }
+    owner_index_end_sync (s->owners);
+    owner_index_save (s->owners);
+    PROFILE_END ("owner index", start);
+
+    start = PROFILE_BEGIN ();
+    s->text = text_index_open (NULL);
+    if (!text_index_update (s->text, s->projects, TRUE, &err)) {
+        g_warning ("%s", err->message);
+        g_error_free (err);
+    }
+    PROFILE_END ("text index", start);
+
+    g_task_return_boolean (task, TRUE);
+}
+
+static void index_sync_start (void);
+
+static void cb_index_sync_finished (GObject *source, GAsyncResult *res,
+                                                            gpointer data)
+{
+    GTask *task = G_TASK (res);
+    IndexSync *s = g_task_get_task_data (task);
+    GError *err = NULL;
+
+    index_busy = FALSE;
+    g_task_propagate_boolean (task, &err);
+    if (err != NULL) {
+        // 中断された場合はウィンドウが既に無い事があるので何もしない
+        g_error_free (err);
+        return;
+    }
+    owner_index_free (ownerindex);
+    ownerindex = s->owners;
+    s->owners = NULL;
+    text_index_close (textindex);
+    textindex = s->text;
+    s->text = NULL;
+    projectview_reapply_only ();
+
+    if (index_again) {
+        index_again = FALSE;
+        index_sync_start ();
+    }
+}
+
+static void index_sync_start (void)
+{
+    IndexSync *s;
+    GTask *task;
+
+    if (index_busy) {
+        index_again = TRUE;
+        return;
+    }
+    if (index_cancellable == NULL) index_cancellable = g_cancellable_new ();
+
+    s = g_new0 (IndexSync, 1);
+    s->pool = projectinfo_pool_new ();
+    s->projects = g_ptr_array_new ();
+    project_model_foreach (projectlist, cb_index_collect, s);
+
+    index_busy = TRUE;
+    task = g_task_new (NULL, index_cancellable, cb_index_sync_finished, NULL);
+    g_task_set_task_data (task, s, index_sync_free);
+    g_task_run_in_thread (task, index_thread_func);
+    g_object_unref (task);
+}
+
+static void index_shutdown (void)
+{
+    if (index_cancellable == NULL) return;
+
+    g_cancellable_cancel (index_cancellable);
+    g_clear_object (&index_cancellable);
 }
 
 /*
- * UI に格納されたプロジェクトファイル名を引数にして geany を起動する
- * ダブル fork で このプログラム自体から切り離して起動する。
+ * ファイル監視
+ * 走査したディレクトリを監視し、変化のあったプロジェクトファイルだけを
+ * 読み直す。短時間に続くイベント (git checkout など) はまとめて処理する。
+ */
+#define MONITOR_DELAY   250     // イベントをまとめる時間 (ms)
+
+static GHashTable *monitors = NULL;     // ディレクトリ → GFileMonitor
+static GHashTable *pending_paths;       // 変化のあったプロジェクトファイル
+static GHashTable *pending_dirs;        // 変化のあったディレクトリ → 深さ
+static GCancellable *monitor_cancellable = NULL;
+static guint monitor_timer = 0;
+static gboolean monitor_busy = FALSE;   // 読み直しの実行中
+
+static gboolean cb_monitor_timeout (gpointer data);
+
+static gboolean monitor_skip (const gchar *path)
+{
+    gchar *name = g_path_get_basename (path);
+    gboolean ret = scan_options_skip (scan_options, name);
+
+    g_free (name);
+    return ret;
+}
+
+static void monitor_queue (const gchar *path, gint level, gboolean appeared)
+{
+    if (path == NULL) return;
+
+    if (scanner_is_project_file (path)) {
+        g_hash_table_add (pending_paths, g_strdup (path));
+    }
+    else if (appeared == TRUE && level <= scan_options->max_depth &&
+                monitor_skip (path) == FALSE) {
+        // ディレクトリかどうかはワーカースレッドで調べる
+        g_hash_table_insert (pending_dirs, g_strdup (path),
+                                                GINT_TO_POINTER (level));
+    }
+    else if (appeared == FALSE && g_hash_table_contains (monitors, path)) {
+        // 監視中のディレクトリが無くなった
+        g_hash_table_insert (pending_dirs, g_strdup (path),
+                                                GINT_TO_POINTER (level));
+    }
+    else {
+        return;
+    }
+
+    if (monitor_timer == 0) {
+        monitor_timer = g_timeout_add (MONITOR_DELAY,
+                                            cb_monitor_timeout, NULL);
+    }
+}
+
+static void cb_monitor_changed (GFileMonitor *monitor,
+                                GFile *file, GFile *other_file,
+                                GFileMonitorEvent event, gpointer data)
+{
+    gint level = GPOINTER_TO_INT (g_object_get_data (G_OBJECT (monitor),
+                                                            "level")) + 1;
+    gchar *path = g_file_get_path (file);
+    gchar *other = (other_file != NULL) ? g_file_get_path (other_file) : NULL;
+
+    switch (event) {
+        case G_FILE_MONITOR_EVENT_CREATED:
+        case G_FILE_MONITOR_EVENT_MOVED_IN:
+        case G_FILE_MONITOR_EVENT_CHANGED:
+        case G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT:
+            monitor_queue (path, level, TRUE);
+            break;
+        case G_FILE_MONITOR_EVENT_DELETED:
+        case G_FILE_MONITOR_EVENT_MOVED_OUT:
+            monitor_queue (path, level, FALSE);
+            break;
+        case G_FILE_MONITOR_EVENT_RENAMED:
+            monitor_queue (path, level, FALSE);
+            monitor_queue (other, level, TRUE);
+            break;
+        default:
+            break;
+    }
+    g_free (path);
+    g_free (other);
+}
+
+static void monitor_add_dir (const gchar *dir, gint level)
+{
+    GFileMonitor *monitor;
+    GFile *file;
+    GError *err = NULL;
+
+    if (g_hash_table_contains (monitors, dir)) return;
+
+    file = g_file_new_for_path (dir);
+    monitor = g_file_monitor_directory (file, G_FILE_MONITOR_WATCH_MOVES,
+                                                            NULL, &err);
+    g_object_unref (file);
+    if (monitor == NULL) {
+        g_warning ("%s", err->message);
+        g_error_free (err);
+        return;
+    }
+    g_object_set_data (G_OBJECT (monitor), "level", GINT_TO_POINTER (level));
+    g_signal_connect (monitor, "changed",
+                        G_CALLBACK (cb_monitor_changed), NULL);
+    g_hash_table_insert (monitors, g_strdup (dir), monitor);
+}
+
+/*
+ * ディレクトリが無くなったので、その下の監視と一覧の行を取り除く
+ */
+static void monitor_remove_dir (const gchar *dir)
+{
+    GHashTableIter iter;
+    gpointer key;
+    gchar *prefix;
+
+    prefix = g_strconcat (dir, G_DIR_SEPARATOR_S, NULL);
+    g_hash_table_iter_init (&iter, monitors);
+    while (g_hash_table_iter_next (&iter, &key, NULL)) {
+        if (!g_strcmp0 (key, dir) || g_str_has_prefix (key, prefix)) {
+            g_hash_table_iter_remove (&iter);
+        }
+    }
+    g_free (prefix);
+    project_model_remove_under (projectlist, dir);
+}
+
+static void monitor_add_scanned (ScanContext *ctx)
+{
+    ScanDir *d;
+    guint i;
+
+    for (i = 0; i < ctx->gone->len; i++) {
+        monitor_remove_dir (g_ptr_array_index (ctx->gone, i));
+    }
+    for (i = 0; i < ctx->dirs->len; i++) {
+        d = g_ptr_array_index (ctx->dirs, i);
+        monitor_add_dir (d->path, d->level);
+    }
+}
+
+static void cb_monitor_update_finished (GObject *source, GAsyncResult *res,
+                                                            gpointer data)
+{
+    GTask *task = G_TASK (res);
+    GError *err = NULL;
+
+    monitor_busy = FALSE;
+    g_task_propagate_boolean (task, &err);
+    if (err != NULL) {
+        g_error_free (err);
+        return;
+    }
+    monitor_add_scanned (g_task_get_task_data (task));
+    index_sync_start ();
+}
+
+/*
+ * 溜まったイベントをまとめて読み直す
+ */
+static gboolean cb_monitor_timeout (gpointer data)
+{
+    ScanContext *ctx;
+    GHashTableIter iter;
+    gpointer key, value;
+
+    // 前回の読み直しが終わるまで待つ (結果の順序が入れ替わらないように)
+    if (monitor_busy == TRUE) return G_SOURCE_CONTINUE;
+    monitor_timer = 0;
+
+    ctx = scan_context_new (scan_roots_key, monitor_cancellable);
+    ctx->incremental = TRUE;
+    g_hash_table_iter_init (&iter, pending_dirs);
+    while (g_hash_table_iter_next (&iter, &key, &value)) {
+        g_ptr_array_add (ctx->roots,
+                    scan_dir_new (key, GPOINTER_TO_INT (value)));
+    }
+    g_hash_table_iter_init (&iter, pending_paths);
+    while (g_hash_table_iter_next (&iter, &key, NULL)) {
+        g_hash_table_iter_steal (&iter);
+        g_ptr_array_add (ctx->paths, key);
+    }
+    g_hash_table_remove_all (pending_dirs);
+
+    monitor_busy = TRUE;
+    scan_run (ctx, cb_monitor_update_finished);
+
+    return G_SOURCE_REMOVE;
+}
+
+static void monitor_init (void)
+{
+    if (monitors != NULL) return;
+
+    monitors = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                        g_free, (GDestroyNotify)g_object_unref);
+    pending_paths = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                            g_free, NULL);
+    pending_dirs = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                            g_free, NULL);
+    monitor_cancellable = g_cancellable_new ();
+}
+
+static void monitor_shutdown (void)
+{
+    if (monitors == NULL) return;
+
+    g_cancellable_cancel (monitor_cancellable);
+    g_clear_object (&monitor_cancellable);
+    if (monitor_timer != 0) {
+        g_source_remove (monitor_timer);
+        monitor_timer = 0;
+    }
+    // GFileMonitor は最後の参照が外れた時に監視を止める
+    g_clear_pointer (&monitors, g_hash_table_unref);
+    g_clear_pointer (&pending_paths, g_hash_table_unref);
+    g_clear_pointer (&pending_dirs, g_hash_table_unref);
+}
+
+static void cb_scan_finished (GObject *source, GAsyncResult *res,
+                                                    gpointer data)
+{
+    GTask *task = G_TASK (res);
+    ScanContext *ctx = g_task_get_task_data (task);
+    GError *err = NULL;
+
+    g_task_propagate_boolean (task, &err);
+    if (err != NULL) {
+        // 中断された場合はウィンドウが既に無い事があるので何もしない
+        g_error_free (err);
+        return;
+    }
+    if (scan_cancellable == ctx->cancellable) {
+        g_clear_object (&scan_cancellable);
+    }
+    scan_set_progress (ctx->count, FALSE);
+    PROFILE_END ("scan", ctx->profile_start);
+    PROFILE_MARK ("scan finished");
+
+    // 前回の読み込みから残っている文字列を一度に解放する
+    project_model_compact (projectlist);
+
+    // 以降の変化はファイル監視で追従する
+    monitor_init ();
+    monitor_add_scanned (ctx);
+    index_sync_start ();
+}
+
+/*
+ * プロジェクトの読み込みを開始する。結果は随時一覧に追加される。
+ * cache は前回の内容で、cache とその置き場所 pool の所有権は
+ * ワーカースレッドに移る。この走査で読んだものも pool に置く。
+ */
+static void scan_start (gchar **roots, GHashTable *cache,
+                                        ProjectinfoPool *pool)
+{
+    ScanContext *ctx;
+
+    if (roots == NULL || *roots == NULL) {
+        if (cache != NULL) g_hash_table_unref (cache);
+        projectinfo_pool_unref (pool);
+        return;
+    }
+
+    scan_cancellable = g_cancellable_new ();
+    ctx = scan_context_new (scan_roots_key, scan_cancellable);
+    for (; *roots != NULL; roots++) {
+        g_ptr_array_add (ctx->roots, scan_dir_new (*roots, 0));
+    }
+    ctx->cache = cache;
+    projectinfo_pool_unref (ctx->pool);
+    ctx->pool = pool;
+    scan_run (ctx, cb_scan_finished);
+
+    scan_set_progress (0, TRUE);
+}
+
+static void scan_cancel (void)
+{
+    if (scan_cancellable != NULL) {
+        g_cancellable_cancel (scan_cancellable);
+        g_clear_object (&scan_cancellable);
+    }
+}
+
+static void cb_btnscanstop_clicked (GtkWidget *widget, gpointer data)
+{
+    guint count = project_model_get_n_projects (projectlist);
+    scan_cancel ();
+    scan_set_progress (count, FALSE);
+}
+
+/*
+ * 起動したプログラムがこれより早く異常終了したら、起動の失敗として知らせる
+ */
+#define LAUNCH_FAIL_TIME    (3 * G_USEC_PER_SEC)
+
+typedef struct {
+    gchar *program;
+    gint64 started;
+} LaunchWatch;
+
+/*
+ * エラーをダイアログで知らせる。応答を待たずに戻る。
+ */
+static void show_error (const gchar *format, ...) G_GNUC_PRINTF (1, 2);
+static void show_error (const gchar *format, ...)
+{
+    GtkWidget *dialog;
+    va_list args;
+    gchar *message;
+
+    va_start (args, format);
+    message = g_strdup_vprintf (format, args);
+    va_end (args);
+
+    if (ui == NULL) {
+        g_warning ("%s", message);
+        g_free (message);
+        return;
+    }
+    dialog = gtk_message_dialog_new (GTK_WINDOW (ui),
+                            GTK_DIALOG_DESTROY_WITH_PARENT,
+                            GTK_MESSAGE_ERROR, GTK_BUTTONS_CLOSE,
+                            "%s", message);
+    g_signal_connect (dialog, "response",
+                            G_CALLBACK (gtk_widget_destroy), NULL);
+    gtk_widget_show (dialog);
+    g_free (message);
+}
+
+static void cb_launch_exited (GPid pid, gint status, gpointer data)
+{
+    LaunchWatch *w = data;
+
+    if (g_get_monotonic_time () - w->started < LAUNCH_FAIL_TIME) {
+        if (WIFEXITED (status) && WEXITSTATUS (status) != 0) {
+            show_error (_("%s exited with status %d."),
+                                    w->program, WEXITSTATUS (status));
+        }
+        else if (WIFSIGNALED (status)) {
+            show_error (_("%s was terminated by signal %d."),
+                                    w->program, WTERMSIG (status));
+        }
+    }
+    g_spawn_close_pid (pid);
+    g_free (w->program);
+    g_free (w);
+}
+
+/*
+ * argv を起動し、終了はメインループの child watch で見届ける (待たない)。
+ * 作業ディレクトリや child_setup を指定しないので、g_spawn は使える所では
+ * posix_spawn で起動し、このプロセスを複製しない。
+ */
+static void launch_spawn (gchar **argv)
+{
+    LaunchWatch *w;
+    GError *err = NULL;
+    GPid pid;
+
+    if (g_spawn_async (NULL, argv, NULL,
+                        G_SPAWN_SEARCH_PATH | G_SPAWN_DO_NOT_REAP_CHILD,
+                        NULL, NULL, &pid, &err) == FALSE) {
+        show_error (_("Failed to start %s: %s"), argv[0], err->message);
+        g_error_free (err);
+        return;
+    }
+    w = g_new (LaunchWatch, 1);
+    w->program = g_strdup (argv[0]);
+    w->started = g_get_monotonic_time ();
+    g_child_watch_add (pid, cb_launch_exited, w);
+}
+
+/*
+ * 端末の中で、引数のディレクトリで利用者のシェルを起動するスクリプト。
+ * geany の terminal_cmd の %c には実行するスクリプトを渡す。
+ */
+static gchar *launch_shell_script (GError **error)
+{
+    static const gchar script[] =
+        "#!/bin/sh\n"
+        "cd \"$1\" 2>/dev/null\n"
+        "exec \"${SHELL:-/bin/sh}\"\n";
+    gchar *dir, *path, *contents = NULL;
+
+    dir = g_build_filename (g_get_user_cache_dir (), PACKAGE, NULL);
+    path = g_build_filename (dir, "shell.sh", NULL);
+    g_mkdir_with_parents (dir, 0700);
+    g_free (dir);
+    if (g_file_get_contents (path, &contents, NULL, NULL) == FALSE ||
+                                            strcmp (contents, script)) {
+        if (g_file_set_contents (path, script, -1, error) == FALSE) {
+            g_free (contents);
+            g_free (path);
+            return NULL;
+        }
+    }
+    g_free (contents);
+    return path;
+}
+
+/*
+ * geany の terminal_cmd をそのまま使い、%c は上のスクリプトと
+ * ディレクトリに置き換える。%c の無い設定では、以前と同じく
+ * --working-directory を付け加える。
+ */
+static gchar **launch_terminal_argv (const gchar *dir, GError **error)
+{
+    GPtrArray *v;
+    gchar **argv, **a, *script = NULL, *quoted = NULL;
+    gboolean has_command = FALSE;
+
+    if (terminal_cmd == NULL || *terminal_cmd == '\0') {
+        g_set_error_literal (error, G_SHELL_ERROR, G_SHELL_ERROR_EMPTY_STRING,
+                                _("No terminal is configured in Geany."));
+        return NULL;
+    }
+    if (g_shell_parse_argv (terminal_cmd, NULL, &argv, error) == FALSE) {
+        return NULL;
+    }
+
+    v = g_ptr_array_new ();
+    for (a = argv; *a != NULL; a++) {
+        if (strstr (*a, "%c") != NULL) {
+            gchar **parts;
+
+            if (quoted == NULL) {
+                script = launch_shell_script (error);
+                if (script == NULL) {
+                    g_ptr_array_set_free_func (v, g_free);
+                    g_ptr_array_unref (v);
+                    g_strfreev (argv);
+                    return NULL;
+                }
+                gchar *q1 = g_shell_quote (script);
+                gchar *q2 = g_shell_quote (dir);
+                quoted = g_strconcat (q1, " ", q2, NULL);
+                g_free (q1);
+                g_free (q2);
+            }
+            parts = g_strsplit (*a, "%c", -1);
+            g_ptr_array_add (v, g_strjoinv (quoted, parts));
+            g_strfreev (parts);
+            has_command = TRUE;
+        }
+        else {
+            g_ptr_array_add (v, g_strdup (*a));
+        }
+    }
+    if (has_command == FALSE) {
+        g_ptr_array_add (v, g_strdup_printf ("--working-directory=%s", dir));
+    }
+    g_ptr_array_add (v, NULL);
+    g_strfreev (argv);
+    g_free (script);
+    g_free (quoted);
+    return (gchar **)g_ptr_array_free (v, FALSE);
+}
+
+/*
+ * 起動中の geany にプロジェクトを開かせる。送れなければ FALSE を返す。
+ */
+static gboolean launch_geany_socket (const gchar *prjfilename)
+{
+    const gchar *files[] = { prjfilename, NULL };
+    GdkDisplay *display = gdk_display_get_default ();
+    GError *err = NULL;
+    gchar *path;
+    gboolean ok;
+
+    if (prjfilename == NULL) return FALSE;
+    path = geany_socket_get_path ((display != NULL) ?
+                                    gdk_display_get_name (display) : NULL);
+    ok = geany_socket_open_files (path, files, &err);
+    if (ok == FALSE) {
+        g_debug ("%s", err->message);
+        g_error_free (err);
+    }
+    g_free (path);
+    return ok;
+}
+
+/*
+ * UI で選ばれたプロジェクトで geany、端末あるいは gitg を起動する。
+ * widget が NULL ならプロジェクトを指定せずに geany を起動する。
  */
 static void launch_geany (GtkWidget *widget, int mode)
 {
     GtkTreeSelection *selection;
     GtkTreeModel *store;
     GtkTreeIter iter;
-    gchar *execprj;
-    pid_t pid, pid_2;
-    int status;
+    gchar *prjfilename = NULL, *base_path = NULL, **argv;
+    GError *err = NULL;
 
     if (GTK_IS_TREE_VIEW(widget)) {
         // UIからプロジェクト名あるいはベースパスを得る
         selection = gtk_tree_view_get_selection (GTK_TREE_VIEW(widget));
         store = gtk_tree_view_get_model (GTK_TREE_VIEW(widget));
         if (gtk_tree_selection_get_selected (selection, &store,
-                                                    &iter) == TRUE) {
-            if (mode == _LAUNCH_GEANY) {
-                gtk_tree_model_get (store, &iter, _P_PRJFILENAME,
-                                                        &execprj, -1);
-            }
-            else if (mode == _LAUNCH_TERMINAL) {
-                gchar *tmp;
-                gtk_tree_model_get (store, &iter, _P_BASE_PATH,
-                                                        &tmp, -1);
-                execprj = g_strdup_printf ("--working-directory=%s", tmp);
-                g_free (tmp);
-            }
-            else if (mode == _LAUNCH_GITG) {
-                gtk_tree_model_get (store, &iter, _P_BASE_PATH,
-                                                        &execprj, -1);
+                                                    &iter) == FALSE) {
+            return;
+        }
+        gtk_tree_model_get (store, &iter, _P_PRJFILENAME, &prjfilename,
+                                        _P_BASE_PATH, &base_path, -1);
+        usage_record (prjfilename);
+    }
+
+    if (mode == _LAUNCH_GEANY) {
+        if (reuse_geany == FALSE) {
+            gchar *geany_argv[] = { "geany", "-i", prjfilename, NULL };
+            launch_spawn (geany_argv);
+        }
+        else if (launch_geany_socket (prjfilename) == FALSE) {
+            // 起動した geany が次からソケットで受け付ける
+            gchar *geany_argv[] = { "geany", prjfilename, NULL };
+            launch_spawn (geany_argv);
+        }
+    }
+    else if (mode == _LAUNCH_TERMINAL && base_path != NULL) {
+        argv = launch_terminal_argv (base_path, &err);
+        if (argv != NULL) {
+            launch_spawn (argv);
+            g_strfreev (argv);
+        }
+        else {
+            show_error ("%s", err->message);
+            g_error_free (err);
+        }
+    }
+    else if (mode == _LAUNCH_GITG && base_path != NULL) {
+        gchar *gitg_argv[] = { "gitg", base_path, NULL };
+        launch_spawn (gitg_argv);
+    }
+    g_free (prjfilename);
+    g_free (base_path);
+}
+
+static gboolean cb_button_press_event(GtkWidget *widget,
+                                        GdkEventButton *event,
+                                        gpointer data)
+{
+    // 左ボタン　ダブルクリック
+    return (event->button == 1 && event->type == GDK_2BUTTON_PRESS) ?
+        (launch_geany (widget, _LAUNCH_GEANY), TRUE) :
+        FALSE;
+}
+
+static gboolean cb_key_press_event (GtkWidget *widget,
+                                    GdkEventKey *event,
+                                    gpointer data)
+{
+    return (toupper (event->keyval) == GDK_KEY_Return) ?
+        (launch_geany (widget, _LAUNCH_GEANY), TRUE) :
+        FALSE;
+}
+
+/*
+ * 更新日時の表示。書式化は描画される行についてだけ行う。
+ * 同じ分の値が続くことが多いので、前回の文字列を使い回す。
+ */
+static void cell_data_mtime (GtkTreeViewColumn *column,
+                             GtkCellRenderer   *renderer,
+                             GtkTreeModel      *model,
+                             GtkTreeIter       *iter,
+                             gpointer           data)
+{
+    static gint64 last_minute = G_MININT64;
+    static gchar buf[PROJECTINFO_MTIME_LEN];
+    const Projectinfo *prj;
+
+    prj = project_model_get_info (PROJECT_MODEL (model), iter);
+    if (prj == NULL) return;
+    if (prj->mtime / 60 != last_minute) {
+        projectinfo_format_mtime (prj->mtime, buf, sizeof(buf));
+        last_minute = prj->mtime / 60;
+    }
+    g_object_set (renderer, "text", buf, NULL);
+}
+
+/*
+ * git の状態とディレクトリの集計。求めるのは表示されている行の分だけで、
+ * 描画では覚えている結果を見るだけにする (求めていなければ空欄)。
+ */
+static GitStatusCache *gitstatus = NULL;
+static DirStatsCache *dirstats = NULL;
+static guint visible_queue_idle = 0;
+static guint visible_refresh_timer = 0;
+
+static void cell_data_git (GtkTreeViewColumn *column,
+                           GtkCellRenderer   *renderer,
+                           GtkTreeModel      *model,
+                           GtkTreeIter       *iter,
+                           gpointer           data)
+{
+    const Projectinfo *prj;
+    gchar *path, *text = NULL;
+
+    prj = project_model_get_info (PROJECT_MODEL (model), iter);
+    if (gitstatus != NULL && prj != NULL &&
+                        (path = projectinfo_get_base_dir (prj)) != NULL) {
+        text = git_status_format (git_status_cache_peek (gitstatus, path));
+        g_free (path);
+    }
+    g_object_set (renderer, "text", text, NULL);
+    g_free (text);
+}
+
+/*
+ * 大きさ、ファイル数、最後に更新したファイルの日時。data で選ぶ。
+ */
+enum {
+    _STATS_SIZE,
+    _STATS_FILES,
+    _STATS_NEWEST
+};
+
+static void cell_data_stats (GtkTreeViewColumn *column,
+                             GtkCellRenderer   *renderer,
+                             GtkTreeModel      *model,
+                             GtkTreeIter       *iter,
+                             gpointer           data)
+{
+    const Projectinfo *prj;
+    const DirStats *stats = NULL;
+    gchar *path, *text = NULL;
+    gchar buf[PROJECTINFO_MTIME_LEN];
+
+    prj = project_model_get_info (PROJECT_MODEL (model), iter);
+    if (dirstats != NULL && prj != NULL &&
+                        (path = projectinfo_get_base_dir (prj)) != NULL) {
+        stats = dir_stats_cache_peek (dirstats, path);
+        g_free (path);
+    }
+    if (stats != NULL) {
+        switch (GPOINTER_TO_INT (data)) {
+        case _STATS_SIZE:
+            text = g_format_size (stats->size);
+            break;
+        case _STATS_FILES:
+            text = g_strdup_printf ("%" G_GUINT64_FORMAT, stats->files);
+            break;
+        case _STATS_NEWEST:
+            if (stats->newest_file != NULL) {
+                projectinfo_format_mtime (stats->newest_mtime, buf,
+                                                        sizeof (buf));
+                text = g_strdup (buf);
             }
+            break;
         }
     }
-    else {
-        execprj = NULL;
-    }
-
-    pid = fork ();
-    if (pid == -1) {
-        // エラー
-        g_error ("起動に失敗しました。エラー番号 %d\n", errno);
-        g_free (execprj);
-    }
-    else if (pid == 0) {
-        // 子プロセス
-        pid_2 = fork();
-        if (pid_2 == -1) {
-            // エラー
-            g_error ("起動に失敗しました。エラー番号 %d\n", errno);
-        }
-        else if (pid_2 == 0) {
-            if (execprj != NULL) {
-                // 出来る限り g_free で開放したいので環境にコピーを取る
-                if (!setenv (PROJECTNAME, execprj, !0)) {
-                    g_free (execprj);
-                    execprj = getenv (PROJECTNAME);
-                }
-            }
-            if (mode == _LAUNCH_GEANY) {
-                execlp ("geany", "geany", "-i", execprj, (char*)NULL);
-            }
-            else if (mode == _LAUNCH_TERMINAL) {
-                execlp (terminal_cmd, terminal_cmd, execprj, (char*)NULL);
-            }
-            else if (mode == _LAUNCH_GITG) {
-                execlp ("gitg", "gitg", execprj, (char*)NULL);
-            }
-            // 戻ってきたら失敗
-            g_error ("起動に失敗しました。エラー番号 %d\n", errno);
-        }
-        else {
-            //~ g_message ("孫プロセス %d を起動しました。", pid_2);
-            g_free (execprj);
-            exit (0);
-        }
+    g_object_set (renderer, "text", text, NULL);
+    g_free (text);
+}
+
+/*
+ * 選択中の行を先に、表示されている行について頼む
+ */
+static gboolean cb_queue_visible (gpointer data)
+{
+    GtkTreeView *view = data;
+    GtkTreeModel *model = gtk_tree_view_get_model (view);
+    GtkTreeSelection *selection = gtk_tree_view_get_selection (view);
+    GtkTreePath *start, *end;
+    GtkTreeIter iter;
+    const Projectinfo *prj;
+    gchar *path;
+
+    visible_queue_idle = 0;
+    git_status_cache_begin_pass (gitstatus);
+    dir_stats_cache_begin_pass (dirstats);
+    if (gtk_tree_selection_get_selected (selection, NULL, &iter)) {
+        prj = project_model_get_info (PROJECT_MODEL (model), &iter);
+        if (prj != NULL && (path = projectinfo_get_base_dir (prj)) != NULL) {
+            dir_stats_cache_request (dirstats, path, TRUE);
+            g_free (path);
+        }
+    }
+    if (gtk_tree_view_get_visible_range (view, &start, &end) == FALSE) {
+        return G_SOURCE_REMOVE;
+    }
+    if (gtk_tree_model_get_iter (model, &iter, start)) {
+        do {
+            prj = project_model_get_info (PROJECT_MODEL (model), &iter);
+            if (prj != NULL && (path = projectinfo_get_base_dir (prj)) != NULL) {
+                git_status_cache_request (gitstatus, path);
+                dir_stats_cache_request (dirstats, path, FALSE);
+                g_free (path);
+            }
+            gtk_tree_path_next (start);
+        } while (gtk_tree_path_compare (start, end) <= 0 &&
+                                gtk_tree_model_iter_next (model, &iter));
+    }
+    gtk_tree_path_free (start);
+    gtk_tree_path_free (end);
+    return G_SOURCE_REMOVE;
+}
+
+// スクロールや絞り込みの度に呼ばれるので、まとめて idle で行う
+static void queue_visible (GtkWidget *view)
+{
+    if (visible_queue_idle == 0) {
+        visible_queue_idle = g_idle_add_full (G_PRIORITY_LOW,
+                                    cb_queue_visible, view, NULL);
+    }
+}
+
+static void cb_visible_result_changed (const gchar *path, gpointer data)
+{
+    gtk_widget_queue_draw (GTK_WIDGET (data));
+    queue_visible (GTK_WIDGET (data));
+}
+
+static void cb_visible_view_changed (gpointer instance, GtkWidget *view)
+{
+    queue_visible (view);
+}
+
+/*
+ * 監視で分からない変更もあるので、表示中の行は時々頼み直す
+ * (古くなったものだけが求め直される)
+ */
+static gboolean cb_visible_refresh (gpointer data)
+{
+    if (gtk_widget_get_mapped (GTK_WIDGET (data))) {
+        queue_visible (GTK_WIDGET (data));
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+static void visible_attach_view (GtkWidget *view)
+{
+    GtkAdjustment *vadj;
+
+    gitstatus = git_status_cache_new (cb_visible_result_changed, view);
+    dirstats = dir_stats_cache_new (scan_options, stats_max_dirs,
+                            stats_idle_io, cb_visible_result_changed, view);
+    vadj = gtk_scrollable_get_vadjustment (GTK_SCROLLABLE (view));
+    g_signal_connect (vadj, "value-changed",
+                        G_CALLBACK (cb_visible_view_changed), view);
+    g_signal_connect (vadj, "changed",
+                        G_CALLBACK (cb_visible_view_changed), view);
+    g_signal_connect (gtk_tree_view_get_selection (GTK_TREE_VIEW (view)),
+                        "changed", G_CALLBACK (cb_visible_view_changed), view);
+    g_signal_connect_swapped (projectlist, "row-inserted",
+                        G_CALLBACK (queue_visible), view);
+    g_signal_connect_swapped (projectlist, "row-deleted",
+                        G_CALLBACK (queue_visible), view);
+    g_signal_connect_swapped (projectlist, "rows-reordered",
+                        G_CALLBACK (queue_visible), view);
+    visible_refresh_timer = g_timeout_add_seconds (GIT_STATUS_REFRESH,
+                                            cb_visible_refresh, view);
+}
+
+static void visible_shutdown (void)
+{
+    if (visible_queue_idle != 0) {
+        g_source_remove (visible_queue_idle);
+        visible_queue_idle = 0;
+    }
+    if (visible_refresh_timer != 0) {
+        g_source_remove (visible_refresh_timer);
+        visible_refresh_timer = 0;
     }
-    else {
-        // 親プロセス
-        //~ g_message ("子プロセス %d を起動しました。", pid);
-        waitpid (pid, &status, 0);
-        g_free (execprj);
+    git_status_cache_free (gitstatus);
+    gitstatus = NULL;
+    dir_stats_cache_free (dirstats);
+    dirstats = NULL;
+}
+
+/*
+ * 全ての列の幅を固定して fixed-height-mode にする。行の高さを
+ * 1行目で決めるので、描画の手間が全体の行数でなく表示する行数で決まる。
+ */
+static void projectview_set_fixed (GtkTreeView *view)
+{
+    // name, description, mtime, git, size, files, last edit
+    static const gint widths[] = { 200, 300, 150, 120, 80, 70, 150 };
+    GList *columns = gtk_tree_view_get_columns (view), *l;
+    guint i;
+
+    for (l = columns, i = 0; l != NULL; l = l->next, i++) {
+        gtk_tree_view_column_set_sizing (l->data, GTK_TREE_VIEW_COLUMN_FIXED);
+        gtk_tree_view_column_set_fixed_width (l->data,
+                            (i < G_N_ELEMENTS (widths)) ? widths[i] : 100);
     }
+    g_list_free (columns);
+    gtk_tree_view_set_fixed_height_mode (view, TRUE);
 }
 
-static gboolean cb_button_press_event(GtkWidget *widget,
-                                        GdkEventButton *event,
-                                        gpointer data)
+/*
+ * 選択したプロジェクトの詳細 (fixed_rows の時だけ出す)
+ */
+static void cb_detail_selection_changed (GtkTreeSelection *selection,
+                                                        GtkWidget *label)
 {
-    // 左ボタン　ダブルクリック
-    return (event->button == 1 && event->type == GDK_2BUTTON_PRESS) ?
-        (launch_geany (widget, _LAUNCH_GEANY), TRUE) :
-        FALSE;
+    GtkTreeModel *model;
+    GtkTreeIter iter;
+    const Projectinfo *prj = NULL;
+    gchar *markup;
+
+    if (gtk_tree_selection_get_selected (selection, &model, &iter)) {
+        prj = project_model_get_info (PROJECT_MODEL (model), &iter);
+    }
+    if (prj == NULL) {
+        gtk_label_set_text (GTK_LABEL (label), "");
+        return;
+    }
+    markup = g_markup_printf_escaped ("<b>%s</b>\n%s\n<small>%s\n%s</small>",
+                    (prj->name != NULL) ? prj->name : "",
+                    (prj->description != NULL) ? prj->description : "",
+                    (prj->base_path != NULL) ? prj->base_path : "",
+                    prj->prjfilename);
+    gtk_label_set_markup (GTK_LABEL (label), markup);
+    g_free (markup);
 }
 
-static gboolean cb_key_press_event (GtkWidget *widget,
-                                    GdkEventKey *event,
-                                    gpointer data)
+static GtkWidget *create_detail_pane (GtkWidget *view)
 {
-    return (toupper (event->keyval) == GDK_KEY_Return) ?
-        (launch_geany (widget, _LAUNCH_GEANY), TRUE) :
-        FALSE;
+    GtkWidget *label, *frame;
+
+    label = gtk_label_new (NULL);
+    gtk_label_set_xalign (GTK_LABEL (label), 0);
+    gtk_label_set_yalign (GTK_LABEL (label), 0);
+    gtk_label_set_line_wrap (GTK_LABEL (label), TRUE);
+    gtk_label_set_line_wrap_mode (GTK_LABEL (label), PANGO_WRAP_WORD_CHAR);
+    gtk_label_set_selectable (GTK_LABEL (label), TRUE);
+    // 長すぎる説明で一覧が狭くならないよう 8 行までにする
+    gtk_label_set_ellipsize (GTK_LABEL (label), PANGO_ELLIPSIZE_END);
+    gtk_label_set_lines (GTK_LABEL (label), 8);
+    gtk_widget_set_margin_start (label, 5);
+    gtk_widget_set_margin_end (label, 5);
+    gtk_widget_set_can_focus (label, FALSE);
+    frame = gtk_frame_new (NULL);
+    gtk_container_add (GTK_CONTAINER (frame), label);
+    g_signal_connect (gtk_tree_view_get_selection (GTK_TREE_VIEW (view)),
+                        "changed", G_CALLBACK (cb_detail_selection_changed),
+                        label);
+    return frame;
 }
 
 static GtkWidget *create_projectview (void)
@@ -368,16 +1812,21 @@ static GtkWidget *create_projectview (void)
     GtkTreeViewColumn *column;
     GtkCellRenderer *renderer;
 
-    projectlist = gtk_list_store_new (5,    G_TYPE_STRING,  // 名前
-                                            G_TYPE_STRING,  // 説明
-                                            G_TYPE_STRING,  // 変更日時
-                                            G_TYPE_STRING,  // ファイル名
-                                            G_TYPE_STRING); // パス
+    // 絞り込みと並べ替えはモデル自身が行う
+    searchindex = search_index_new ();
+    projectlist = project_model_new (searchindex);
+    // 並べ替えの指定がなければよく使う順
+    if (usage_get () != NULL) {
+        project_model_set_frecency_func (projectlist, project_frecency, NULL);
+    }
+    gtk_tree_sortable_set_sort_column_id (GTK_TREE_SORTABLE (projectlist),
+                            PROJECT_MODEL_SORT_FRECENCY, GTK_SORT_ASCENDING);
     view = gtk_tree_view_new_with_model (GTK_TREE_MODEL(projectlist));
     gtk_tree_view_set_headers_visible (GTK_TREE_VIEW(view), TRUE);
 
     //~ プロジェクトの名称
     renderer = gtk_cell_renderer_text_new ();
+    if (fixed_rows) g_object_set (renderer, "ellipsize", PANGO_ELLIPSIZE_END, NULL);
     column = gtk_tree_view_column_new_with_attributes (
                 _("name"), renderer, "text", _P_NAME, NULL);
     gtk_tree_view_column_set_max_width (column, 200);
@@ -387,12 +1836,20 @@ static GtkWidget *create_projectview (void)
     gtk_tree_view_append_column (GTK_TREE_VIEW(view), column);
 
     //~ 説明文の表示。長いものは折り返す。
+    //~ fixed_rows なら折り返さずに切り詰める (全文は詳細欄に出す)
     renderer = gtk_cell_renderer_text_new ();
-    g_object_set (renderer, "wrap-width", 300, NULL);
-    g_object_set (renderer, "wrap-mode", PANGO_WRAP_WORD_CHAR, NULL);
+    if (fixed_rows) {
+        g_object_set (renderer, "ellipsize", PANGO_ELLIPSIZE_END,
+                                "single-paragraph-mode", TRUE, NULL);
+    }
+    else {
+        g_object_set (renderer, "wrap-width", 300, NULL);
+        g_object_set (renderer, "wrap-mode", PANGO_WRAP_WORD_CHAR, NULL);
+    }
     // ここで表示行高さを指定しないと幅を変更したりソートした時におかしくなる
     gtk_cell_renderer_text_set_fixed_height_from_font (
-                                GTK_CELL_RENDERER_TEXT(renderer), 2);
+                                GTK_CELL_RENDERER_TEXT(renderer),
+                                fixed_rows ? 1 : 2);
     column = gtk_tree_view_column_new_with_attributes (
                 _("description"), renderer, "text", _P_DESCRIPTION, NULL);
     //~ gtk_tree_view_column_set_max_width (column, 300);
@@ -405,13 +1862,60 @@ static GtkWidget *create_projectview (void)
     renderer = gtk_cell_renderer_text_new ();
     g_object_set (renderer, "xalign", 0.5, NULL);
     column = gtk_tree_view_column_new_with_attributes (
-                _("mtime"), renderer, "text", _P_TIMESTAMP, NULL);
+                _("mtime"), renderer, NULL);
+    gtk_tree_view_column_set_cell_data_func (column, renderer,
+                                            cell_data_mtime, NULL, NULL);
     gtk_tree_view_column_set_max_width (column, 200);
     g_object_set (column, "alignment", 0.5, NULL);
     gtk_tree_view_column_set_resizable (column, TRUE);
     gtk_tree_view_column_set_sort_column_id (column, _P_TIMESTAMP);
     gtk_tree_view_append_column (GTK_TREE_VIEW(view), column);
 
+    //~ git の状態 (表示されている行だけ求める)
+    renderer = gtk_cell_renderer_text_new ();
+    column = gtk_tree_view_column_new_with_attributes (
+                _("git"), renderer, NULL);
+    gtk_tree_view_column_set_cell_data_func (column, renderer,
+                                            cell_data_git, NULL, NULL);
+    gtk_tree_view_column_set_max_width (column, 200);
+    g_object_set (column, "alignment", 0.5, NULL);
+    gtk_tree_view_column_set_resizable (column, TRUE);
+    gtk_tree_view_append_column (GTK_TREE_VIEW(view), column);
+
+    //~ ベースパス以下の大きさ、ファイル数、最後に更新したファイル
+    renderer = gtk_cell_renderer_text_new ();
+    g_object_set (renderer, "xalign", 1.0, NULL);
+    column = gtk_tree_view_column_new_with_attributes (
+                _("size"), renderer, NULL);
+    gtk_tree_view_column_set_cell_data_func (column, renderer,
+                    cell_data_stats, GINT_TO_POINTER (_STATS_SIZE), NULL);
+    g_object_set (column, "alignment", 0.5, NULL);
+    gtk_tree_view_column_set_resizable (column, TRUE);
+    gtk_tree_view_append_column (GTK_TREE_VIEW(view), column);
+
+    renderer = gtk_cell_renderer_text_new ();
+    g_object_set (renderer, "xalign", 1.0, NULL);
+    column = gtk_tree_view_column_new_with_attributes (
+                _("files"), renderer, NULL);
+    gtk_tree_view_column_set_cell_data_func (column, renderer,
+                    cell_data_stats, GINT_TO_POINTER (_STATS_FILES), NULL);
+    g_object_set (column, "alignment", 0.5, NULL);
+    gtk_tree_view_column_set_resizable (column, TRUE);
+    gtk_tree_view_append_column (GTK_TREE_VIEW(view), column);
+
+    renderer = gtk_cell_renderer_text_new ();
+    g_object_set (renderer, "xalign", 0.5, NULL);
+    column = gtk_tree_view_column_new_with_attributes (
+                _("last edit"), renderer, NULL);
+    gtk_tree_view_column_set_cell_data_func (column, renderer,
+                    cell_data_stats, GINT_TO_POINTER (_STATS_NEWEST), NULL);
+    gtk_tree_view_column_set_max_width (column, 200);
+    g_object_set (column, "alignment", 0.5, NULL);
+    gtk_tree_view_column_set_resizable (column, TRUE);
+    gtk_tree_view_append_column (GTK_TREE_VIEW(view), column);
+    visible_attach_view (view);
+    if (fixed_rows) projectview_set_fixed (GTK_TREE_VIEW (view));
+
     //~ コールバック　
     g_signal_connect (view, "key-press-event",
                         G_CALLBACK (cb_key_press_event), NULL);
@@ -422,6 +1926,27 @@ static GtkWidget *create_projectview (void)
 }
 
 
+/*
+ * 常駐する時は閉じずに隠す。一覧と監視はそのまま保つので、
+ * 次に呼ばれた時はすぐに出せる。
+ */
+static gboolean cb_main_window_delete (GtkWidget *widget, GdkEvent *event,
+                                                            gpointer data)
+{
+    if (resident == FALSE) return FALSE;
+    gtk_widget_hide (widget);
+    return TRUE;
+}
+
+static void cb_main_window_destroy (GtkWidget *widget, gpointer data)
+{
+    scan_cancel ();
+    monitor_shutdown ();
+    index_shutdown ();
+    visible_shutdown ();
+    scan_header = NULL;
+}
+
 static void cb_btnopen_clicked (GtkWidget *widget, GtkWidget *view)
 {
     launch_geany (view, _LAUNCH_GEANY);
@@ -449,8 +1974,7 @@ cb_entbuff_inserted_text (GtkEntryBuffer *buffer,
                guint           n_chars,
                gpointer        data)
 {
-    searchvalue = gtk_entry_buffer_get_text (buffer);
-    gtk_tree_model_filter_refilter (GTK_TREE_MODEL_FILTER(data));
+    projectview_queue_refilter (buffer);
 }
 
 static void
@@ -459,8 +1983,37 @@ cb_entbuff_deleted_text (GtkEntryBuffer *buffer,
                guint           n_chars,
                gpointer        data)
 {
-    searchvalue = gtk_entry_buffer_get_text (buffer);
-    gtk_tree_model_filter_refilter (GTK_TREE_MODEL_FILTER(data));
+    projectview_queue_refilter (buffer);
+}
+
+/*
+ * 計測が有効な時だけ、描画の時間と最初のフレームまでの時間を記録する
+ */
+static gint64 profile_paint_start;
+
+static void cb_profile_paint (GdkFrameClock *clock, gpointer data)
+{
+    profile_paint_start = PROFILE_BEGIN ();
+}
+
+static void cb_profile_after_paint (GdkFrameClock *clock, gpointer data)
+{
+    static gboolean first = TRUE;
+
+    PROFILE_END ("paint", profile_paint_start);
+    if (first) {
+        PROFILE_MARK ("first frame");
+        first = FALSE;
+    }
+}
+
+static void cb_profile_realize (GtkWidget *widget, gpointer data)
+{
+    GdkFrameClock *clock = gtk_widget_get_frame_clock (widget);
+
+    g_signal_connect (clock, "paint", G_CALLBACK(cb_profile_paint), NULL);
+    g_signal_connect_after (clock, "after-paint",
+                            G_CALLBACK(cb_profile_after_paint), NULL);
 }
 
 GtkWidget *create_main_window (GtkApplication *app)
@@ -469,6 +2022,7 @@ GtkWidget *create_main_window (GtkApplication *app)
     GtkWidget *hbox;
     GtkWidget *pv, *sw;
     GtkWidget *btn_blank, *btn_open, *btn_terminal, *btn_gitg;
+    gint64 start = PROFILE_BEGIN ();
 
     window = gtk_application_window_new (app);
 
@@ -500,22 +2054,33 @@ GtkWidget *create_main_window (GtkApplication *app)
     g_signal_connect (G_OBJECT(btn_gitg), "clicked",
                         G_CALLBACK(cb_btngitg_clicked), pv);
 
-    // 検索用フィルタモデル
-    GtkTreeModel *model = gtk_tree_model_filter_new (GTK_TREE_MODEL (projectlist), NULL);
-    gtk_tree_model_filter_set_visible_func (GTK_TREE_MODEL_FILTER (model),
-                                                  visible_func, NULL, NULL);
-    gtk_tree_view_set_model (GTK_TREE_VIEW (pv), model);
+    // 読み込み中の表示と中断ボタン
+    scan_spinner = gtk_spinner_new ();
+    btn_scan_stop = gtk_button_new_from_icon_name ("process-stop",
+                                                GTK_ICON_SIZE_BUTTON);
+    gtk_widget_set_tooltip_text (btn_scan_stop, _("Stop loading"));
+    gtk_widget_set_no_show_all (scan_spinner, TRUE);
+    gtk_widget_set_no_show_all (btn_scan_stop, TRUE);
+    g_signal_connect (G_OBJECT(btn_scan_stop), "clicked",
+                        G_CALLBACK(cb_btnscanstop_clicked), NULL);
 
     // 検索入力
-    // searchvalue は GtkTreeViewのvisible_funcにて参照されるので、
+    // searchvalue は絞り込みの際に前回の検索語として参照されるので、
     // gtk_widget_show_all実行迄に初期化しておく事。
     GtkEntryBuffer *entbuff = gtk_entry_buffer_new (NULL,256);
     GtkWidget *ent_search = gtk_entry_new_with_buffer (entbuff);
-    searchvalue = gtk_entry_buffer_get_text (entbuff);
+    gtk_widget_set_tooltip_text (ent_search,
+                _("Search names, descriptions and paths.\n"
+                  "since:YYYY-MM-DD and until:YYYY-MM-DD limit the "
+                  "modification date.\n"
+                  "owner:PATH shows the projects that own the file.\n"
+                  "text:WORD also searches session files and build commands."));
+    searchvalue = g_strdup (gtk_entry_buffer_get_text (entbuff));
+    search_entry = ent_search;
     g_signal_connect (G_OBJECT(entbuff), "inserted-text",
-                        G_CALLBACK(cb_entbuff_inserted_text), model);
+                        G_CALLBACK(cb_entbuff_inserted_text), NULL);
     g_signal_connect (G_OBJECT(entbuff), "deleted-text",
-                        G_CALLBACK(cb_entbuff_deleted_text), model);
+                        G_CALLBACK(cb_entbuff_deleted_text), NULL);
 
     // ヘッダーバー
     header = gtk_header_bar_new ();
@@ -527,33 +2092,114 @@ GtkWidget *create_main_window (GtkApplication *app)
     gtk_header_bar_pack_end (GTK_HEADER_BAR (header), btn_terminal);
     gtk_header_bar_pack_end (GTK_HEADER_BAR (header), btn_gitg);
     gtk_header_bar_pack_start (GTK_HEADER_BAR (header), ent_search);
+    gtk_header_bar_pack_start (GTK_HEADER_BAR (header), btn_scan_stop);
+    gtk_header_bar_pack_start (GTK_HEADER_BAR (header), scan_spinner);
+    scan_header = header;
 
     // まとめ
     hbox = gtk_box_new (GTK_ORIENTATION_HORIZONTAL, 5);
-    gtk_box_pack_start (GTK_BOX(hbox), sw, TRUE, TRUE, 5);
+    if (fixed_rows) {
+        GtkWidget *vbox = gtk_box_new (GTK_ORIENTATION_VERTICAL, 5);
+        gtk_box_pack_start (GTK_BOX(vbox), sw, TRUE, TRUE, 0);
+        gtk_box_pack_start (GTK_BOX(vbox), create_detail_pane (pv),
+                                                        FALSE, FALSE, 0);
+        gtk_box_pack_start (GTK_BOX(hbox), vbox, TRUE, TRUE, 5);
+    }
+    else {
+        gtk_box_pack_start (GTK_BOX(hbox), sw, TRUE, TRUE, 5);
+    }
     gtk_container_add (GTK_CONTAINER(window), hbox);
     gtk_window_set_titlebar (GTK_WINDOW (window), header);
     gtk_widget_set_size_request (window, 800, 600);
     gtk_window_set_position (GTK_WINDOW(window), GTK_WIN_POS_CENTER);
 
+    g_signal_connect (G_OBJECT(window), "delete-event",
+                        G_CALLBACK(cb_main_window_delete), NULL);
+    g_signal_connect (G_OBJECT(window), "destroy",
+                        G_CALLBACK(cb_main_window_destroy), NULL);
+    if (profile_enabled) {
+        g_signal_connect (G_OBJECT(window), "realize",
+                            G_CALLBACK(cb_profile_realize), NULL);
+    }
+    PROFILE_END ("create window", start);
+
+    // 前回のキャッシュがあればそれで一覧を作っておく
+    start = PROFILE_BEGIN ();
+    ProjectinfoPool *pool = projectinfo_pool_new ();
+    GHashTable *cache = (scan_roots_key != NULL) ?
+                                prjcache_load (scan_roots_key, pool) : NULL;
+    PROFILE_END ("cache load", start);
+    if (cache != NULL) {
+        GHashTableIter iter;
+        gpointer value;
+        start = PROFILE_BEGIN ();
+        g_hash_table_iter_init (&iter, cache);
+        project_model_freeze (projectlist);
+        while (g_hash_table_iter_next (&iter, NULL, &value)) {
+            project_model_set (projectlist, value);
+        }
+        project_model_thaw (projectlist);
+        PROFILE_END ("cache insert", start);
+    }
+
     // 既定のディレクトリからプロジェクトファイルを読み込んで ui に格納する
-    read_project_all (prjpath, 0);
+    // 読み込みはバックグラウンドで行うので、ウィンドウはすぐに表示される
+    // キャッシュと一致したファイルは読み直さない
+    scan_start (scan_roots, cache, pool);
 
     return window;
 }
 
+static gchar *pending_query = NULL;     // 次に出す時に検索欄に入れる
+
 static void
 cb_activate_main (GtkApplication *app, gpointer userdata)
 {
     //~ g_message ("activate.");
     GList *windows = gtk_application_get_windows (app);
+    gboolean reshow = (windows != NULL);
 
     ui = (windows == NULL)? create_main_window (app):
                              windows->data;
+    if (pending_query != NULL) {
+        gtk_entry_set_text (GTK_ENTRY (search_entry), pending_query);
+        gtk_editable_set_position (GTK_EDITABLE (search_entry), -1);
+        gtk_widget_grab_focus (search_entry);
+        g_clear_pointer (&pending_query, g_free);
+    }
+    else if (reshow) {
+        // 前の検索語は打ち込めば置き換わるようにしておく
+        gtk_widget_grab_focus (search_entry);
+    }
     gtk_widget_show_all (ui);
     gtk_window_present (GTK_WINDOW(ui));
 }
 
+/*
+ * 起動時と、起動中のものがある時に後から起動された時に呼ばれる
+ * (後者は引数がこのプロセスに送られてくる)。残りの引数は検索語として
+ * 検索欄に入れる。
+ */
+static gint
+cb_command_line_main (GApplication *app, GApplicationCommandLine *cmdline,
+                                                    gpointer userdata)
+{
+    GVariantDict *options = g_application_command_line_get_options_dict (
+                                                                cmdline);
+    const gchar **rest = NULL;
+    gboolean res = FALSE;
+
+    if (g_variant_dict_lookup (options, "resident", "b", &res) && res) {
+        resident = TRUE;
+    }
+    g_variant_dict_lookup (options, G_OPTION_REMAINING, "^a&s", &rest);
+    g_free (pending_query);
+    pending_query = (rest != NULL) ? g_strjoinv (" ", (gchar **)rest) : NULL;
+    g_free (rest);
+    g_application_activate (app);
+    return EXIT_SUCCESS;
+}
+
 static void
 about_activated (GSimpleAction *action,
                        GVariant      *parameter,
@@ -574,6 +2220,24 @@ about_activated (GSimpleAction *action,
 }
 
 
+/*
+ * 列の見出しで並べ替えた後、よく使う順に戻す
+ */
+static void
+sort_frecency_activated (GSimpleAction *action,
+                         GVariant      *parameter,
+                         gpointer       app)
+{
+    if (sorted_by_score) {
+        // 検索を終えた時に戻す並び
+        user_sort_id = PROJECT_MODEL_SORT_FRECENCY;
+        user_sort_order = GTK_SORT_ASCENDING;
+        return;
+    }
+    gtk_tree_sortable_set_sort_column_id (GTK_TREE_SORTABLE (projectlist),
+                            PROJECT_MODEL_SORT_FRECENCY, GTK_SORT_ASCENDING);
+}
+
 static void
 quit_activated (GSimpleAction *action,
                 GVariant      *parameter,
@@ -582,30 +2246,47 @@ quit_activated (GSimpleAction *action,
     g_application_quit (G_APPLICATION (app));
 }
 
-static void
-cb_startup_main (GtkApplication *app, gpointer userdata)
+/*
+ * 設定を読む。ウィンドウを出さない問い合わせでも使う。
+ */
+static void load_config (void)
 {
-    //~ g_message ("start up.");
-
+    gint64 start = PROFILE_BEGIN ();
     GKeyFile *kconf = load_geany_config ();
-    prjpath = g_key_file_get_string (kconf, "project",
+    gchar *path = g_key_file_get_string (kconf, "project",
                                         "project_file_path", NULL);
+    // ファイル監視から得るパスと一致させるため正規化しておく
+    prjpath = (path != NULL) ? g_canonicalize_filename (path, NULL) : NULL;
+    g_free (path);
+    load_app_config ();
 
-    gchar *tmp = g_key_file_get_string (kconf, "tools",
+    // 引数も含めたまま持ち、起動の時に分解する
+    terminal_cmd = g_key_file_get_string (kconf, "tools",
                                         "terminal_cmd", NULL);
-    if (tmp != NULL) {
-        gchar **v = g_strsplit (tmp, " ", -1);
-        if (v != NULL) {
-            terminal_cmd = g_strdup (v[0]);
-        }
-        g_strfreev (v);
-    }
     g_key_file_free (kconf);
+    PROFILE_END ("load config", start);
+}
+
+static void free_config (void)
+{
+    g_free (prjpath);
+    g_strfreev (scan_roots);
+    g_free (scan_roots_key);
+    scan_options_free (scan_options);
+    g_free (terminal_cmd);
+}
+
+static void
+cb_startup_main (GtkApplication *app, gpointer userdata)
+{
+    //~ g_message ("start up.");
 
+    load_config ();
 
     static GActionEntry app_entries[] =
     {
       { "about", about_activated, NULL, NULL, NULL },
+      { "sort-frecency", sort_frecency_activated, NULL, NULL, NULL },
       { "quit", quit_activated, NULL, NULL, NULL }
     };
 
@@ -614,6 +2295,12 @@ cb_startup_main (GtkApplication *app, gpointer userdata)
     "<interface>"
     "<!-- interface-requires gtk+ 3.0 -->"
     "<menu id=\"appmenu\">"
+    "<section>"
+      "<item>"
+        "<attribute name=\"label\" translatable=\"yes\">Sort by _usage</attribute>"
+        "<attribute name=\"action\">app.sort-frecency</attribute>"
+      "</item>"
+    "</section>"
     "<section>"
       "<item>"
         "<attribute name=\"label\" translatable=\"yes\">_about</attribute>"
@@ -642,12 +2329,470 @@ cb_startup_main (GtkApplication *app, gpointer userdata)
 static void
 cb_shutdown_main (GtkApplication *app, gpointer userdata)
 {
-    g_free (prjpath);
-    g_free (terminal_cmd);
+    scan_cancel ();
+    monitor_shutdown ();
+    usage_store_close (usage);
+    usage = NULL;
+    g_free (searchvalue);
+    g_free (pending_query);
+    owner_index_free (ownerindex);
+    ownerindex = NULL;
+    text_index_close (textindex);
+    textindex = NULL;
+    free_config ();
 
     //~ g_message ("shutdown.\n");
 }
 
+/*
+ * ウィンドウを出さない問い合わせ (--list, --open)
+ * ランチャーから打鍵ごとに呼ばれるので、GTK (GDK) は初期化せず、
+ * キャッシュがあればそれだけで答える。
+ */
+typedef struct {
+    GMutex lock;
+    GHashTable *cache;          // 前回のキャッシュ (stat が同じなら読まない)
+    ProjectinfoPool *pool;
+    GPtrArray *all;             // 見つかった全プロジェクト
+} ListScan;
+
+typedef struct {
+    const Projectinfo *prj;
+    gint score;
+    gchar *key;                 // 名前の照合キー
+} ListItem;
+
+static void list_scan_add (const gchar *path, const GStatBuf *st,
+                                                    gpointer data)
+{
+    ListScan *ls = data;
+    Projectinfo *prj = NULL, *tmp;
+
+    g_mutex_lock (&ls->lock);
+    if (ls->cache != NULL) {
+        prj = g_hash_table_lookup (ls->cache, path);
+        if (prj != NULL && projectinfo_stat_equal (prj, st) == TRUE) {
+            g_ptr_array_add (ls->all, prj);
+            g_mutex_unlock (&ls->lock);
+            return;
+        }
+    }
+    g_mutex_unlock (&ls->lock);
+
+    tmp = projectinfo_read_file (path, st);
+
+    g_mutex_lock (&ls->lock);
+    g_ptr_array_add (ls->all, projectinfo_pool_copy (ls->pool, tmp));
+    g_mutex_unlock (&ls->lock);
+    projectinfo_free (tmp);
+}
+
+/*
+ * 全プロジェクトを得る。キャッシュが無いか refresh が TRUE の時だけ
+ * その場で走査し、キャッシュを書き直す。refresh の時は全文検索の
+ * 索引も更新する。
+ */
+static GPtrArray *list_load (ProjectinfoPool *pool, gboolean refresh)
+{
+    ListScan ls;
+    GHashTableIter iter;
+    GPtrArray *roots;
+    GError *err = NULL;
+    GStatBuf st;
+    gpointer value;
+    gchar **r;
+    gint64 start;
+
+    ls.pool = pool;
+    ls.all = g_ptr_array_new ();
+    start = PROFILE_BEGIN ();
+    ls.cache = prjcache_load (scan_roots_key, pool);
+    PROFILE_END ("cache load", start);
+    if (ls.cache != NULL && refresh == FALSE) {
+        g_hash_table_iter_init (&iter, ls.cache);
+        while (g_hash_table_iter_next (&iter, NULL, &value)) {
+            g_ptr_array_add (ls.all, value);
+        }
+        g_hash_table_unref (ls.cache);
+        return ls.all;
+    }
+
+    start = PROFILE_BEGIN ();
+    g_mutex_init (&ls.lock);
+    roots = g_ptr_array_new_with_free_func ((GDestroyNotify)scan_dir_free);
+    for (r = scan_roots; *r != NULL; r++) {
+        if (g_stat (*r, &st) == 0 && S_ISDIR (st.st_mode)) {
+            g_ptr_array_add (roots, scan_dir_new (*r, 0));
+        }
+    }
+    scanner_walk (scan_options, roots, list_scan_add, NULL, &ls, NULL);
+    g_ptr_array_unref (roots);
+    g_mutex_clear (&ls.lock);
+    if (ls.cache != NULL) g_hash_table_unref (ls.cache);
+    PROFILE_END ("scan", start);
+
+    if (prjcache_save (scan_roots_key, ls.all, &err) == FALSE) {
+        g_warning ("%s", err->message);
+        g_error_free (err);
+        err = NULL;
+    }
+    if (refresh == TRUE) {
+        // 走査し直した一覧なので、消えたプロジェクトも索引から除ける
+        TextIndex *tidx = text_index_open (NULL);
+
+        start = PROFILE_BEGIN ();
+        if (!text_index_update (tidx, ls.all, TRUE, &err)) {
+            g_warning ("%s", err->message);
+            g_error_free (err);
+        }
+        text_index_close (tidx);
+        PROFILE_END ("text index", start);
+    }
+    return ls.all;
+}
+
+/*
+ * 点数 (よく使うものは加点) の高い順、同点なら名前順
+ */
+static gint list_item_compare (gconstpointer a, gconstpointer b)
+{
+    const ListItem *x = a, *y = b;
+
+    if (x->score != y->score) return (x->score < y->score) ? 1 : -1;
+    return strcmp (x->key, y->key);
+}
+
+/*
+ * 検索語に一致するプロジェクトを並べて返す。
+ * 検索語と日付の期間の扱いは検索欄と同じ。
+ */
+static GArray *list_query (GPtrArray *all, const gchar *text)
+{
+    SearchIndex *idx;
+    GArray *items;
+    ListItem item;
+    gint64 since, until, start = PROFILE_BEGIN ();
+    gint64 now = g_get_real_time () / G_USEC_PER_SEC;
+    GHashTable *only = NULL;
+    gchar *query, *rest, *words;
+    guint i, id;
+
+    usage_get ();
+    idx = search_index_new ();
+    for (i = 0; i < all->len; i++) {
+        const Projectinfo *prj = g_ptr_array_index (all, i);
+        search_index_add (idx, prj->name, prj->description,
+                                            prj->base_path, prj->mtime);
+    }
+    rest = parse_text ((text != NULL) ? text : "", &words);
+    query = parse_date_range (rest, &since, &until);
+    search_index_filter (idx, query, since, until);
+    g_free (query);
+    g_free (rest);
+    if (words != NULL) {
+        // 索引は開くだけ (更新はウィンドウ側と --refresh で行う)
+        TextIndex *tidx = text_index_open (NULL);
+
+        only = text_index_query (tidx, words);
+        text_index_close (tidx);
+        g_free (words);
+    }
+
+    items = g_array_new (FALSE, FALSE, sizeof (ListItem));
+    for (id = 0; id < all->len; id++) {
+        if (search_index_is_visible (idx, id) == FALSE) continue;
+        item.prj = g_ptr_array_index (all, id);
+        if (only != NULL &&
+                !g_hash_table_contains (only, item.prj->prjfilename)) {
+            continue;
+        }
+        item.score = search_index_get_score (idx, id) +
+                search_frecency_boost (usage_store_get (usage,
+                                            item.prj->prjfilename, now));
+        item.key = g_utf8_collate_key ((item.prj->name != NULL) ?
+                                            item.prj->name : "", -1);
+        g_array_append_val (items, item);
+    }
+    search_index_free (idx);
+    if (only != NULL) g_hash_table_unref (only);
+    g_array_sort (items, list_item_compare);
+    PROFILE_END ("query", start);
+    return items;
+}
+
+static void list_items_free (GArray *items)
+{
+    guint i;
+
+    for (i = 0; i < items->len; i++) {
+        g_free (g_array_index (items, ListItem, i).key);
+    }
+    g_array_free (items, TRUE);
+}
+
+static void list_append_json (GString *out, const gchar *s)
+{
+    const gchar *p;
+
+    g_string_append_c (out, '"');
+    for (p = (s != NULL) ? s : ""; *p != '\0'; p++) {
+        switch (*p) {
+        case '"':  g_string_append (out, "\\\""); break;
+        case '\\': g_string_append (out, "\\\\"); break;
+        case '\n': g_string_append (out, "\\n");  break;
+        case '\r': g_string_append (out, "\\r");  break;
+        case '\t': g_string_append (out, "\\t");  break;
+        default:
+            if ((guchar)*p < 0x20) {
+                g_string_append_printf (out, "\\u%04x", (guchar)*p);
+            }
+            else {
+                g_string_append_c (out, *p);
+            }
+        }
+    }
+    g_string_append_c (out, '"');
+}
+
+/*
+ * TSV の欄に区切り文字が入らないよう空白に置き換える
+ */
+static void list_append_tsv (GString *out, const gchar *s)
+{
+    const gchar *p;
+
+    for (p = (s != NULL) ? s : ""; *p != '\0'; p++) {
+        g_string_append_c (out, (*p == '\t' || *p == '\n' || *p == '\r') ?
+                                                            ' ' : *p);
+    }
+}
+
+enum {
+    _LIST_PLAIN,
+    _LIST_TSV,
+    _LIST_JSON,
+};
+
+static void list_print (GArray *items, gint format)
+{
+    GString *out = g_string_sized_new (4096);
+    gchar buf[PROJECTINFO_MTIME_LEN];
+    guint i;
+
+    if (format == _LIST_JSON) g_string_append_c (out, '[');
+    for (i = 0; i < items->len; i++) {
+        const Projectinfo *prj = g_array_index (items, ListItem, i).prj;
+
+        switch (format) {
+        case _LIST_JSON:
+            g_string_append (out, (i == 0) ? "\n{\"name\":" : ",\n{\"name\":");
+            list_append_json (out, prj->name);
+            g_string_append (out, ",\"description\":");
+            list_append_json (out, prj->description);
+            g_string_append (out, ",\"base_path\":");
+            list_append_json (out, prj->base_path);
+            g_string_append (out, ",\"prjfilename\":");
+            list_append_json (out, prj->prjfilename);
+            g_string_append_printf (out, ",\"mtime\":%" G_GINT64_FORMAT "}",
+                                                            prj->mtime);
+            break;
+        case _LIST_TSV:
+            list_append_tsv (out, prj->name);
+            g_string_append_c (out, '\t');
+            list_append_tsv (out, prj->description);
+            g_string_append_c (out, '\t');
+            list_append_tsv (out, prj->base_path);
+            g_string_append_c (out, '\t');
+            list_append_tsv (out, prj->prjfilename);
+            g_string_append_c (out, '\t');
+            g_string_append (out, projectinfo_format_mtime (prj->mtime,
+                                                    buf, sizeof (buf)));
+            g_string_append_c (out, '\n');
+            break;
+        default:
+            list_append_tsv (out, prj->name);
+            g_string_append_c (out, '\n');
+        }
+    }
+    if (format == _LIST_JSON) g_string_append (out, "\n]\n");
+    fwrite (out->str, 1, out->len, stdout);
+    g_string_free (out, TRUE);
+}
+
+/*
+ * GDK を使わずに、GDK が既定で開くディスプレイの名前を得る
+ */
+static const gchar *list_display_name (void)
+{
+    const gchar *name = g_getenv ("WAYLAND_DISPLAY");
+
+    if (name == NULL || *name == '\0') name = g_getenv ("DISPLAY");
+    return name;
+}
+
+/*
+ * 名前 (あるいはプロジェクトファイル名) の一致するものを、
+ * 無ければ検索して一番点数の高いものを geany で開く。
+ * reuse_geany の時は起動中の geany があればそれに開かせる。
+ */
+static gint list_open (GPtrArray *all, const gchar *name)
+{
+    const Projectinfo *found = NULL;
+    GError *err = NULL;
+    gchar *argv[4];
+    guint i;
+
+    for (i = 0; i < all->len && found == NULL; i++) {
+        const Projectinfo *prj = g_ptr_array_index (all, i);
+        if (!g_strcmp0 (prj->name, name) ||
+                            !g_strcmp0 (prj->prjfilename, name)) {
+            found = prj;
+        }
+    }
+    if (found == NULL) {
+        GArray *items = list_query (all, name);
+        if (items->len != 0) {
+            found = g_array_index (items, ListItem, 0).prj;
+        }
+        list_items_free (items);
+    }
+    if (found == NULL) {
+        g_printerr (_("No project matches \"%s\".\n"), name);
+        return EXIT_FAILURE;
+    }
+
+    usage_record (found->prjfilename);
+    if (reuse_geany == TRUE) {
+        const gchar *files[] = { found->prjfilename, NULL };
+        gchar *path = geany_socket_get_path (list_display_name ());
+        gboolean ok = geany_socket_open_files (path, files, NULL);
+
+        g_free (path);
+        if (ok == TRUE) return EXIT_SUCCESS;
+    }
+    argv[0] = "geany";
+    argv[1] = (reuse_geany == TRUE) ? found->prjfilename : "-i";
+    argv[2] = (reuse_geany == TRUE) ? NULL : found->prjfilename;
+    argv[3] = NULL;
+    if (g_spawn_async (NULL, argv, NULL, G_SPAWN_SEARCH_PATH |
+                            G_SPAWN_STDOUT_TO_DEV_NULL, NULL, NULL,
+                            NULL, &err) == FALSE) {
+        g_printerr ("%s\n", err->message);
+        g_error_free (err);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+/*
+ * path を持つプロジェクトを format の形で表示する。
+ * 索引は保存しておき、更新日時の変わったプロジェクトだけを読み直す。
+ */
+static gint list_owner (GPtrArray *all, const gchar *path, gint format)
+{
+    OwnerIndex *idx;
+    GHashTable *by_file;
+    GPtrArray *owners;
+    GArray *items;
+    ListItem item;
+    gchar *canon;
+    gint64 start = PROFILE_BEGIN ();
+    guint i;
+
+    idx = owner_index_new (NULL);
+    by_file = g_hash_table_new (g_str_hash, g_str_equal);
+    owner_index_begin_sync (idx);
+    for (i = 0; i < all->len; i++) {
+        Projectinfo *prj = g_ptr_array_index (all, i);
+        owner_index_update (idx, prj);
+        g_hash_table_insert (by_file, prj->prjfilename, prj);
+    }
+    owner_index_end_sync (idx);
+
+    canon = g_canonicalize_filename (path, NULL);
+    owners = owner_index_lookup (idx, canon);
+    items = g_array_new (FALSE, FALSE, sizeof (ListItem));
+    for (i = 0; i < owners->len; i++) {
+        item.prj = g_hash_table_lookup (by_file,
+                                    g_ptr_array_index (owners, i));
+        if (item.prj == NULL) continue;
+        item.score = 0;
+        item.key = g_utf8_collate_key ((item.prj->name != NULL) ?
+                                            item.prj->name : "", -1);
+        g_array_append_val (items, item);
+    }
+    g_array_sort (items, list_item_compare);
+    PROFILE_END ("owner", start);
+
+    if (items->len == 0) {
+        g_printerr (_("No project owns \"%s\".\n"), canon);
+    }
+    else {
+        list_print (items, format);
+    }
+    owner_index_save (idx);
+    i = items->len;
+    list_items_free (items);
+    g_ptr_array_unref (owners);
+    g_hash_table_unref (by_file);
+    owner_index_free (idx);
+    g_free (canon);
+    return (i != 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/*
+ * --list、--open あるいは --owner が指定されていれば、ウィンドウを出さずに
+ * 答えて終わる。GtkApplication の startup より前に呼ばれるので、
+ * GDK の初期化もセッションバスへの登録も行われない。
+ */
+static gint
+cb_handle_local_options (GApplication *app, GVariantDict *options,
+                                                    gpointer userdata)
+{
+    ProjectinfoPool *pool;
+    GPtrArray *all;
+    const gchar **rest = NULL;
+    const gchar *open = NULL, *owner = NULL;
+    gboolean list = FALSE, json = FALSE, tsv = FALSE, refresh = FALSE;
+    gchar *text;
+    gint status = EXIT_SUCCESS;
+
+    g_variant_dict_lookup (options, "list", "b", &list);
+    g_variant_dict_lookup (options, "open", "&s", &open);
+    g_variant_dict_lookup (options, "owner", "^&ay", &owner);
+    if (list == FALSE && open == NULL && owner == NULL) return -1;
+    g_variant_dict_lookup (options, "json", "b", &json);
+    g_variant_dict_lookup (options, "tsv", "b", &tsv);
+    g_variant_dict_lookup (options, "refresh", "b", &refresh);
+    g_variant_dict_lookup (options, G_OPTION_REMAINING, "^a&s", &rest);
+
+    load_config ();
+    pool = projectinfo_pool_new ();
+    all = list_load (pool, refresh);
+    if (open != NULL) {
+        status = list_open (all, open);
+    }
+    else if (owner != NULL) {
+        status = list_owner (all, owner,
+                        json ? _LIST_JSON : tsv ? _LIST_TSV : _LIST_PLAIN);
+    }
+    else {
+        GArray *items;
+
+        text = (rest != NULL) ? g_strjoinv (" ", (gchar **)rest) : NULL;
+        items = list_query (all, text);
+        list_print (items, json ? _LIST_JSON : tsv ? _LIST_TSV : _LIST_PLAIN);
+        list_items_free (items);
+        g_free (text);
+    }
+    g_ptr_array_unref (all);
+    projectinfo_pool_unref (pool);
+    g_free (rest);
+    free_config ();
+    return status;
+}
+
+
 static void init_locale (void)
 {
     setlocale (LC_ALL, "");
@@ -660,15 +2805,45 @@ int main (gint argc, gchar **argv)
     GtkApplication *app;
     int status;
 
+    profile_init ();
     init_locale ();
 
+    static const GOptionEntry entries[] = {
+        { "list", 'l', 0, G_OPTION_ARG_NONE, NULL,
+            N_("Print the projects matching the query and exit"), NULL },
+        { "json", 0, 0, G_OPTION_ARG_NONE, NULL,
+            N_("Print the list as JSON"), NULL },
+        { "tsv", 0, 0, G_OPTION_ARG_NONE, NULL,
+            N_("Print the list as tab separated values"), NULL },
+        { "open", 'o', 0, G_OPTION_ARG_STRING, NULL,
+            N_("Open the named project in Geany and exit"), N_("NAME") },
+        { "owner", 0, 0, G_OPTION_ARG_FILENAME, NULL,
+            N_("Print the projects that own the file and exit"),
+                                                        N_("PATH") },
+        { "refresh", 0, 0, G_OPTION_ARG_NONE, NULL,
+            N_("Scan the project directories instead of using the cache"),
+                                                                    NULL },
+        { "resident", 0, 0, G_OPTION_ARG_NONE, NULL,
+            N_("Keep running when the window is closed"), NULL },
+        { G_OPTION_REMAINING, 0, 0, G_OPTION_ARG_STRING_ARRAY, NULL,
+            NULL, N_("[QUERY...]") },
+        { NULL }
+    };
+
+    // 起動中のものがあれば、引数はそちらに送って終わる
     app = gtk_application_new ("com.gmail.endeavor2wako.Geanyproject",
-                                            G_APPLICATION_FLAGS_NONE);
+                                    G_APPLICATION_HANDLES_COMMAND_LINE);
+    g_application_add_main_option_entries (G_APPLICATION(app), entries);
+    g_signal_connect (app, "handle-local-options",
+                            G_CALLBACK(cb_handle_local_options), NULL);
+    g_signal_connect (app, "command-line",
+                            G_CALLBACK(cb_command_line_main), NULL);
     g_signal_connect (app, "activate", G_CALLBACK(cb_activate_main), NULL);
     g_signal_connect (app, "startup",  G_CALLBACK(cb_startup_main),  NULL);
     g_signal_connect (app, "shutdown", G_CALLBACK(cb_shutdown_main), NULL);
-    status = g_application_run (G_APPLICATION(app), 0, NULL);
+    status = g_application_run (G_APPLICATION(app), argc, argv);
     g_object_unref (app);
+    profile_finish ();
 
     return status;
 }
@@ -0,0 +1,419 @@
+/*
+ * Geany プロジェクト一覧 - ファイルの持ち主
+ *
+ * Copylight by Sakai Satoru 2018
+ *
+ * endeavor2wako@gmail.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+
+/*
+ * ファイルからそれを持つプロジェクトを引く索引。
+ *
+ * プロジェクトのベースパスと、[files] に記録された開いていたファイルを
+ * パスの要素ごとの trie に入れ、調べるパスを根から辿って、最も深く
+ * 一致したところのプロジェクトを返す。開いていたファイルそのものの
+ * 一致はベースパスより深いので優先される。
+ *
+ * [files] を読むにはファイル全体を読む必要があるので、プロジェクト
+ * ごとの結果を更新日時と大きさと共に保存しておき、変わったものだけを
+ * 読み直す。trie は読み込んだ時に作り直す。
+ */
+
+#ifdef HAVE_CONFIG_H
+#   include "config.h"
+#endif
+
+#include <string.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "ownerindex.h"
+
+#define OWNER_DIR       "geanyproject"
+#define OWNER_FILE      "owners.cache"
+#define OWNER_VERSION   1
+#define OWNER_TYPE      "(ua(sxxsas))"
+
+typedef struct {
+    gchar *prjfilename;             // NULL なら空き
+    gint64 mtime;                   // 読んだ時のプロジェクトファイル
+    gint64 size;
+    gchar *base;                    // 正規化したベースパス (無ければ NULL)
+    gchar **files;                  // 開いていたファイル
+    gboolean seen;                  // owner_index_begin_sync() の後に現れた
+} OwnerProject;
+
+typedef struct {
+    GHashTable *children;           // パスの要素 → OwnerNode (必要な時に作る)
+    GArray *owners;                 // ここで終わるパスを持つ slot (同上)
+} OwnerNode;
+
+struct _OwnerIndex {
+    gchar *filename;
+    GArray *projects;               // slot → OwnerProject
+    GArray *free_slots;
+    GHashTable *lookup;             // prjfilename → slot + 1
+    OwnerNode *root;
+    gboolean dirty;                 // 保存していない変更がある
+};
+
+#define PROJECT(idx, slot)  (&g_array_index ((idx)->projects, OwnerProject, (slot)))
+
+static void owner_node_free (gpointer data)
+{
+    OwnerNode *node = data;
+
+    if (node->children != NULL) g_hash_table_unref (node->children);
+    if (node->owners != NULL) g_array_unref (node->owners);
+    g_free (node);
+}
+
+/*
+ * path の要素を辿る。create なら無い節を作る。
+ */
+static OwnerNode *trie_find (OwnerNode *node, const gchar *path,
+                                                    gboolean create)
+{
+    const gchar *p = path, *end;
+    OwnerNode *child;
+    gchar *name;
+
+    while (node != NULL) {
+        while (*p == G_DIR_SEPARATOR) p++;
+        if (*p == '\0') break;
+        end = strchr (p, G_DIR_SEPARATOR);
+        if (end == NULL) end = p + strlen (p);
+        name = g_strndup (p, end - p);
+        child = (node->children != NULL) ?
+                        g_hash_table_lookup (node->children, name) : NULL;
+        if (child == NULL && create) {
+            if (node->children == NULL) {
+                node->children = g_hash_table_new_full (g_str_hash,
+                                    g_str_equal, g_free, owner_node_free);
+            }
+            child = g_new0 (OwnerNode, 1);
+            g_hash_table_insert (node->children, name, child);
+        }
+        else {
+            g_free (name);
+        }
+        node = child;
+        p = end;
+    }
+    return node;
+}
+
+static void trie_insert (OwnerIndex *idx, const gchar *path, guint slot)
+{
+    OwnerNode *node = trie_find (idx->root, path, TRUE);
+    guint i;
+
+    if (node->owners == NULL) {
+        node->owners = g_array_new (FALSE, FALSE, sizeof (guint));
+    }
+    for (i = 0; i < node->owners->len; i++) {
+        if (g_array_index (node->owners, guint, i) == slot) return;
+    }
+    g_array_append_val (node->owners, slot);
+}
+
+static void trie_remove (OwnerIndex *idx, const gchar *path, guint slot)
+{
+    OwnerNode *node = trie_find (idx->root, path, FALSE);
+    guint i;
+
+    if (node == NULL || node->owners == NULL) return;
+    for (i = 0; i < node->owners->len; i++) {
+        if (g_array_index (node->owners, guint, i) == slot) {
+            g_array_remove_index_fast (node->owners, i);
+            return;
+        }
+    }
+}
+
+static void project_index (OwnerIndex *idx, guint slot)
+{
+    OwnerProject *p = PROJECT (idx, slot);
+    gchar **f;
+
+    if (p->base != NULL) trie_insert (idx, p->base, slot);
+    for (f = p->files; f != NULL && *f != NULL; f++) {
+        trie_insert (idx, *f, slot);
+    }
+}
+
+static void project_unindex (OwnerIndex *idx, guint slot)
+{
+    OwnerProject *p = PROJECT (idx, slot);
+    gchar **f;
+
+    if (p->base != NULL) trie_remove (idx, p->base, slot);
+    for (f = p->files; f != NULL && *f != NULL; f++) {
+        trie_remove (idx, *f, slot);
+    }
+    g_clear_pointer (&p->base, g_free);
+    g_clear_pointer (&p->files, g_strfreev);
+}
+
+static guint project_alloc (OwnerIndex *idx, const gchar *prjfilename)
+{
+    guint slot;
+
+    if (idx->free_slots->len > 0) {
+        slot = g_array_index (idx->free_slots, guint,
+                                            idx->free_slots->len - 1);
+        g_array_set_size (idx->free_slots, idx->free_slots->len - 1);
+    }
+    else {
+        slot = idx->projects->len;
+        g_array_set_size (idx->projects, slot + 1);
+    }
+    PROJECT (idx, slot)->prjfilename = g_strdup (prjfilename);
+    g_hash_table_insert (idx->lookup, PROJECT (idx, slot)->prjfilename,
+                                                GUINT_TO_POINTER (slot + 1));
+    return slot;
+}
+
+static void project_free (OwnerIndex *idx, guint slot)
+{
+    OwnerProject *p = PROJECT (idx, slot);
+
+    project_unindex (idx, slot);
+    g_hash_table_remove (idx->lookup, p->prjfilename);
+    g_free (p->prjfilename);
+    memset (p, 0, sizeof (*p));
+    g_array_append_val (idx->free_slots, slot);
+}
+
+static void owner_index_load (OwnerIndex *idx)
+{
+    GMappedFile *mf;
+    GBytes *bytes;
+    GVariant *v, *records;
+    GVariantIter iter;
+    OwnerProject *p;
+    const gchar *prjfilename, *base;
+    gint64 mtime, size;
+    gchar **files;
+    guint32 version;
+    guint slot;
+
+    mf = g_mapped_file_new (idx->filename, FALSE, NULL);
+    if (mf == NULL) return;
+    bytes = g_mapped_file_get_bytes (mf);
+    g_mapped_file_unref (mf);
+    v = g_variant_new_from_bytes (G_VARIANT_TYPE (OWNER_TYPE), bytes, FALSE);
+    g_bytes_unref (bytes);
+
+    g_variant_get_child (v, 0, "u", &version);
+    if (version == OWNER_VERSION) {
+        records = g_variant_get_child_value (v, 1);
+        g_variant_iter_init (&iter, records);
+        while (g_variant_iter_next (&iter, "(&sxx&s^as)", &prjfilename,
+                                        &mtime, &size, &base, &files)) {
+            if (g_hash_table_contains (idx->lookup, prjfilename)) {
+                g_strfreev (files);
+                continue;
+            }
+            slot = project_alloc (idx, prjfilename);
+            p = PROJECT (idx, slot);
+            p->mtime = mtime;
+            p->size = size;
+            p->base = (*base != '\0') ? g_strdup (base) : NULL;
+            p->files = files;
+            project_index (idx, slot);
+        }
+        g_variant_unref (records);
+    }
+    g_variant_unref (v);
+}
+
+gchar *owner_index_get_filename (void)
+{
+    return g_build_filename (g_get_user_cache_dir (),
+                                OWNER_DIR, OWNER_FILE, NULL);
+}
+
+/*
+ * filename (NULL なら owner_index_get_filename()) に保存した索引を読む
+ */
+OwnerIndex *owner_index_new (const gchar *filename)
+{
+    OwnerIndex *idx = g_new0 (OwnerIndex, 1);
+
+    idx->filename = (filename != NULL) ?
+                    g_strdup (filename) : owner_index_get_filename ();
+    idx->projects = g_array_new (FALSE, TRUE, sizeof (OwnerProject));
+    idx->free_slots = g_array_new (FALSE, FALSE, sizeof (guint));
+    idx->lookup = g_hash_table_new (g_str_hash, g_str_equal);
+    idx->root = g_new0 (OwnerNode, 1);
+    owner_index_load (idx);
+    return idx;
+}
+
+void owner_index_free (OwnerIndex *idx)
+{
+    OwnerProject *p;
+    guint slot;
+
+    if (idx == NULL) return;
+
+    for (slot = 0; slot < idx->projects->len; slot++) {
+        p = PROJECT (idx, slot);
+        g_free (p->prjfilename);
+        g_free (p->base);
+        g_strfreev (p->files);
+    }
+    g_array_unref (idx->projects);
+    g_array_unref (idx->free_slots);
+    g_hash_table_unref (idx->lookup);
+    owner_node_free (idx->root);
+    g_free (idx->filename);
+    g_free (idx);
+}
+
+/*
+ * 変更があれば保存する
+ */
+void owner_index_save (OwnerIndex *idx)
+{
+    static const gchar *none[] = { NULL };
+    GVariantBuilder b;
+    GVariant *v;
+    GError *err = NULL;
+    OwnerProject *p;
+    gchar *dir;
+    guint slot;
+
+    if (idx->dirty == FALSE) return;
+
+    g_variant_builder_init (&b, G_VARIANT_TYPE ("a(sxxsas)"));
+    for (slot = 0; slot < idx->projects->len; slot++) {
+        p = PROJECT (idx, slot);
+        if (p->prjfilename == NULL) continue;
+        g_variant_builder_add (&b, "(sxxs^as)", p->prjfilename,
+                    p->mtime, p->size, (p->base != NULL) ? p->base : "",
+                    (p->files != NULL) ? p->files : (gchar **)none);
+    }
+    v = g_variant_ref_sink (g_variant_new ("(u@a(sxxsas))",
+                            OWNER_VERSION, g_variant_builder_end (&b)));
+
+    dir = g_path_get_dirname (idx->filename);
+    g_mkdir_with_parents (dir, 0700);
+    g_free (dir);
+    if (g_file_set_contents (idx->filename, g_variant_get_data (v),
+                                g_variant_get_size (v), &err) == FALSE) {
+        g_warning ("%s", err->message);
+        g_error_free (err);
+    }
+    else {
+        idx->dirty = FALSE;
+    }
+    g_variant_unref (v);
+}
+
+/*
+ * 全てのプロジェクトを owner_index_update() で渡し直す前に呼ぶ。
+ * owner_index_end_sync() で、渡されなかったものを消す。
+ */
+void owner_index_begin_sync (OwnerIndex *idx)
+{
+    guint slot;
+
+    for (slot = 0; slot < idx->projects->len; slot++) {
+        PROJECT (idx, slot)->seen = FALSE;
+    }
+}
+
+void owner_index_end_sync (OwnerIndex *idx)
+{
+    guint slot;
+
+    for (slot = 0; slot < idx->projects->len; slot++) {
+        OwnerProject *p = PROJECT (idx, slot);
+        if (p->prjfilename != NULL && p->seen == FALSE) {
+            project_free (idx, slot);
+            idx->dirty = TRUE;
+        }
+    }
+}
+
+/*
+ * prj を索引に入れる。前と更新日時と大きさが同じなら読み直さない。
+ */
+void owner_index_update (OwnerIndex *idx, const Projectinfo *prj)
+{
+    OwnerProject *p;
+    gpointer value;
+    guint slot;
+
+    if (prj->prjfilename == NULL) return;
+
+    value = g_hash_table_lookup (idx->lookup, prj->prjfilename);
+    if (value != NULL) {
+        slot = GPOINTER_TO_UINT (value) - 1;
+        p = PROJECT (idx, slot);
+        p->seen = TRUE;
+        if (p->mtime == prj->mtime && p->size == prj->size) return;
+        project_unindex (idx, slot);
+    }
+    else {
+        slot = project_alloc (idx, prj->prjfilename);
+    }
+    p = PROJECT (idx, slot);
+    p->seen = TRUE;
+    p->mtime = prj->mtime;
+    p->size = prj->size;
+    p->base = projectinfo_get_base_dir (prj);
+    p->files = projectinfo_read_session_files (prj->prjfilename);
+    project_index (idx, slot);
+    idx->dirty = TRUE;
+}
+
+/*
+ * path を持つプロジェクトのファイル名を返す。最も深く一致したところに
+ * 複数あればその全て。要素は索引が持つので、次に更新するまでに使うこと。
+ */
+GPtrArray *owner_index_lookup (OwnerIndex *idx, const gchar *path)
+{
+    GPtrArray *result = g_ptr_array_new ();
+    OwnerNode *node = idx->root, *best = NULL;
+    const gchar *p = path, *end;
+    gchar *name;
+    guint i;
+
+    while (node != NULL) {
+        if (node->owners != NULL && node->owners->len > 0) best = node;
+        while (*p == G_DIR_SEPARATOR) p++;
+        if (*p == '\0' || node->children == NULL) break;
+        end = strchr (p, G_DIR_SEPARATOR);
+        if (end == NULL) end = p + strlen (p);
+        name = g_strndup (p, end - p);
+        node = g_hash_table_lookup (node->children, name);
+        g_free (name);
+        p = end;
+    }
+    for (i = 0; best != NULL && i < best->owners->len; i++) {
+        guint slot = g_array_index (best->owners, guint, i);
+        g_ptr_array_add (result, PROJECT (idx, slot)->prjfilename);
+    }
+    return result;
+}
@@ -0,0 +1,44 @@
+/*
+ * Geany プロジェクト一覧 - ファイルの持ち主
+ *
+ * Copylight by Sakai Satoru 2018
+ *
+ * endeavor2wako@gmail.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+
+#ifndef OWNERINDEX_H
+#define OWNERINDEX_H
+
+#include <glib.h>
+
+#include "projectinfo.h"
+
+typedef struct _OwnerIndex OwnerIndex;
+
+gchar *owner_index_get_filename (void);
+OwnerIndex *owner_index_new (const gchar *filename);
+void owner_index_free (OwnerIndex *idx);
+void owner_index_save (OwnerIndex *idx);
+void owner_index_begin_sync (OwnerIndex *idx);
+void owner_index_update (OwnerIndex *idx, const Projectinfo *prj);
+void owner_index_end_sync (OwnerIndex *idx);
+GPtrArray *owner_index_lookup (OwnerIndex *idx, const gchar *path);
+
+#endif /* OWNERINDEX_H */
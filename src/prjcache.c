@@ -0,0 +1,224 @@
+/*
+ * Geany プロジェクト一覧 - プロジェクト一覧のキャッシュ
+ *
+ * Copylight by Sakai Satoru 2018
+ *
+ * endeavor2wako@gmail.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+
+/*
+ * 前回読み込んだプロジェクトの情報を $XDG_CACHE_HOME/geanyproject/ に保存し、
+ * 次回起動時はプロジェクトファイルを開かずに一覧を作る。
+ * ファイルの更新は stat 情報 (mtime, inode, size) の比較で判断する。
+ *
+ * 書式 (1行1件、フィールドはタブ区切り)
+ *   GEANYPROJECT-CACHE <版> <走査したディレクトリ>
+ *   <prjfilename> <mtime> <inode> <size> <name> <description> <base_path>
+ * 文字列中の \ タブ 改行 復帰 は \\ \t \n \r にエスケープする。
+ */
+
+#ifdef HAVE_CONFIG_H
+#   include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "prjcache.h"
+
+#define CACHE_DIR       "geanyproject"
+#define CACHE_FILE      "projects.cache"
+#define CACHE_MAGIC     "GEANYPROJECT-CACHE"
+#define CACHE_VERSION   1
+#define CACHE_NFIELDS   7
+
+gchar *prjcache_get_filename (void)
+{
+    return g_build_filename (g_get_user_cache_dir (),
+                                CACHE_DIR, CACHE_FILE, NULL);
+}
+
+static void cache_append_escaped (GString *out, const gchar *s)
+{
+    for (; s != NULL && *s != '\0'; s++) {
+        switch (*s) {
+            case '\\':  g_string_append (out, "\\\\");  break;
+            case '\t':  g_string_append (out, "\\t");   break;
+            case '\n':  g_string_append (out, "\\n");   break;
+            case '\r':  g_string_append (out, "\\r");   break;
+            default:    g_string_append_c (out, *s);    break;
+        }
+    }
+}
+
+/*
+ * cache_append_escaped() のエスケープをその場で戻す
+ */
+static gchar *cache_unescape (gchar *s)
+{
+    gchar *p, *q;
+
+    for (p = q = s; *p != '\0'; p++) {
+        if (*p == '\\' && p[1] != '\0') {
+            switch (*++p) {
+                case 't':   *q++ = '\t';    break;
+                case 'n':   *q++ = '\n';    break;
+                case 'r':   *q++ = '\r';    break;
+                default:    *q++ = *p;      break;
+            }
+        }
+        else {
+            *q++ = *p;
+        }
+    }
+    *q = '\0';
+    return s;
+}
+
+/*
+ * 1行をタブで分割する。行の中身はその場で書き換える。
+ */
+static gint cache_split_line (gchar *line, gchar **fields, gint max)
+{
+    gint n = 0;
+    gchar *p;
+
+    fields[n++] = line;
+    for (p = line; *p != '\0'; p++) {
+        if (*p == '\t') {
+            if (n >= max) return -1;
+            *p = '\0';
+            fields[n++] = p + 1;
+        }
+    }
+    return n;
+}
+
+/*
+ * キャッシュを読み込む。ファイルは一度に読む。
+ * prjfilename をキーとする Projectinfo のハッシュを返す。Projectinfo は
+ * pool に置くので、ハッシュを解放しても pool を解放するまで残る。
+ * キャッシュが無いか、走査ディレクトリが異なる場合は NULL を返す。
+ */
+GHashTable *prjcache_load (const gchar *root, ProjectinfoPool *pool)
+{
+    gchar *filename, *contents, *line, *next, *fields[CACHE_NFIELDS];
+    gchar *cached_root;
+    GHashTable *table = NULL;
+    Projectinfo tmp = { NULL }, *prj;
+    struct stat st;
+    gint n;
+
+    filename = prjcache_get_filename ();
+    if (g_file_get_contents (filename, &contents, NULL, NULL) == FALSE) {
+        g_free (filename);
+        return NULL;
+    }
+    g_free (filename);
+
+    // ヘッダ
+    line = contents;
+    next = strchr (line, '\n');
+    if (next != NULL) *next++ = '\0';
+    n = cache_split_line (line, fields, 3);
+    if (n != 3 || g_strcmp0 (fields[0], CACHE_MAGIC) ||
+                        atoi (fields[1]) != CACHE_VERSION) goto out;
+    cached_root = g_strcompress (fields[2]);
+    if (g_strcmp0 (cached_root, root)) {
+        g_free (cached_root);
+        goto out;
+    }
+    g_free (cached_root);
+
+    table = g_hash_table_new (g_str_hash, g_str_equal);
+    for (line = next; line != NULL && *line != '\0'; line = next) {
+        next = strchr (line, '\n');
+        if (next != NULL) *next++ = '\0';
+        if (cache_split_line (line, fields, CACHE_NFIELDS) != CACHE_NFIELDS) {
+            continue;   // 壊れた行は無視する (次の走査で読み直される)
+        }
+
+        memset (&st, 0, sizeof(st));
+        st.st_mtime = g_ascii_strtoll (fields[1], NULL, 10);
+        st.st_ino = g_ascii_strtoull (fields[2], NULL, 10);
+        st.st_size = g_ascii_strtoll (fields[3], NULL, 10);
+
+        // 文字列は読み込んだ内容の中でエスケープを戻してから pool へ写す
+        tmp.prjfilename = cache_unescape (fields[0]);
+        tmp.name = cache_unescape (fields[4]);
+        tmp.description = cache_unescape (fields[5]);
+        tmp.base_path = cache_unescape (fields[6]);
+        projectinfo_set_stat (&tmp, &st);
+        prj = projectinfo_pool_copy (pool, &tmp);
+        // キーは値の prjfilename を共有する
+        g_hash_table_replace (table, prj->prjfilename, prj);
+    }
+
+out:
+    g_free (contents);
+    return table;
+}
+
+/*
+ * projects (Projectinfo の配列) をキャッシュに書き出す。
+ * 書き込みは一時ファイル経由で行うので、途中で失敗しても前の内容は残る。
+ */
+gboolean prjcache_save (const gchar *root, GPtrArray *projects,
+                                                        GError **error)
+{
+    GString *out;
+    gchar *filename, *dir;
+    Projectinfo *prj;
+    gboolean ret;
+    guint i;
+
+    out = g_string_sized_new (128 * (projects->len + 1));
+    g_string_append_printf (out, "%s\t%d\t", CACHE_MAGIC, CACHE_VERSION);
+    cache_append_escaped (out, root);
+    g_string_append_c (out, '\n');
+
+    for (i = 0; i < projects->len; i++) {
+        prj = g_ptr_array_index (projects, i);
+        cache_append_escaped (out, prj->prjfilename);
+        g_string_append_printf (out,
+                    "\t%" G_GINT64_FORMAT "\t%" G_GUINT64_FORMAT
+                    "\t%" G_GINT64_FORMAT "\t",
+                    prj->mtime, prj->inode, prj->size);
+        cache_append_escaped (out, prj->name);
+        g_string_append_c (out, '\t');
+        cache_append_escaped (out, prj->description);
+        g_string_append_c (out, '\t');
+        cache_append_escaped (out, prj->base_path);
+        g_string_append_c (out, '\n');
+    }
+
+    filename = prjcache_get_filename ();
+    dir = g_path_get_dirname (filename);
+    g_mkdir_with_parents (dir, 0700);
+    ret = g_file_set_contents (filename, out->str, out->len, error);
+
+    g_free (dir);
+    g_free (filename);
+    g_string_free (out, TRUE);
+    return ret;
+}
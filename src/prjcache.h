@@ -0,0 +1,38 @@
+/*
+ * Geany プロジェクト一覧 - プロジェクト一覧のキャッシュ
+ *
+ * Copylight by Sakai Satoru 2018
+ *
+ * endeavor2wako@gmail.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+
+#ifndef PRJCACHE_H
+#define PRJCACHE_H
+
+#include <glib.h>
+
+#include "projectinfo.h"
+
+gchar *prjcache_get_filename (void);
+GHashTable *prjcache_load (const gchar *root, ProjectinfoPool *pool);
+gboolean prjcache_save (const gchar *root, GPtrArray *projects,
+                                                        GError **error);
+
+#endif /* PRJCACHE_H */
@@ -0,0 +1,266 @@
+/*
+ * Geany プロジェクト一覧 - 処理時間の計測
+ *
+ * Copylight by Sakai Satoru 2018
+ *
+ * endeavor2wako@gmail.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+
+/*
+ * 起動が遅い時に、どの段階に時間がかかっているかを調べるための計測
+ *
+ *   GEANYPROJECT_PROFILE=1            終了時に集計を標準エラー出力へ書く
+ *   GEANYPROJECT_PROFILE=FILE         集計を FILE へ書く
+ *   GEANYPROJECT_PROFILE=FILE.json    Trace Event 形式で書く
+ *                                     (chrome://tracing や Perfetto で開ける)
+ *
+ * 時刻は profile_init() からの単調増加時刻。走査スレッドからも呼ばれる。
+ */
+
+#ifdef HAVE_CONFIG_H
+#   include "config.h"
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "profile.h"
+
+typedef struct {
+    const gchar *name;
+    gint64 start;               // profile_init() からの時間 (μs)
+    gint64 duration;            // 時刻の記録だけなら -1
+    gint tid;
+} ProfileEvent;
+
+typedef struct {
+    const gchar *name;
+    guint count;
+    gint64 total, max, first;
+} ProfileStat;
+
+gboolean profile_enabled = FALSE;
+
+static gint64 origin;
+static gchar *output = NULL;        // NULL なら標準エラー出力
+static gboolean trace = FALSE;
+static GMutex lock;
+static GArray *events = NULL;
+static gsize counters[PROFILE_N_COUNTERS];
+static GPrivate thread_key;
+static gint n_threads = 0;
+
+static const gchar *counter_names[PROFILE_N_COUNTERS] = {
+    "dirs opened",
+    "entries read",
+    "stat calls",
+    "files parsed",
+    "bytes read",
+    "rows inserted",
+};
+
+/*
+ * スレッドごとの小さな番号 (最初に呼んだメインスレッドが 1)
+ */
+static gint profile_thread_id (void)
+{
+    gint id = GPOINTER_TO_INT (g_private_get (&thread_key));
+
+    if (id == 0) {
+        id = g_atomic_int_add (&n_threads, 1) + 1;
+        g_private_set (&thread_key, GINT_TO_POINTER (id));
+    }
+    return id;
+}
+
+void profile_init (void)
+{
+    const gchar *env = g_getenv ("GEANYPROJECT_PROFILE");
+
+    if (env == NULL || *env == '\0' || !strcmp (env, "0")) return;
+
+    origin = g_get_monotonic_time ();
+    if (strcmp (env, "1") != 0) {
+        output = g_strdup (env);
+        trace = g_str_has_suffix (env, ".json");
+    }
+    events = g_array_new (FALSE, FALSE, sizeof (ProfileEvent));
+    profile_thread_id ();
+    profile_enabled = TRUE;
+}
+
+static void profile_add (const gchar *name, gint64 start, gint64 duration)
+{
+    ProfileEvent ev;
+
+    ev.name = name;
+    ev.start = start - origin;
+    ev.duration = duration;
+    ev.tid = profile_thread_id ();
+    g_mutex_lock (&lock);
+    // 終了処理と入れ違いになった走査スレッドの記録は捨てる
+    if (events != NULL) g_array_append_val (events, ev);
+    g_mutex_unlock (&lock);
+}
+
+/*
+ * start (PROFILE_BEGIN() の値) から今までを name の区間として記録する
+ */
+void profile_span (const gchar *name, gint64 start)
+{
+    profile_add (name, start, g_get_monotonic_time () - start);
+}
+
+void profile_mark (const gchar *name)
+{
+    profile_add (name, g_get_monotonic_time (), -1);
+}
+
+void profile_count (ProfileCounter counter, gsize n)
+{
+    g_atomic_pointer_add (&counters[counter], n);
+}
+
+/*
+ * 区間は名前ごとに回数、合計、最大、最初の開始時刻をまとめる
+ */
+static void profile_write_summary (FILE *fp)
+{
+    GHashTable *stats = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                        NULL, g_free);
+    GPtrArray *order = g_ptr_array_new ();
+    ProfileStat *s;
+    guint i;
+
+    fprintf (fp, "geanyproject profile (%.3f ms)\n",
+                    (g_get_monotonic_time () - origin) / 1000.0);
+    fprintf (fp, "%-20s %8s %12s %12s %12s\n",
+                    "phase", "count", "total ms", "max ms", "first at ms");
+    for (i = 0; i < events->len; i++) {
+        ProfileEvent *ev = &g_array_index (events, ProfileEvent, i);
+
+        if (ev->duration < 0) continue;
+        s = g_hash_table_lookup (stats, ev->name);
+        if (s == NULL) {
+            s = g_new0 (ProfileStat, 1);
+            s->name = ev->name;
+            s->first = ev->start;
+            g_hash_table_insert (stats, (gpointer)ev->name, s);
+            g_ptr_array_add (order, s);
+        }
+        s->count++;
+        s->total += ev->duration;
+        s->max = MAX (s->max, ev->duration);
+    }
+    for (i = 0; i < order->len; i++) {
+        s = g_ptr_array_index (order, i);
+        fprintf (fp, "%-20s %8u %12.3f %12.3f %12.3f\n", s->name, s->count,
+                        s->total / 1000.0, s->max / 1000.0, s->first / 1000.0);
+    }
+
+    fprintf (fp, "%-20s %12s\n", "mark", "at ms");
+    for (i = 0; i < events->len; i++) {
+        ProfileEvent *ev = &g_array_index (events, ProfileEvent, i);
+
+        if (ev->duration >= 0) continue;
+        fprintf (fp, "%-20s %12.3f\n", ev->name, ev->start / 1000.0);
+    }
+
+    fprintf (fp, "%-20s %12s\n", "counter", "value");
+    for (i = 0; i < PROFILE_N_COUNTERS; i++) {
+        fprintf (fp, "%-20s %12" G_GSIZE_FORMAT "\n", counter_names[i],
+                                                        counters[i]);
+    }
+    g_ptr_array_unref (order);
+    g_hash_table_unref (stats);
+}
+
+/*
+ * Trace Event 形式 (JSON)。区間は "X"、時刻は "i"、数は最後に "C" で書く
+ */
+static void profile_write_trace (FILE *fp)
+{
+    gint pid = getpid ();
+    gint64 end = g_get_monotonic_time () - origin;
+    gint i;
+
+    fprintf (fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf (fp, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,"
+                "\"tid\":1,\"args\":{\"name\":\"main\"}}", pid);
+    for (i = 0; i < (gint)events->len; i++) {
+        ProfileEvent *ev = &g_array_index (events, ProfileEvent, i);
+
+        if (ev->duration >= 0) {
+            fprintf (fp, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%"
+                        G_GINT64_FORMAT ",\"dur\":%" G_GINT64_FORMAT
+                        ",\"pid\":%d,\"tid\":%d}", ev->name, ev->start,
+                        ev->duration, pid, ev->tid);
+        }
+        else {
+            fprintf (fp, ",\n{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"g\","
+                        "\"ts\":%" G_GINT64_FORMAT ",\"pid\":%d,\"tid\":%d}",
+                        ev->name, ev->start, pid, ev->tid);
+        }
+    }
+    for (i = 0; i < PROFILE_N_COUNTERS; i++) {
+        fprintf (fp, ",\n{\"name\":\"%s\",\"ph\":\"C\",\"ts\":%"
+                    G_GINT64_FORMAT ",\"pid\":%d,\"args\":{\"value\":%"
+                    G_GSIZE_FORMAT "}}", counter_names[i], end, pid,
+                    counters[i]);
+    }
+    fprintf (fp, "\n]}\n");
+}
+
+/*
+ * 記録を書き出して計測を終える。終了時に1度だけ呼ぶ。
+ */
+void profile_finish (void)
+{
+    FILE *fp = stderr;
+
+    if (profile_enabled == FALSE) return;
+    profile_enabled = FALSE;
+
+    if (output != NULL) {
+        fp = g_fopen (output, "w");
+        if (fp == NULL) {
+            g_warning ("cannot write %s", output);
+            fp = stderr;
+        }
+    }
+    g_mutex_lock (&lock);
+    if (trace) {
+        profile_write_trace (fp);
+    }
+    else {
+        profile_write_summary (fp);
+    }
+    g_mutex_unlock (&lock);
+    if (fp != stderr) fclose (fp);
+
+    g_array_free (events, TRUE);
+    events = NULL;
+    g_free (output);
+    output = NULL;
+}
@@ -0,0 +1,68 @@
+/*
+ * Geany プロジェクト一覧 - 処理時間の計測
+ *
+ * Copylight by Sakai Satoru 2018
+ *
+ * endeavor2wako@gmail.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <glib.h>
+
+/*
+ * 数える項目
+ */
+typedef enum {
+    PROFILE_DIRS_OPENED,        // 開いたディレクトリ
+    PROFILE_ENTRIES_READ,       // 読んだディレクトリエントリ
+    PROFILE_STAT_CALLS,         // stat の呼び出し
+    PROFILE_FILES_PARSED,       // 読んだ .geany
+    PROFILE_BYTES_READ,         // .geany から読んだバイト数
+    PROFILE_ROWS_INSERTED,      // 一覧に加えた行
+    PROFILE_N_COUNTERS
+} ProfileCounter;
+
+/*
+ * GEANYPROJECT_PROFILE が設定されている時だけ記録する。
+ * 無効な時は変数を1つ調べるだけで済むよう、マクロを通して呼ぶこと。
+ */
+extern gboolean profile_enabled;
+
+#define PROFILE_BEGIN() \
+    (G_UNLIKELY (profile_enabled) ? g_get_monotonic_time () : 0)
+#define PROFILE_END(name, start) G_STMT_START { \
+    if (G_UNLIKELY (profile_enabled)) profile_span ((name), (start)); \
+} G_STMT_END
+#define PROFILE_COUNT(counter, n) G_STMT_START { \
+    if (G_UNLIKELY (profile_enabled)) profile_count ((counter), (n)); \
+} G_STMT_END
+#define PROFILE_MARK(name) G_STMT_START { \
+    if (G_UNLIKELY (profile_enabled)) profile_mark (name); \
+} G_STMT_END
+
+void profile_init (void);
+void profile_finish (void);
+void profile_span (const gchar *name, gint64 start);
+void profile_count (ProfileCounter counter, gsize n);
+void profile_mark (const gchar *name);
+
+#endif /* PROFILE_H */
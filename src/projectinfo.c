@@ -0,0 +1,510 @@
+/*
+ * Geany プロジェクト一覧 - プロジェクト情報
+ *
+ * Copylight by Sakai Satoru 2018
+ *
+ * endeavor2wako@gmail.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#   include "config.h"
+#endif
+
+#include <sys/stat.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <glib.h>
+
+#include "profile.h"
+#include "projectinfo.h"
+
+Projectinfo *projectinfo_new (void)
+{
+    Projectinfo *prj = g_malloc (sizeof(Projectinfo));
+    if (prj != NULL) {
+        prj->name = NULL;
+        prj->description = NULL;
+        prj->prjfilename = NULL;
+        prj->base_path = NULL;
+        prj->mtime = 0;
+        prj->inode = 0;
+        prj->size = 0;
+    }
+    return prj;
+}
+
+Projectinfo *projectinfo_copy (const Projectinfo *prj)
+{
+    Projectinfo *dst;
+
+    if (prj == NULL) return NULL;
+    dst = projectinfo_new ();
+    dst->name = g_strdup (prj->name);
+    dst->description = g_strdup (prj->description);
+    dst->prjfilename = g_strdup (prj->prjfilename);
+    dst->base_path = g_strdup (prj->base_path);
+    dst->mtime = prj->mtime;
+    dst->inode = prj->inode;
+    dst->size = prj->size;
+    return dst;
+}
+
+/*
+ * 文字列を解放する (構造体そのものは解放しない)
+ */
+void projectinfo_clear (Projectinfo *prj)
+{
+    g_clear_pointer (&prj->name, g_free);
+    g_clear_pointer (&prj->description, g_free);
+    g_clear_pointer (&prj->prjfilename, g_free);
+    g_clear_pointer (&prj->base_path, g_free);
+}
+
+void projectinfo_free (Projectinfo *prj)
+{
+    if (prj != NULL) {
+        projectinfo_clear (prj);
+        g_free (prj);
+    }
+}
+
+/*
+ * Projectinfo の置き場所 (アリーナ)
+ * 走査1回分の Projectinfo と文字列をまとめて確保し、まとめて解放する。
+ * 説明やベースパスのように同じ値が多いものは共有する。
+ * スレッドセーフではないので、複数のスレッドから使う場合は呼び出し側で
+ * 排他すること。
+ */
+#define POOL_BLOCK_SIZE     256         // 一度に確保する Projectinfo の数
+
+struct _ProjectinfoPool {
+    gint ref_count;
+    GStringChunk *strings;
+    GSList *blocks;             // Projectinfo の配列 (POOL_BLOCK_SIZE 個)
+    guint used;                 // 先頭のブロックで使った数
+};
+
+ProjectinfoPool *projectinfo_pool_new (void)
+{
+    ProjectinfoPool *pool = g_new0 (ProjectinfoPool, 1);
+
+    pool->ref_count = 1;
+    pool->strings = g_string_chunk_new (64 * 1024);
+    pool->used = POOL_BLOCK_SIZE;
+    return pool;
+}
+
+ProjectinfoPool *projectinfo_pool_ref (ProjectinfoPool *pool)
+{
+    g_atomic_int_inc (&pool->ref_count);
+    return pool;
+}
+
+void projectinfo_pool_unref (ProjectinfoPool *pool)
+{
+    if (pool == NULL) return;
+    if (g_atomic_int_dec_and_test (&pool->ref_count)) {
+        g_string_chunk_free (pool->strings);
+        g_slist_free_full (pool->blocks, g_free);
+        g_free (pool);
+    }
+}
+
+/*
+ * 文字列をアリーナにコピーする。intern が TRUE なら同じ値を共有する。
+ */
+gchar *projectinfo_pool_strdup (ProjectinfoPool *pool, const gchar *s,
+                                                        gboolean intern)
+{
+    if (s == NULL) return NULL;
+    return intern ? g_string_chunk_insert_const (pool->strings, s) :
+                    g_string_chunk_insert (pool->strings, s);
+}
+
+/*
+ * prj をアリーナにコピーする。返されたものは個別に解放しないこと。
+ */
+Projectinfo *projectinfo_pool_copy (ProjectinfoPool *pool,
+                                                const Projectinfo *prj)
+{
+    Projectinfo *dst;
+
+    if (prj == NULL) return NULL;
+    if (pool->used == POOL_BLOCK_SIZE) {
+        pool->blocks = g_slist_prepend (pool->blocks,
+                                g_new (Projectinfo, POOL_BLOCK_SIZE));
+        pool->used = 0;
+    }
+    dst = (Projectinfo *)pool->blocks->data + pool->used++;
+    dst->name = projectinfo_pool_strdup (pool, prj->name, FALSE);
+    dst->description = projectinfo_pool_strdup (pool, prj->description, TRUE);
+    dst->prjfilename = projectinfo_pool_strdup (pool, prj->prjfilename, FALSE);
+    dst->base_path = projectinfo_pool_strdup (pool, prj->base_path, TRUE);
+    dst->mtime = prj->mtime;
+    dst->inode = prj->inode;
+    dst->size = prj->size;
+    return dst;
+}
+
+/*
+ * stat 情報を記録する。更新日時は表示する時に書式化する。
+ */
+void projectinfo_set_stat (Projectinfo *prj, const struct stat *st)
+{
+    prj->mtime = st->st_mtime;
+    prj->inode = st->st_ino;
+    prj->size = st->st_size;
+}
+
+/*
+ * 更新日時を "yyyy-mm-dd  hh:mm" の形にする (地方時)
+ * タイムゾーンは最初に一度だけ読み、UTC からの差を足して gmtime_r で
+ * 分解するので、localtime_r のように呼ぶたびに環境を調べる事はない。
+ * buf は PROJECTINFO_MTIME_LEN バイト以上。
+ */
+const gchar *projectinfo_format_mtime (gint64 mtime, gchar *buf, gsize len)
+{
+    static GTimeZone *tz = NULL;
+    struct tm tm;
+    time_t t;
+    gint interval;
+
+    if (g_once_init_enter (&tz)) {
+        g_once_init_leave (&tz, g_time_zone_new_local ());
+    }
+    interval = g_time_zone_find_interval (tz, G_TIME_TYPE_UNIVERSAL, mtime);
+    t = mtime + ((interval >= 0) ? g_time_zone_get_offset (tz, interval) : 0);
+    if (gmtime_r (&t, &tm) == NULL ||
+                    strftime (buf, len, "%F  %R", &tm) == 0) {
+        *buf = '\0';
+    }
+    return buf;
+}
+
+/*
+ * 記録済みの stat 情報と一致すればファイルは変更されていないとみなす
+ */
+gboolean projectinfo_stat_equal (const Projectinfo *prj,
+                                                const struct stat *st)
+{
+    return prj->mtime == (gint64)st->st_mtime &&
+           prj->inode == (guint64)st->st_ino &&
+           prj->size  == (gint64)st->st_size;
+}
+
+/*
+ * GKeyFile でファイル全体を読んでプロジェクトの情報を得る
+ * projectinfo_read_header() で扱えないファイルはこちらで読む。
+ */
+Projectinfo *projectinfo_read_file_keyfile (const gchar *file,
+                                                const struct stat *st)
+{
+    GKeyFile *kprjconf;
+    Projectinfo *prj;
+    struct stat sbuf;
+
+    kprjconf = g_key_file_new ();
+    prj = projectinfo_new ();
+    if (g_key_file_load_from_file (
+            kprjconf, file, G_KEY_FILE_NONE, NULL) == TRUE) {
+        prj->name = g_key_file_get_string (kprjconf,
+                                "project", "name", NULL);
+        prj->description = g_key_file_get_string (kprjconf,
+                                "project", "description", NULL);
+        prj->base_path = g_key_file_get_string (kprjconf,
+                                "project", "base_path", NULL);
+    }
+    // 読めなかったファイルもキャッシュで再読込を避けられるよう
+    // ファイル名と stat 情報は常に記録する
+    prj->prjfilename = g_strdup (file);
+    if (st == NULL) {
+        if (lstat (prj->prjfilename, &sbuf) != 0) memset (&sbuf, 0, sizeof(sbuf));
+        st = &sbuf;
+    }
+    projectinfo_set_stat (prj, st);
+    // GKeyFile はファイル全体を読む
+    PROFILE_COUNT (PROFILE_BYTES_READ, st->st_size);
+
+    g_key_file_free (kprjconf);
+    return prj;
+}
+
+/*
+ * GKeyFile と同じ規則でエスケープを戻す (\s \n \t \r \\)
+ * それ以外のエスケープや UTF-8 として正しくない値は NULL を返す。
+ */
+static gchar *header_unescape (const gchar *s, gsize len)
+{
+    GString *v = g_string_sized_new (len);
+    gsize i;
+
+    for (i = 0; i < len; i++) {
+        if (s[i] != '\\') {
+            g_string_append_c (v, s[i]);
+            continue;
+        }
+        if (++i >= len) goto fail;
+        switch (s[i]) {
+            case 's':   g_string_append_c (v, ' ');     break;
+            case 'n':   g_string_append_c (v, '\n');    break;
+            case 't':   g_string_append_c (v, '\t');    break;
+            case 'r':   g_string_append_c (v, '\r');    break;
+            case '\\':  g_string_append_c (v, '\\');    break;
+            default:    goto fail;
+        }
+    }
+    if (g_utf8_validate (v->str, v->len, NULL) == FALSE) goto fail;
+    return g_string_free (v, FALSE);
+
+fail:
+    g_string_free (v, TRUE);
+    return NULL;
+}
+
+/*
+ * [project] の name, description, base_path だけを読む。
+ * ファイルは先頭から1行ずつ読み、[project] の次のグループが現れた所で止める。
+ * [files] や [build-menu] が長くても読まずに済む。
+ *
+ * GKeyFile と結果が変わり得る行 (グループより前のキー、キーでも
+ * グループでもない行、不正なエスケープ、末尾の空白や CR、NUL 文字、
+ * [project] の重複) を見つけたら NULL を返すので、呼び出し側で
+ * projectinfo_read_file_keyfile() を使うこと。
+ * name[ja] のようなロケール付きのキーは g_key_file_get_string() と同様に
+ * 別のキーとして無視する。
+ */
+Projectinfo *projectinfo_read_header (const gchar *file,
+                                                const struct stat *st)
+{
+    FILE *fp;
+    Projectinfo *prj;
+    gchar *line = NULL, *p, *q, *eq, *v, **target;
+    gchar *name = NULL, *description = NULL, *base_path = NULL;
+    gboolean in_group = FALSE, in_project = FALSE, seen_project = FALSE;
+    gboolean ok = TRUE;
+    size_t cap = 0;
+    ssize_t len;
+    gsize klen, vlen, bytes = 0;
+    struct stat sbuf;
+
+    fp = fopen (file, "r");
+    if (fp == NULL) return NULL;
+
+    while ((len = getline (&line, &cap, fp)) != -1) {
+        bytes += len;
+        if (len > 0 && line[len-1] == '\n') line[--len] = '\0';
+        if (strlen (line) != (gsize)len) {
+            ok = FALSE;     // NUL 文字を含む
+            break;
+        }
+
+        p = line;
+        while (g_ascii_isspace (*p)) p++;
+        if (*p == '\0' || *p == '#') continue;
+
+        if (*p == '[') {
+            if (in_project == TRUE) break;      // [project] の終わり
+            q = strrchr (p, ']');
+            if (q == NULL || q[1] != '\0') {
+                ok = FALSE;
+                break;
+            }
+            in_group = TRUE;
+            if (q - p - 1 == 7 && !strncmp (p + 1, "project", 7)) {
+                if (seen_project == TRUE) {
+                    ok = FALSE;
+                    break;
+                }
+                in_project = seen_project = TRUE;
+            }
+            continue;
+        }
+
+        eq = strchr (p, '=');
+        if (eq == NULL || in_group == FALSE) {
+            ok = FALSE;
+            break;
+        }
+        if (in_project == FALSE) continue;
+
+        // キー (= の前の空白は除く)
+        q = eq;
+        while (q > p && g_ascii_isspace (q[-1])) q--;
+        klen = q - p;
+        if (klen == 4 && !strncmp (p, "name", 4)) {
+            target = &name;
+        }
+        else if (klen == 11 && !strncmp (p, "description", 11)) {
+            target = &description;
+        }
+        else if (klen == 9 && !strncmp (p, "base_path", 9)) {
+            target = &base_path;
+        }
+        else {
+            continue;
+        }
+
+        // 値 (= の後の空白は除く)
+        v = eq + 1;
+        while (g_ascii_isspace (*v)) v++;
+        vlen = line + len - v;
+        if (vlen > 0 && g_ascii_isspace (v[vlen-1])) {
+            ok = FALSE;
+            break;
+        }
+        g_free (*target);
+        *target = header_unescape (v, vlen);
+        if (*target == NULL) {
+            ok = FALSE;
+            break;
+        }
+    }
+    if (ferror (fp)) ok = FALSE;
+    free (line);
+    fclose (fp);
+    PROFILE_COUNT (PROFILE_BYTES_READ, bytes);
+
+    if (ok == FALSE) {
+        g_free (name);
+        g_free (description);
+        g_free (base_path);
+        return NULL;
+    }
+
+    prj = projectinfo_new ();
+    prj->name = name;
+    prj->description = description;
+    prj->base_path = base_path;
+    prj->prjfilename = g_strdup (file);
+    if (st == NULL) {
+        if (lstat (prj->prjfilename, &sbuf) != 0) memset (&sbuf, 0, sizeof(sbuf));
+        st = &sbuf;
+    }
+    projectinfo_set_stat (prj, st);
+    return prj;
+}
+
+/*
+ * [files] に記録された、プロジェクトで開いていたファイルのパスを files に
+ * 加える。値は "位置;種類;...;パス;..." の形で、8番目のパスは URI と同じ
+ * エスケープをしてある。相対パスはプロジェクトファイルの場所から辿る。
+ */
+static void session_files (GKeyFile *kf, const gchar *file, GPtrArray *files)
+{
+    gchar **keys, **k, *value, **fields, *path, *dir;
+
+    keys = g_key_file_get_keys (kf, "files", NULL, NULL);
+    dir = g_path_get_dirname (file);
+    for (k = keys; k != NULL && *k != NULL; k++) {
+        if (g_str_has_prefix (*k, "FILE_NAME_") == FALSE) continue;
+        value = g_key_file_get_string (kf, "files", *k, NULL);
+        if (value == NULL) continue;
+        fields = g_strsplit (value, ";", 9);
+        if (g_strv_length (fields) >= 8 && *fields[7] != '\0') {
+            path = g_uri_unescape_string (fields[7], NULL);
+            if (path != NULL) {
+                g_ptr_array_add (files, g_canonicalize_filename (path, dir));
+                g_free (path);
+            }
+        }
+        g_strfreev (fields);
+        g_free (value);
+    }
+    g_free (dir);
+    g_strfreev (keys);
+}
+
+/*
+ * 開いていたファイルのパスを返す。読めなければ空の配列を返す。
+ */
+gchar **projectinfo_read_session_files (const gchar *file)
+{
+    GKeyFile *kf = g_key_file_new ();
+    GPtrArray *files = g_ptr_array_new ();
+
+    if (g_key_file_load_from_file (kf, file, G_KEY_FILE_NONE, NULL)) {
+        session_files (kf, file, files);
+    }
+    g_key_file_free (kf);
+    g_ptr_array_add (files, NULL);
+    return (gchar **)g_ptr_array_free (files, FALSE);
+}
+
+/*
+ * 全文検索に使う、[project] 以外の文字列を返す。開いていたファイルの
+ * パスと、[build-menu] のコマンド (..._CM) を1行ずつ並べる。
+ */
+gchar *projectinfo_read_session_text (const gchar *file)
+{
+    GKeyFile *kf = g_key_file_new ();
+    GPtrArray *lines = g_ptr_array_new_with_free_func (g_free);
+    gchar **keys, **k, *text;
+
+    if (g_key_file_load_from_file (kf, file, G_KEY_FILE_NONE, NULL)) {
+        session_files (kf, file, lines);
+        keys = g_key_file_get_keys (kf, "build-menu", NULL, NULL);
+        for (k = keys; k != NULL && *k != NULL; k++) {
+            if (g_str_has_suffix (*k, "_CM")) {
+                text = g_key_file_get_string (kf, "build-menu", *k, NULL);
+                if (text != NULL) g_ptr_array_add (lines, text);
+            }
+        }
+        g_strfreev (keys);
+    }
+    g_key_file_free (kf);
+    g_ptr_array_add (lines, NULL);
+    text = g_strjoinv ("\n", (gchar **)lines->pdata);
+    g_ptr_array_unref (lines);
+    return text;
+}
+
+/*
+ * 正規化したベースパス。base_path はプロジェクトファイルからの相対もある。
+ * 無ければ NULL。
+ */
+gchar *projectinfo_get_base_dir (const Projectinfo *prj)
+{
+    gchar *dir, *path;
+
+    if (prj->base_path == NULL || prj->prjfilename == NULL) return NULL;
+    dir = g_path_get_dirname (prj->prjfilename);
+    path = g_canonicalize_filename (prj->base_path, dir);
+    g_free (dir);
+    return path;
+}
+
+/*
+ * 指定したファイルからプロジェクトの情報を得る
+ * st には呼び出し側で取得済みの stat 情報を渡す。NULL ならここで取得する。
+ * 返されたProjectinfoは使用後開放すること。
+ */
+Projectinfo *projectinfo_read_file (const gchar *file, const struct stat *st)
+{
+    gint64 start = PROFILE_BEGIN ();
+    Projectinfo *prj = projectinfo_read_header (file, st);
+
+    if (prj == NULL) prj = projectinfo_read_file_keyfile (file, st);
+    PROFILE_COUNT (PROFILE_FILES_PARSED, 1);
+    PROFILE_END ("parse", start);
+    return prj;
+}
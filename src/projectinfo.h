@@ -0,0 +1,75 @@
+/*
+ * Geany プロジェクト一覧 - プロジェクト情報
+ *
+ * Copylight by Sakai Satoru 2018
+ *
+ * endeavor2wako@gmail.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+
+#ifndef PROJECTINFO_H
+#define PROJECTINFO_H
+
+#include <sys/stat.h>
+#include <glib.h>
+
+/*
+ * プロジェクトの情報
+ */
+typedef struct {
+    gchar *name;            // プロジェクト名
+    gchar *description;     // プロジェクトの説明
+    gchar *prjfilename;     // プロジェクトファイルの絶対パス
+    gchar *base_path;       // プロジェクトのベースパス
+    gint64 mtime;           // 最終更新日時。以下はプロジェクトファイルの
+    guint64 inode;          // stat 情報 (キャッシュの有効性確認に使う)
+    gint64 size;
+} Projectinfo;
+
+typedef struct _ProjectinfoPool ProjectinfoPool;
+
+#define PROJECTINFO_MTIME_LEN   32  // projectinfo_format_mtime() の buf
+
+Projectinfo *projectinfo_new (void);
+Projectinfo *projectinfo_copy (const Projectinfo *prj);
+void projectinfo_clear (Projectinfo *prj);
+void projectinfo_free (Projectinfo *prj);
+void projectinfo_set_stat (Projectinfo *prj, const struct stat *st);
+gboolean projectinfo_stat_equal (const Projectinfo *prj,
+                                                const struct stat *st);
+const gchar *projectinfo_format_mtime (gint64 mtime, gchar *buf, gsize len);
+Projectinfo *projectinfo_read_file (const gchar *file,
+                                                const struct stat *st);
+Projectinfo *projectinfo_read_header (const gchar *file,
+                                                const struct stat *st);
+Projectinfo *projectinfo_read_file_keyfile (const gchar *file,
+                                                const struct stat *st);
+gchar **projectinfo_read_session_files (const gchar *file);
+gchar *projectinfo_read_session_text (const gchar *file);
+gchar *projectinfo_get_base_dir (const Projectinfo *prj);
+
+ProjectinfoPool *projectinfo_pool_new (void);
+ProjectinfoPool *projectinfo_pool_ref (ProjectinfoPool *pool);
+void projectinfo_pool_unref (ProjectinfoPool *pool);
+gchar *projectinfo_pool_strdup (ProjectinfoPool *pool, const gchar *s,
+                                                        gboolean intern);
+Projectinfo *projectinfo_pool_copy (ProjectinfoPool *pool,
+                                                const Projectinfo *prj);
+
+#endif /* PROJECTINFO_H */
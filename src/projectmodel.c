@@ -0,0 +1,959 @@
+/*
+ * Geany プロジェクト一覧 - プロジェクト一覧のモデル
+ *
+ * Copylight by Sakai Satoru 2018
+ *
+ * endeavor2wako@gmail.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+
+/*
+ * GtkListStore の代わりに、プロジェクトの情報を1つの連続した配列に持つ
+ * GtkTreeModel。
+ *
+ * プロジェクトは配列の添字 (slot) で識別し、削除するまで変わらない。
+ * 表示する行は slot の並び (order) として持ち、絞り込みと並べ替えは
+ * 配列の上でこの並びを作り直すだけで行う。列の値は GValue に文字列を
+ * コピーせず、配列の中の文字列をそのまま渡す。
+ *
+ * 文字列は ProjectinfoPool にまとめて置き、同じ値の多い説明や
+ * ベースパスは共有する。更新や削除で使われなくなった分が増えたら、
+ * 新しい pool に写し直して古いものを一度に解放する。
+ *
+ * 行は並びの中の位置で表すので、GtkTreeIter は並びが変わるまでしか
+ * 使えない (GTK_TREE_MODEL_ITERS_PERSIST ではない)。
+ */
+
+#ifdef HAVE_CONFIG_H
+#   include "config.h"
+#endif
+
+#include <string.h>
+
+#include <gtk/gtk.h>
+
+#include "profile.h"
+#include "projectmodel.h"
+
+#define ROW_NONE    G_MAXUINT       // 表示していない
+#define COMPACT_MIN (1024 * 1024)   // 写し直しを考える無駄の大きさ
+
+typedef struct {
+    Projectinfo info;           // 文字列は strings にある
+    guint search_id;            // 検索索引での id
+    gboolean live;              // FALSE なら空きか削除待ち
+    gchar *key_name;            // 並べ替え用の照合キー (必要な時に作る)
+    gchar *key_description;
+    gdouble frecency;           // 並べ替えの時に frecency_func で求める
+} ProjectRecord;
+
+struct _ProjectModel {
+    GObject parent;
+
+    gint stamp;
+    SearchIndex *index;         // 検索索引 (このモデルは持たない)
+    ProjectinfoPool *strings;   // 各プロジェクトの文字列
+    gsize string_bytes;         // strings に入れたおおよその量
+    gsize waste;                // そのうち使われなくなった量
+    GArray *records;            // slot → ProjectRecord
+    GArray *free_slots;
+    GArray *dead;               // 行の削除を通知した後で空きにする slot
+    GHashTable *lookup;         // prjfilename → slot + 1
+    GArray *order;              // 行 → slot
+    GArray *rows;               // slot → 行
+    GArray *newrow;             // slot → 新しい並びでの行 (作業用。普段は
+                                // 全て ROW_NONE)
+    GArray *slots;              // 検索索引での id → slot
+    GArray *changed;            // 値が変わった slot
+    gint sort_id;
+    GtkSortType sort_order;
+    ProjectFrecencyFunc frecency_func;
+    gpointer frecency_data;
+    GHashTable *only;           // 表示するプロジェクトファイル (NULL なら全て)
+    guint freeze;
+    gboolean dirty;             // 凍結中に並びを作り直す必要が生じた
+    gboolean rescan;            // 次の並びは全件から作る (追加、削除、
+                                // 並べ替えの変更の後)
+};
+
+#define RECORD(m, slot)     (&g_array_index ((m)->records, ProjectRecord, (slot)))
+#define ROW(m, slot)        (g_array_index ((m)->rows, guint, (slot)))
+#define ORDER(a, i)         (g_array_index ((a), guint, (i)))
+
+static const GType *column_types (void)
+{
+    static GType types[_P_N_COLUMNS];
+
+    if (types[0] == 0) {
+        types[_P_NAME] = G_TYPE_STRING;
+        types[_P_DESCRIPTION] = G_TYPE_STRING;
+        types[_P_TIMESTAMP] = G_TYPE_INT64;
+        types[_P_PRJFILENAME] = G_TYPE_STRING;
+        types[_P_BASE_PATH] = G_TYPE_STRING;
+        types[_P_ID] = G_TYPE_UINT;
+    }
+    return types;
+}
+
+static void project_model_tree_model_init (GtkTreeModelIface *iface);
+static void project_model_sortable_init (GtkTreeSortableIface *iface);
+
+G_DEFINE_TYPE_WITH_CODE (ProjectModel, project_model, G_TYPE_OBJECT,
+        G_IMPLEMENT_INTERFACE (GTK_TYPE_TREE_MODEL,
+                                project_model_tree_model_init)
+        G_IMPLEMENT_INTERFACE (GTK_TYPE_TREE_SORTABLE,
+                                project_model_sortable_init))
+
+static gchar *model_strdup (ProjectModel *model, const gchar *s,
+                                                        gboolean intern)
+{
+    if (s == NULL) return NULL;
+    model->string_bytes += strlen (s) + 1;
+    return projectinfo_pool_strdup (model->strings, s, intern);
+}
+
+static void model_strfree (ProjectModel *model, gchar **s)
+{
+    if (*s == NULL) return;
+    model->waste += strlen (*s) + 1;
+    *s = NULL;
+}
+
+static void record_clear (ProjectModel *model, ProjectRecord *rec)
+{
+    model_strfree (model, &rec->info.name);
+    model_strfree (model, &rec->info.description);
+    model_strfree (model, &rec->info.prjfilename);
+    model_strfree (model, &rec->info.base_path);
+    g_clear_pointer (&rec->key_name, g_free);
+    g_clear_pointer (&rec->key_description, g_free);
+    rec->live = FALSE;
+}
+
+/*
+ * prjfilename 以外の値を prj の値で置き換える
+ */
+static void record_update (ProjectModel *model, ProjectRecord *rec,
+                                                const Projectinfo *prj)
+{
+    model_strfree (model, &rec->info.name);
+    model_strfree (model, &rec->info.description);
+    model_strfree (model, &rec->info.base_path);
+    rec->info.name = model_strdup (model, prj->name, FALSE);
+    rec->info.description = model_strdup (model, prj->description, TRUE);
+    rec->info.base_path = model_strdup (model, prj->base_path, TRUE);
+    rec->info.mtime = prj->mtime;
+    rec->info.inode = prj->inode;
+    rec->info.size = prj->size;
+    g_clear_pointer (&rec->key_name, g_free);
+    g_clear_pointer (&rec->key_description, g_free);
+}
+
+static guint record_alloc (ProjectModel *model)
+{
+    guint slot;
+
+    if (model->free_slots->len != 0) {
+        slot = ORDER (model->free_slots, model->free_slots->len - 1);
+        g_array_set_size (model->free_slots, model->free_slots->len - 1);
+    }
+    else {
+        slot = model->records->len;
+        g_array_set_size (model->records, slot + 1);
+        g_array_set_size (model->rows, slot + 1);
+        g_array_set_size (model->newrow, slot + 1);
+        ROW (model, slot) = ROW_NONE;
+        ORDER (model->newrow, slot) = ROW_NONE;
+    }
+    return slot;
+}
+
+/*
+ * 検索索引での id から slot を引けるようにする (ROW_NONE なら消す)
+ */
+static void project_model_set_search_slot (ProjectModel *model, guint id,
+                                                            guint slot)
+{
+    guint n = model->slots->len;
+
+    if (id >= n) {
+        g_array_set_size (model->slots, id + 1);
+        for (; n < id; n++) ORDER (model->slots, n) = ROW_NONE;
+    }
+    ORDER (model->slots, id) = slot;
+}
+
+/*
+ * 並べ替え
+ */
+static gint record_compare (gconstpointer a, gconstpointer b, gpointer data)
+{
+    ProjectModel *model = data;
+    guint slot_a = *(const guint *)a, slot_b = *(const guint *)b;
+    const ProjectRecord *ra = RECORD (model, slot_a);
+    const ProjectRecord *rb = RECORD (model, slot_b);
+    gint ret = 0, sa, sb;
+
+    switch (model->sort_id) {
+    case PROJECT_MODEL_SORT_SCORE:
+        // 点数 (よく使うものは加点) の高い順。同点なら名前順。
+        sa = search_index_get_score (model->index, ra->search_id) +
+                                    search_frecency_boost (ra->frecency);
+        sb = search_index_get_score (model->index, rb->search_id) +
+                                    search_frecency_boost (rb->frecency);
+        ret = (sa > sb) ? -1 : (sa < sb) ? 1 : 0;
+        if (ret == 0) ret = strcmp (ra->key_name, rb->key_name);
+        break;
+    case PROJECT_MODEL_SORT_FRECENCY:
+        // よく使う順。使ったことがなければ新しい順。
+        ret = (ra->frecency < rb->frecency) - (ra->frecency > rb->frecency);
+        if (ret == 0) {
+            ret = (ra->info.mtime < rb->info.mtime) -
+                  (ra->info.mtime > rb->info.mtime);
+        }
+        break;
+    case _P_NAME:
+        ret = strcmp (ra->key_name, rb->key_name);
+        break;
+    case _P_DESCRIPTION:
+        ret = strcmp (ra->key_description, rb->key_description);
+        break;
+    case _P_TIMESTAMP:
+        ret = (ra->info.mtime > rb->info.mtime) -
+              (ra->info.mtime < rb->info.mtime);
+        break;
+    case _P_PRJFILENAME:
+        ret = g_strcmp0 (ra->info.prjfilename, rb->info.prjfilename);
+        break;
+    case _P_BASE_PATH:
+        ret = g_strcmp0 (ra->info.base_path, rb->info.base_path);
+        break;
+    }
+    if (model->sort_order == GTK_SORT_DESCENDING) ret = -ret;
+    if (ret == 0) ret = (slot_a > slot_b) - (slot_a < slot_b);
+    return ret;
+}
+
+static void project_model_sort (ProjectModel *model, GArray *order)
+{
+    ProjectRecord *rec;
+    gboolean name, description, frecency;
+    guint i;
+
+    if (model->sort_id < 0 || model->sort_id > PROJECT_MODEL_SORT_FRECENCY) {
+        return;
+    }
+
+    // 照合キーは並べ替えに使う列の分だけ作る
+    name = (model->sort_id == _P_NAME ||
+            model->sort_id == PROJECT_MODEL_SORT_SCORE);
+    description = (model->sort_id == _P_DESCRIPTION);
+    // frecency は時間で変わるので並べ替えの度に求める
+    frecency = (model->frecency_func != NULL &&
+                (model->sort_id == PROJECT_MODEL_SORT_SCORE ||
+                 model->sort_id == PROJECT_MODEL_SORT_FRECENCY));
+    for (i = 0; i < order->len; i++) {
+        rec = RECORD (model, ORDER (order, i));
+        rec->frecency = frecency ?
+                model->frecency_func (&rec->info, model->frecency_data) : 0;
+        if (name && rec->key_name == NULL) {
+            rec->key_name = g_utf8_collate_key (
+                        rec->info.name != NULL ? rec->info.name : "", -1);
+        }
+        if (description && rec->key_description == NULL) {
+            rec->key_description = g_utf8_collate_key (
+                        rec->info.description != NULL ?
+                                        rec->info.description : "", -1);
+        }
+    }
+    g_qsort_with_data (order->data, order->len, sizeof(guint),
+                                                record_compare, model);
+}
+
+/*
+ * 使われている文字列だけを新しい pool に写し、古い pool を解放する
+ */
+static void project_model_rebuild_strings (ProjectModel *model)
+{
+    ProjectinfoPool *old = model->strings;
+    ProjectRecord *rec;
+    guint slot;
+
+    model->strings = projectinfo_pool_new ();
+    model->string_bytes = 0;
+    model->waste = 0;
+    g_hash_table_remove_all (model->lookup);
+    for (slot = 0; slot < model->records->len; slot++) {
+        rec = RECORD (model, slot);
+        // 削除を通知する前の行も読まれることがあるので写しておく
+        if (rec->info.prjfilename == NULL) continue;
+        rec->info.name = model_strdup (model, rec->info.name, FALSE);
+        rec->info.description = model_strdup (model,
+                                            rec->info.description, TRUE);
+        rec->info.prjfilename = model_strdup (model,
+                                            rec->info.prjfilename, FALSE);
+        rec->info.base_path = model_strdup (model, rec->info.base_path, TRUE);
+        if (rec->live) {
+            g_hash_table_insert (model->lookup, rec->info.prjfilename,
+                                                GUINT_TO_POINTER (slot + 1));
+        }
+    }
+    projectinfo_pool_unref (old);
+}
+
+/*
+ * 表示する行の並びを order にし、その差分を通知する。
+ * 消える行を後ろから削除し、残る行の並べ替えを1回で通知してから、
+ * 新しい行を挿入する。残る行は選択やスクロールの位置を保つ。
+ */
+static void project_model_apply_order (ProjectModel *model, GArray *order)
+{
+    GtkTreeModel *tree_model = GTK_TREE_MODEL (model);
+    GtkTreePath *path;
+    GtkTreeIter iter;
+    gint *new_order;
+    gboolean moved = FALSE;
+    guint i, n, slot;
+
+    // 表示中の行と新しい行の数だけで済むよう、作業用の newrow は
+    // 使った所だけ戻す
+    for (i = 0; i < order->len; i++) {
+        ORDER (model->newrow, ORDER (order, i)) = i;
+    }
+
+    // 消える行
+    for (n = model->order->len; n > 0; n--) {
+        slot = ORDER (model->order, n - 1);
+        if (ORDER (model->newrow, slot) != ROW_NONE) continue;
+        g_array_remove_index (model->order, n - 1);
+        ROW (model, slot) = ROW_NONE;
+        model->stamp++;
+        path = gtk_tree_path_new_from_indices (n - 1, -1);
+        gtk_tree_model_row_deleted (tree_model, path);
+        gtk_tree_path_free (path);
+    }
+    for (i = 0; i < order->len; i++) {
+        ORDER (model->newrow, ORDER (order, i)) = ROW_NONE;
+    }
+
+    // 残る行を新しい並びでの順にする
+    for (i = 0; i < model->order->len; i++) {
+        ROW (model, ORDER (model->order, i)) = i;
+    }
+    new_order = g_new (gint, model->order->len + 1);
+    for (i = 0, n = 0; i < order->len; i++) {
+        slot = ORDER (order, i);
+        if (ROW (model, slot) == ROW_NONE) continue;
+        new_order[n] = ROW (model, slot);
+        if (new_order[n] != (gint)n) moved = TRUE;
+        n++;
+    }
+    if (moved) {
+        for (i = 0, n = 0; i < order->len; i++) {
+            slot = ORDER (order, i);
+            if (ROW (model, slot) != ROW_NONE) ORDER (model->order, n++) = slot;
+        }
+        model->stamp++;
+        path = gtk_tree_path_new ();
+        gtk_tree_model_rows_reordered (tree_model, path, NULL, new_order);
+        gtk_tree_path_free (path);
+    }
+    g_free (new_order);
+
+    // 新しい行。前から挿入すれば、挿入する位置は新しい並びでの行になる
+    for (i = 0; i < order->len; i++) {
+        slot = ORDER (order, i);
+        if (ROW (model, slot) != ROW_NONE) continue;
+        g_array_insert_val (model->order, i, slot);
+        model->stamp++;
+        iter.stamp = model->stamp;
+        iter.user_data = GUINT_TO_POINTER (i);
+        path = gtk_tree_path_new_from_indices (i, -1);
+        gtk_tree_model_row_inserted (tree_model, path, &iter);
+        gtk_tree_path_free (path);
+    }
+    for (i = 0; i < model->order->len; i++) {
+        ROW (model, ORDER (model->order, i)) = i;
+    }
+}
+
+/*
+ * 表示する行の並びを作り直し、変わったところを通知する
+ */
+static void project_model_resync (ProjectModel *model)
+{
+    GtkTreeModel *tree_model = GTK_TREE_MODEL (model);
+    ProjectRecord *rec;
+    GtkTreePath *path;
+    GtkTreeIter iter;
+    const GArray *matches;
+    GArray *order;
+    guint i, id, slot;
+
+    if (model->freeze > 0) {
+        model->dirty = TRUE;
+        return;
+    }
+    model->dirty = FALSE;
+
+    // 表示する slot を集めて並べる。検索語で絞り込むだけなら、
+    // 検索索引に残っている一致した id だけを調べる
+    matches = search_index_get_matches (model->index);
+    if (model->rescan || matches == NULL) {
+        order = g_array_sized_new (FALSE, FALSE, sizeof(guint),
+                                                model->records->len);
+        for (slot = 0; slot < model->records->len; slot++) {
+            rec = RECORD (model, slot);
+            if (rec->live &&
+                    search_index_is_visible (model->index, rec->search_id) &&
+                    (model->only == NULL ||
+                     g_hash_table_contains (model->only,
+                                            rec->info.prjfilename))) {
+                g_array_append_val (order, slot);
+            }
+        }
+    }
+    else {
+        order = g_array_sized_new (FALSE, FALSE, sizeof(guint),
+                                                matches->len);
+        for (i = 0; i < matches->len; i++) {
+            id = ORDER (matches, i);
+            if (id >= model->slots->len) continue;
+            slot = ORDER (model->slots, id);
+            if (slot == ROW_NONE) continue;
+            rec = RECORD (model, slot);
+            if (rec->live && rec->search_id == id &&
+                    (model->only == NULL ||
+                     g_hash_table_contains (model->only,
+                                            rec->info.prjfilename))) {
+                g_array_append_val (order, slot);
+            }
+        }
+    }
+    model->rescan = FALSE;
+    project_model_sort (model, order);
+    project_model_apply_order (model, order);
+    g_array_unref (order);
+
+    // 位置の変わらなかった行の値の変更
+    for (i = 0; i < model->changed->len; i++) {
+        slot = ORDER (model->changed, i);
+        if (ROW (model, slot) == ROW_NONE) continue;
+        iter.stamp = model->stamp;
+        iter.user_data = GUINT_TO_POINTER (ROW (model, slot));
+        path = gtk_tree_path_new_from_indices (ROW (model, slot), -1);
+        gtk_tree_model_row_changed (tree_model, path, &iter);
+        gtk_tree_path_free (path);
+    }
+    g_array_set_size (model->changed, 0);
+
+    // 削除した行はもう参照されないので空きにする
+    for (i = 0; i < model->dead->len; i++) {
+        slot = ORDER (model->dead, i);
+        record_clear (model, RECORD (model, slot));
+        g_array_append_val (model->free_slots, slot);
+    }
+    g_array_set_size (model->dead, 0);
+
+    if (model->waste >= COMPACT_MIN &&
+                        model->waste * 2 >= model->string_bytes) {
+        project_model_rebuild_strings (model);
+    }
+}
+
+/*
+ * プロジェクトを追加する。既にある場合はその値を更新する。
+ */
+void project_model_set (ProjectModel *model, const Projectinfo *prj)
+{
+    ProjectRecord *rec;
+    gpointer value;
+    guint slot;
+
+    g_return_if_fail (PROJECT_IS_MODEL (model));
+    if (prj == NULL || prj->prjfilename == NULL) return;
+
+    value = g_hash_table_lookup (model->lookup, prj->prjfilename);
+    if (value != NULL) {
+        slot = GPOINTER_TO_UINT (value) - 1;
+        rec = RECORD (model, slot);
+        record_update (model, rec, prj);
+        search_index_set (model->index, rec->search_id, rec->info.name,
+                rec->info.description, rec->info.base_path,
+                rec->info.mtime);
+    }
+    else {
+        slot = record_alloc (model);
+        rec = RECORD (model, slot);
+        rec->info.prjfilename = model_strdup (model, prj->prjfilename, FALSE);
+        record_update (model, rec, prj);
+        rec->live = TRUE;
+        rec->search_id = search_index_add (model->index, rec->info.name,
+                rec->info.description, rec->info.base_path,
+                rec->info.mtime);
+        project_model_set_search_slot (model, rec->search_id, slot);
+        g_hash_table_insert (model->lookup, rec->info.prjfilename,
+                                            GUINT_TO_POINTER (slot + 1));
+        PROFILE_COUNT (PROFILE_ROWS_INSERTED, 1);
+    }
+    g_array_append_val (model->changed, slot);
+    model->rescan = TRUE;
+    project_model_resync (model);
+}
+
+/*
+ * 行の削除を通知するまでは文字列を残しておく
+ */
+static void project_model_remove_slot (ProjectModel *model, guint slot)
+{
+    ProjectRecord *rec = RECORD (model, slot);
+
+    g_hash_table_remove (model->lookup, rec->info.prjfilename);
+    search_index_remove (model->index, rec->search_id);
+    project_model_set_search_slot (model, rec->search_id, ROW_NONE);
+    rec->live = FALSE;
+    model->rescan = TRUE;
+    g_array_append_val (model->dead, slot);
+}
+
+void project_model_remove (ProjectModel *model, const gchar *prjfilename)
+{
+    gpointer value;
+
+    g_return_if_fail (PROJECT_IS_MODEL (model));
+
+    value = g_hash_table_lookup (model->lookup, prjfilename);
+    if (value == NULL) return;
+    project_model_remove_slot (model, GPOINTER_TO_UINT (value) - 1);
+    project_model_resync (model);
+}
+
+/*
+ * ディレクトリ dir の下にあるプロジェクトを全て削除する
+ */
+void project_model_remove_under (ProjectModel *model, const gchar *dir)
+{
+    ProjectRecord *rec;
+    gchar *prefix;
+    guint slot;
+
+    g_return_if_fail (PROJECT_IS_MODEL (model));
+
+    prefix = g_strconcat (dir, G_DIR_SEPARATOR_S, NULL);
+    for (slot = 0; slot < model->records->len; slot++) {
+        rec = RECORD (model, slot);
+        if (rec->live && g_str_has_prefix (rec->info.prjfilename, prefix)) {
+            project_model_remove_slot (model, slot);
+        }
+    }
+    g_free (prefix);
+    project_model_resync (model);
+}
+
+/*
+ * 凍結中は変更を通知せず、解凍した時にまとめて並びを作り直す
+ */
+void project_model_freeze (ProjectModel *model)
+{
+    g_return_if_fail (PROJECT_IS_MODEL (model));
+    model->freeze++;
+}
+
+void project_model_thaw (ProjectModel *model)
+{
+    g_return_if_fail (PROJECT_IS_MODEL (model));
+    g_return_if_fail (model->freeze > 0);
+
+    if (--model->freeze == 0 && model->dirty) project_model_resync (model);
+}
+
+/*
+ * 更新や削除で使われなくなった文字列を解放する。
+ * 全体を読み直した後に呼ぶ。project_model_get_info() で得た文字列は
+ * 使えなくなる。
+ */
+void project_model_compact (ProjectModel *model)
+{
+    g_return_if_fail (PROJECT_IS_MODEL (model));
+    if (model->waste != 0) project_model_rebuild_strings (model);
+}
+
+/*
+ * 検索索引の表示フラグに合わせて行を選び直す
+ */
+void project_model_refilter (ProjectModel *model)
+{
+    g_return_if_fail (PROJECT_IS_MODEL (model));
+    project_model_resync (model);
+}
+
+/*
+ * 行のプロジェクト情報 (コピーしない)
+ */
+const Projectinfo *project_model_get_info (ProjectModel *model,
+                                                GtkTreeIter *iter)
+{
+    guint row;
+
+    g_return_val_if_fail (PROJECT_IS_MODEL (model), NULL);
+    g_return_val_if_fail (iter->stamp == model->stamp, NULL);
+
+    row = GPOINTER_TO_UINT (iter->user_data);
+    g_return_val_if_fail (row < model->order->len, NULL);
+    return &RECORD (model, ORDER (model->order, row))->info;
+}
+
+/*
+ * 絞り込みに関係なく、読み込んだプロジェクトの数
+ */
+guint project_model_get_n_projects (ProjectModel *model)
+{
+    g_return_val_if_fail (PROJECT_IS_MODEL (model), 0);
+    return g_hash_table_size (model->lookup);
+}
+
+/*
+ * 使用頻度の求め方を設定する。
+ * PROJECT_MODEL_SORT_FRECENCY と点数順の加点に使う。
+ */
+void project_model_set_frecency_func (ProjectModel *model,
+                                ProjectFrecencyFunc func, gpointer data)
+{
+    g_return_if_fail (PROJECT_IS_MODEL (model));
+    model->frecency_func = func;
+    model->frecency_data = data;
+    model->rescan = TRUE;
+    project_model_resync (model);
+}
+
+/*
+ * 検索語とは別に、表示するプロジェクトをファイル名の集合で限る。
+ * NULL なら限らない。project_model_refilter() で反映する。
+ */
+void project_model_set_only (ProjectModel *model, GHashTable *prjfilenames)
+{
+    g_return_if_fail (PROJECT_IS_MODEL (model));
+    if (prjfilenames != NULL) g_hash_table_ref (prjfilenames);
+    if (model->only != NULL) g_hash_table_unref (model->only);
+    model->only = prjfilenames;
+}
+
+/*
+ * 絞り込みに関係なく、読み込んだ全てのプロジェクトについて func を呼ぶ
+ */
+void project_model_foreach (ProjectModel *model, ProjectForeachFunc func,
+                                                    gpointer data)
+{
+    ProjectRecord *rec;
+    guint slot;
+
+    g_return_if_fail (PROJECT_IS_MODEL (model));
+    for (slot = 0; slot < model->records->len; slot++) {
+        rec = RECORD (model, slot);
+        if (rec->live) func (&rec->info, data);
+    }
+}
+
+ProjectModel *project_model_new (SearchIndex *index)
+{
+    ProjectModel *model = g_object_new (PROJECT_TYPE_MODEL, NULL);
+
+    model->index = index;
+    return model;
+}
+
+/*
+ * GtkTreeModel
+ */
+static GtkTreeModelFlags project_model_get_flags (GtkTreeModel *tree_model)
+{
+    return GTK_TREE_MODEL_LIST_ONLY;
+}
+
+static gint project_model_get_n_columns (GtkTreeModel *tree_model)
+{
+    return _P_N_COLUMNS;
+}
+
+static GType project_model_get_column_type (GtkTreeModel *tree_model,
+                                                        gint index)
+{
+    g_return_val_if_fail (index >= 0 && index < _P_N_COLUMNS,
+                                                        G_TYPE_INVALID);
+    return column_types ()[index];
+}
+
+static gboolean project_model_iter_nth (ProjectModel *model,
+                                            GtkTreeIter *iter, gint n)
+{
+    if (n < 0 || (guint)n >= model->order->len) {
+        iter->stamp = 0;
+        return FALSE;
+    }
+    iter->stamp = model->stamp;
+    iter->user_data = GUINT_TO_POINTER (n);
+    return TRUE;
+}
+
+static gboolean project_model_get_iter (GtkTreeModel *tree_model,
+                                        GtkTreeIter *iter, GtkTreePath *path)
+{
+    if (gtk_tree_path_get_depth (path) != 1) {
+        iter->stamp = 0;
+        return FALSE;
+    }
+    return project_model_iter_nth (PROJECT_MODEL (tree_model), iter,
+                                    gtk_tree_path_get_indices (path)[0]);
+}
+
+static GtkTreePath *project_model_get_path (GtkTreeModel *tree_model,
+                                                    GtkTreeIter *iter)
+{
+    g_return_val_if_fail (iter->stamp == PROJECT_MODEL (tree_model)->stamp,
+                                                                    NULL);
+    return gtk_tree_path_new_from_indices (
+                                GPOINTER_TO_INT (iter->user_data), -1);
+}
+
+static void project_model_get_value (GtkTreeModel *tree_model,
+                                     GtkTreeIter *iter,
+                                     gint column,
+                                     GValue *value)
+{
+    ProjectModel *model = PROJECT_MODEL (tree_model);
+    const ProjectRecord *rec;
+    guint row = GPOINTER_TO_UINT (iter->user_data);
+
+    g_return_if_fail (iter->stamp == model->stamp);
+    g_return_if_fail (column >= 0 && column < _P_N_COLUMNS);
+    g_return_if_fail (row < model->order->len);
+
+    rec = RECORD (model, ORDER (model->order, row));
+    g_value_init (value, column_types ()[column]);
+    // 文字列は配列の中のものをそのまま渡す
+    switch (column) {
+    case _P_NAME:
+        g_value_set_static_string (value, rec->info.name);
+        break;
+    case _P_DESCRIPTION:
+        g_value_set_static_string (value, rec->info.description);
+        break;
+    case _P_TIMESTAMP:
+        g_value_set_int64 (value, rec->info.mtime);
+        break;
+    case _P_PRJFILENAME:
+        g_value_set_static_string (value, rec->info.prjfilename);
+        break;
+    case _P_BASE_PATH:
+        g_value_set_static_string (value, rec->info.base_path);
+        break;
+    case _P_ID:
+        g_value_set_uint (value, rec->search_id);
+        break;
+    }
+}
+
+static gboolean project_model_iter_next (GtkTreeModel *tree_model,
+                                                GtkTreeIter *iter)
+{
+    return project_model_iter_nth (PROJECT_MODEL (tree_model), iter,
+                                    GPOINTER_TO_INT (iter->user_data) + 1);
+}
+
+static gboolean project_model_iter_previous (GtkTreeModel *tree_model,
+                                                GtkTreeIter *iter)
+{
+    return project_model_iter_nth (PROJECT_MODEL (tree_model), iter,
+                                    GPOINTER_TO_INT (iter->user_data) - 1);
+}
+
+static gboolean project_model_iter_children (GtkTreeModel *tree_model,
+                                             GtkTreeIter *iter,
+                                             GtkTreeIter *parent)
+{
+    if (parent != NULL) {
+        iter->stamp = 0;
+        return FALSE;
+    }
+    return project_model_iter_nth (PROJECT_MODEL (tree_model), iter, 0);
+}
+
+static gboolean project_model_iter_has_child (GtkTreeModel *tree_model,
+                                                GtkTreeIter *iter)
+{
+    return FALSE;
+}
+
+static gint project_model_iter_n_children (GtkTreeModel *tree_model,
+                                                GtkTreeIter *iter)
+{
+    if (iter != NULL) return 0;
+    return PROJECT_MODEL (tree_model)->order->len;
+}
+
+static gboolean project_model_iter_nth_child (GtkTreeModel *tree_model,
+                                              GtkTreeIter *iter,
+                                              GtkTreeIter *parent,
+                                              gint n)
+{
+    if (parent != NULL) {
+        iter->stamp = 0;
+        return FALSE;
+    }
+    return project_model_iter_nth (PROJECT_MODEL (tree_model), iter, n);
+}
+
+static gboolean project_model_iter_parent (GtkTreeModel *tree_model,
+                                           GtkTreeIter *iter,
+                                           GtkTreeIter *child)
+{
+    iter->stamp = 0;
+    return FALSE;
+}
+
+static void project_model_tree_model_init (GtkTreeModelIface *iface)
+{
+    iface->get_flags = project_model_get_flags;
+    iface->get_n_columns = project_model_get_n_columns;
+    iface->get_column_type = project_model_get_column_type;
+    iface->get_iter = project_model_get_iter;
+    iface->get_path = project_model_get_path;
+    iface->get_value = project_model_get_value;
+    iface->iter_next = project_model_iter_next;
+    iface->iter_previous = project_model_iter_previous;
+    iface->iter_children = project_model_iter_children;
+    iface->iter_has_child = project_model_iter_has_child;
+    iface->iter_n_children = project_model_iter_n_children;
+    iface->iter_nth_child = project_model_iter_nth_child;
+    iface->iter_parent = project_model_iter_parent;
+}
+
+/*
+ * GtkTreeSortable
+ * 比較は列ごとに決まっているので、比較関数の設定はできない。
+ */
+static gboolean project_model_get_sort_column_id (GtkTreeSortable *sortable,
+                                                  gint *sort_column_id,
+                                                  GtkSortType *order)
+{
+    ProjectModel *model = PROJECT_MODEL (sortable);
+
+    if (sort_column_id != NULL) *sort_column_id = model->sort_id;
+    if (order != NULL) *order = model->sort_order;
+    return model->sort_id >= 0;
+}
+
+static void project_model_set_sort_column_id (GtkTreeSortable *sortable,
+                                              gint sort_column_id,
+                                              GtkSortType order)
+{
+    ProjectModel *model = PROJECT_MODEL (sortable);
+
+    if (model->sort_id == sort_column_id && model->sort_order == order) {
+        return;
+    }
+    model->sort_id = sort_column_id;
+    model->sort_order = order;
+    gtk_tree_sortable_sort_column_changed (sortable);
+    model->rescan = TRUE;
+    project_model_resync (model);
+}
+
+static void project_model_set_sort_func (GtkTreeSortable *sortable,
+                                         gint sort_column_id,
+                                         GtkTreeIterCompareFunc func,
+                                         gpointer data,
+                                         GDestroyNotify destroy)
+{
+    g_warning ("%s: custom sort functions are not supported", G_STRFUNC);
+}
+
+static void project_model_set_default_sort_func (GtkTreeSortable *sortable,
+                                                 GtkTreeIterCompareFunc func,
+                                                 gpointer data,
+                                                 GDestroyNotify destroy)
+{
+    g_warning ("%s: custom sort functions are not supported", G_STRFUNC);
+}
+
+static gboolean project_model_has_default_sort_func (
+                                            GtkTreeSortable *sortable)
+{
+    return FALSE;
+}
+
+static void project_model_sortable_init (GtkTreeSortableIface *iface)
+{
+    iface->get_sort_column_id = project_model_get_sort_column_id;
+    iface->set_sort_column_id = project_model_set_sort_column_id;
+    iface->set_sort_func = project_model_set_sort_func;
+    iface->set_default_sort_func = project_model_set_default_sort_func;
+    iface->has_default_sort_func = project_model_has_default_sort_func;
+}
+
+/*
+ * GObject
+ */
+static void project_model_finalize (GObject *object)
+{
+    ProjectModel *model = PROJECT_MODEL (object);
+    ProjectRecord *rec;
+    guint slot;
+
+    for (slot = 0; slot < model->records->len; slot++) {
+        rec = RECORD (model, slot);
+        g_free (rec->key_name);
+        g_free (rec->key_description);
+    }
+    projectinfo_pool_unref (model->strings);
+    g_array_unref (model->records);
+    g_array_unref (model->free_slots);
+    g_array_unref (model->dead);
+    g_hash_table_unref (model->lookup);
+    if (model->only != NULL) g_hash_table_unref (model->only);
+    g_array_unref (model->order);
+    g_array_unref (model->rows);
+    g_array_unref (model->newrow);
+    g_array_unref (model->slots);
+    g_array_unref (model->changed);
+
+    G_OBJECT_CLASS (project_model_parent_class)->finalize (object);
+}
+
+static void project_model_class_init (ProjectModelClass *klass)
+{
+    G_OBJECT_CLASS (klass)->finalize = project_model_finalize;
+}
+
+static void project_model_init (ProjectModel *model)
+{
+    model->stamp = g_random_int ();
+    model->strings = projectinfo_pool_new ();
+    model->records = g_array_new (FALSE, TRUE, sizeof(ProjectRecord));
+    model->free_slots = g_array_new (FALSE, FALSE, sizeof(guint));
+    model->dead = g_array_new (FALSE, FALSE, sizeof(guint));
+    model->lookup = g_hash_table_new (g_str_hash, g_str_equal);
+    model->order = g_array_new (FALSE, FALSE, sizeof(guint));
+    model->rows = g_array_new (FALSE, FALSE, sizeof(guint));
+    model->newrow = g_array_new (FALSE, FALSE, sizeof(guint));
+    model->slots = g_array_new (FALSE, FALSE, sizeof(guint));
+    model->changed = g_array_new (FALSE, FALSE, sizeof(guint));
+    model->sort_id = GTK_TREE_SORTABLE_UNSORTED_SORT_COLUMN_ID;
+    model->sort_order = GTK_SORT_ASCENDING;
+}
@@ -0,0 +1,78 @@
+/*
+ * Geany プロジェクト一覧 - プロジェクト一覧のモデル
+ *
+ * Copylight by Sakai Satoru 2018
+ *
+ * endeavor2wako@gmail.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+
+#ifndef PROJECTMODEL_H
+#define PROJECTMODEL_H
+
+#include <gtk/gtk.h>
+
+#include "projectinfo.h"
+#include "searchindex.h"
+
+/*
+ * GtkTreeViewでのカラム位置
+ */
+enum {
+    _P_NAME = 0,
+    _P_DESCRIPTION,
+    _P_TIMESTAMP,           // 更新日時 (gint64, 表示時に書式化する)
+    _P_PRJFILENAME,
+    _P_BASE_PATH,
+    _P_ID,                  // 検索索引 (SearchIndex) での id
+    _P_N_COLUMNS
+};
+
+#define PROJECT_MODEL_SORT_SCORE    _P_ID   // 一致の点数で並べる sort id
+#define PROJECT_MODEL_SORT_FRECENCY _P_N_COLUMNS    // よく使う順
+
+/*
+ * プロジェクトの使用頻度 (frecency)。並べ替えの時に呼ばれる。
+ */
+typedef gdouble (*ProjectFrecencyFunc) (const Projectinfo *prj,
+                                                    gpointer user_data);
+typedef void (*ProjectForeachFunc) (const Projectinfo *prj,
+                                                    gpointer user_data);
+
+#define PROJECT_TYPE_MODEL (project_model_get_type ())
+G_DECLARE_FINAL_TYPE (ProjectModel, project_model, PROJECT, MODEL, GObject)
+
+ProjectModel *project_model_new (SearchIndex *index);
+void project_model_set (ProjectModel *model, const Projectinfo *prj);
+void project_model_remove (ProjectModel *model, const gchar *prjfilename);
+void project_model_remove_under (ProjectModel *model, const gchar *dir);
+void project_model_freeze (ProjectModel *model);
+void project_model_thaw (ProjectModel *model);
+void project_model_refilter (ProjectModel *model);
+void project_model_compact (ProjectModel *model);
+const Projectinfo *project_model_get_info (ProjectModel *model,
+                                                GtkTreeIter *iter);
+guint project_model_get_n_projects (ProjectModel *model);
+void project_model_set_frecency_func (ProjectModel *model,
+                                ProjectFrecencyFunc func, gpointer data);
+void project_model_set_only (ProjectModel *model, GHashTable *prjfilenames);
+void project_model_foreach (ProjectModel *model, ProjectForeachFunc func,
+                                                    gpointer data);
+
+#endif /* PROJECTMODEL_H */
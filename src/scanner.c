@@ -0,0 +1,351 @@
+/*
+ * Geany プロジェクト一覧 - ディレクトリの走査
+ *
+ * Copylight by Sakai Satoru 2018
+ *
+ * endeavor2wako@gmail.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+
+/*
+ * プロジェクトファイルを探してディレクトリを並列に走査する。
+ * ディレクトリ1つを1つの仕事としてスレッドプールに積み、見つかった
+ * サブディレクトリは新しい仕事として積み直す。空いたスレッドは共有の
+ * 待ち行列から次の仕事を取るので、深い木や遅いファイルシステムでも
+ * 負荷が偏らない。
+ *
+ * NFS などでは呼び出しの回数と往復の待ち時間が走査の時間を決めるので、
+ * エントリの種類は readdir の d_type で見分け、stat は種類の分からない
+ * エントリと .geany にだけ行う。ディレクトリは親からの openat で開き、
+ * パスの文字列は1つのバッファを使い回す。
+ */
+
+#ifndef _GNU_SOURCE
+#   define _GNU_SOURCE          // statx
+#endif
+
+#ifdef HAVE_CONFIG_H
+#   include "config.h"
+#endif
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <glib.h>
+#include <glib/gi18n.h>
+#include <glib/gstdio.h>
+#include <gio/gio.h>
+
+#include "profile.h"
+#include "scanner.h"
+
+#define WALKER_MAX_OPEN     256     // 積んだ仕事のために開いておく fd の上限
+
+typedef struct {
+    const ScanOptions *opt;
+    ScanFileFunc file_func;
+    ScanDirFunc dir_func;
+    gpointer user_data;
+    GCancellable *cancellable;
+    GThreadPool *pool;
+    gint pending;               // 積まれているか実行中の仕事の数
+                                // (起点を積み終えるまでは1多い)
+    gint n_open;                // 積んだ仕事が持っている fd の数
+    GMutex lock;
+    GCond cond;
+} Walker;
+
+ScanDir *scan_dir_new (const gchar *path, gint level)
+{
+    ScanDir *d = g_new (ScanDir, 1);
+    d->path = g_strdup (path);
+    d->level = level;
+    d->fd = -1;
+    return d;
+}
+
+void scan_dir_free (ScanDir *d)
+{
+    if (d != NULL) {
+        if (d->fd >= 0) close (d->fd);
+        g_free (d->path);
+        g_free (d);
+    }
+}
+
+/*
+ * skip はディレクトリ名のパターン (*, ? が使える) の並び
+ * n_threads が 0 ならプロセッサ数に合わせる
+ */
+ScanOptions *scan_options_new (gint max_depth, guint n_threads,
+                                                    gchar **skip)
+{
+    ScanOptions *opt = g_new (ScanOptions, 1);
+
+    opt->max_depth = MAX (max_depth, 0);
+    opt->n_threads = (n_threads != 0) ? n_threads :
+                                        g_get_num_processors ();
+    opt->skip = g_ptr_array_new_with_free_func (
+                                (GDestroyNotify)g_pattern_spec_free);
+    for (; skip != NULL && *skip != NULL; skip++) {
+        if (**skip != '\0') {
+            g_ptr_array_add (opt->skip, g_pattern_spec_new (*skip));
+        }
+    }
+    return opt;
+}
+
+void scan_options_free (ScanOptions *opt)
+{
+    if (opt != NULL) {
+        g_ptr_array_unref (opt->skip);
+        g_free (opt);
+    }
+}
+
+gboolean scan_options_skip (const ScanOptions *opt, const gchar *name)
+{
+    guint i;
+
+    for (i = 0; i < opt->skip->len; i++) {
+        if (g_pattern_spec_match_string (g_ptr_array_index (opt->skip, i),
+                                                            name)) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+/*
+ * 拡張子が geany のファイル
+ */
+gboolean scanner_is_project_file (const gchar *name)
+{
+    return g_str_has_suffix (name, ".geany");
+}
+
+/*
+ * fd は開いてあるディレクトリ (-1 なら仕事を始める時にパスで開く)
+ */
+static void walker_push (Walker *w, const gchar *path, gint level, int fd)
+{
+    ScanDir *d = scan_dir_new (path, level);
+
+    d->fd = fd;
+    if (fd >= 0) g_atomic_int_inc (&w->n_open);
+    g_atomic_int_inc (&w->pending);
+    g_thread_pool_push (w->pool, d, NULL);
+}
+
+/*
+ * stat の代わりに、必要な項目だけを求める statx を使う。
+ * statx の無いカーネルでは fstatat に戻る。
+ */
+static gboolean walker_stat (int dfd, const gchar *name, GStatBuf *st)
+{
+#ifdef STATX_BASIC_STATS
+    static gint no_statx = FALSE;
+    struct statx sx;
+
+    if (g_atomic_int_get (&no_statx) == FALSE) {
+        if (statx (dfd, name, 0, STATX_TYPE | STATX_MODE | STATX_INO |
+                            STATX_SIZE | STATX_MTIME, &sx) == 0) {
+            memset (st, 0, sizeof (*st));
+            st->st_mode = sx.stx_mode;
+            st->st_ino = sx.stx_ino;
+            st->st_size = sx.stx_size;
+            st->st_mtime = sx.stx_mtime.tv_sec;
+            return TRUE;
+        }
+        if (errno != ENOSYS) return FALSE;
+        g_atomic_int_set (&no_statx, TRUE);
+    }
+#endif
+    return fstatat (dfd, name, st, 0) == 0;
+}
+
+/*
+ * ディレクトリを1つ読む。サブディレクトリは新しい仕事として積む。
+ */
+static void walker_read_dir (Walker *w, ScanDir *d)
+{
+    DIR *dir;
+    struct dirent *ent;
+    const gchar *name;
+    GString *path;
+    GStatBuf st;
+    gsize dirlen, n_entries = 0, n_stats = 0;
+    gboolean is_dir, is_reg, have_stat;
+    gint64 start = PROFILE_BEGIN ();
+    int fd, sub;
+
+    // 親が開いておいた fd はここで引き取る (closedir で閉じられる)
+    fd = (d->fd >= 0) ? d->fd :
+                open (d->path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    d->fd = -1;
+    dir = (fd >= 0) ? fdopendir (fd) : NULL;
+    if (dir == NULL) {
+        if (fd >= 0) close (fd);
+        g_warning ("%s (%s)", _("Fail to open directory."), d->path);
+        return;
+    }
+    fd = dirfd (dir);
+    if (w->dir_func != NULL) w->dir_func (d->path, d->level, w->user_data);
+
+    path = g_string_new (d->path);
+    if (path->len == 0 || path->str[path->len - 1] != G_DIR_SEPARATOR) {
+        g_string_append_c (path, G_DIR_SEPARATOR);
+    }
+    dirlen = path->len;
+
+    while ((ent = readdir (dir)) != NULL) {
+        name = ent->d_name;
+        if (name[0] == '.' && (name[1] == '\0' ||
+                                (name[1] == '.' && name[2] == '\0'))) {
+            continue;
+        }
+        if (g_cancellable_is_cancelled (w->cancellable)) break;
+        n_entries++;
+
+        is_dir = (ent->d_type == DT_DIR);
+        is_reg = (ent->d_type == DT_REG);
+        have_stat = FALSE;
+        if (ent->d_type == DT_UNKNOWN || ent->d_type == DT_LNK) {
+            // 種類を返さないファイルシステムとシンボリックリンクだけ調べる
+            n_stats++;
+            if (walker_stat (fd, name, &st) == FALSE) continue;
+            is_dir = S_ISDIR (st.st_mode);
+            is_reg = S_ISREG (st.st_mode);
+            have_stat = TRUE;
+        }
+
+        if (is_dir) {
+            if (d->level < w->opt->max_depth &&
+                            scan_options_skip (w->opt, name) == FALSE) {
+                g_string_truncate (path, dirlen);
+                g_string_append (path, name);
+                // 開いたままの fd が増えすぎないよう、上限を超えたら
+                // 子の仕事を始める時にパスで開く
+                sub = -1;
+                if (g_atomic_int_get (&w->n_open) < WALKER_MAX_OPEN) {
+                    sub = openat (fd, name,
+                                    O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+                }
+                walker_push (w, path->str, d->level + 1, sub);
+            }
+        }
+        else if (is_reg && scanner_is_project_file (name)) {
+            // 更新日時などはキャッシュの照合に使うので、ここで1回だけ求める
+            if (have_stat == FALSE) {
+                n_stats++;
+                if (walker_stat (fd, name, &st) == FALSE ||
+                                        !S_ISREG (st.st_mode)) {
+                    continue;
+                }
+            }
+            g_string_truncate (path, dirlen);
+            g_string_append (path, name);
+            w->file_func (path->str, &st, w->user_data);
+        }
+    }
+    closedir (dir);
+    g_string_free (path, TRUE);
+
+    PROFILE_COUNT (PROFILE_DIRS_OPENED, 1);
+    PROFILE_COUNT (PROFILE_ENTRIES_READ, n_entries);
+    PROFILE_COUNT (PROFILE_STAT_CALLS, n_stats);
+    PROFILE_END ("scan dir", start);
+}
+
+/*
+ * 仕事を1つ終える。最後の1つなら待っている scanner_walk() を起こす。
+ */
+static void walker_done (Walker *w)
+{
+    if (g_atomic_int_dec_and_test (&w->pending)) {
+        g_mutex_lock (&w->lock);
+        g_cond_signal (&w->cond);
+        g_mutex_unlock (&w->lock);
+    }
+}
+
+static void walker_job (gpointer data, gpointer user_data)
+{
+    ScanDir *d = data;
+    Walker *w = user_data;
+
+    if (d->fd >= 0) g_atomic_int_add (&w->n_open, -1);
+    if (g_cancellable_is_cancelled (w->cancellable) == FALSE) {
+        walker_read_dir (w, d);
+    }
+    scan_dir_free (d);
+
+    // 子の仕事は既に積んであるので、0 になれば全体が終わっている
+    walker_done (w);
+}
+
+/*
+ * roots (ScanDir の配列) から走査し、全て終わるまで戻らない。
+ * ワーカースレッドから呼ぶこと。
+ */
+void scanner_walk (const ScanOptions *opt, GPtrArray *roots,
+                    ScanFileFunc file_func, ScanDirFunc dir_func,
+                    gpointer user_data, GCancellable *cancellable)
+{
+    Walker w = { 0 };
+    ScanDir *d;
+    guint i;
+
+    if (roots->len == 0) return;
+
+    w.opt = opt;
+    w.file_func = file_func;
+    w.dir_func = dir_func;
+    w.user_data = user_data;
+    w.cancellable = cancellable;
+    g_mutex_init (&w.lock);
+    g_cond_init (&w.cond);
+    w.pool = g_thread_pool_new (walker_job, &w, opt->n_threads, FALSE, NULL);
+
+    // 積んでいる間に先の起点が終わっても 0 にならないよう1つ余分に数え、
+    // 積み終えてから引く
+    g_atomic_int_inc (&w.pending);
+    for (i = 0; i < roots->len; i++) {
+        d = g_ptr_array_index (roots, i);
+        if (d->level <= opt->max_depth) {
+            walker_push (&w, d->path, d->level, -1);
+        }
+    }
+    walker_done (&w);
+
+    g_mutex_lock (&w.lock);
+    while (g_atomic_int_get (&w.pending) != 0) {
+        g_cond_wait (&w.cond, &w.lock);
+    }
+    g_mutex_unlock (&w.lock);
+
+    g_thread_pool_free (w.pool, FALSE, TRUE);
+    g_mutex_clear (&w.lock);
+    g_cond_clear (&w.cond);
+}
@@ -0,0 +1,70 @@
+/*
+ * Geany プロジェクト一覧 - ディレクトリの走査
+ *
+ * Copylight by Sakai Satoru 2018
+ *
+ * endeavor2wako@gmail.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+
+#ifndef SCANNER_H
+#define SCANNER_H
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <gio/gio.h>
+
+typedef struct {
+    gchar *path;
+    gint level;                 // 走査の起点からの深さ
+    gint fd;                    // 走査中に開いておいたディレクトリ (無ければ -1)
+} ScanDir;
+
+/*
+ * 走査の設定
+ */
+typedef struct {
+    gint max_depth;             // 起点からのサブディレクトリの深さの上限
+    guint n_threads;            // 走査に使うスレッド数
+    GPtrArray *skip;            // 走査しないディレクトリ名 (GPatternSpec)
+} ScanOptions;
+
+/*
+ * 見つかったプロジェクトファイル、開いたディレクトリごとに呼ばれる。
+ * 複数のワーカースレッドから同時に呼ばれるので、呼ばれる側で排他すること。
+ */
+typedef void (*ScanFileFunc) (const gchar *path, const GStatBuf *st,
+                                                    gpointer user_data);
+typedef void (*ScanDirFunc) (const gchar *path, gint level,
+                                                    gpointer user_data);
+
+ScanDir *scan_dir_new (const gchar *path, gint level);
+void scan_dir_free (ScanDir *d);
+
+ScanOptions *scan_options_new (gint max_depth, guint n_threads,
+                                                    gchar **skip);
+void scan_options_free (ScanOptions *opt);
+gboolean scan_options_skip (const ScanOptions *opt, const gchar *name);
+
+gboolean scanner_is_project_file (const gchar *name);
+void scanner_walk (const ScanOptions *opt, GPtrArray *roots,
+                    ScanFileFunc file_func, ScanDirFunc dir_func,
+                    gpointer user_data, GCancellable *cancellable);
+
+#endif /* SCANNER_H */
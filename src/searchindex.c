@@ -0,0 +1,643 @@
+/*
+ * Geany プロジェクト一覧 - 検索用の索引
+ *
+ * Copylight by Sakai Satoru 2018
+ *
+ * endeavor2wako@gmail.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+
+/*
+ * プロジェクトごとの検索キーを読み込み時に一度だけ作り、1つの連続した
+ * バッファに並べておく。検索は GtkTreeModel を介さずにこのバッファを
+ * 走査し、結果は id ごとの表示フラグとして持つ。
+ *
+ * 検索語ごとの一致した id の一覧を段として積んでおき、検索語が
+ * 伸びた時は直前の段の id だけを調べ、縮んだ時は積んである段に戻す。
+ * 1文字の入力や削除は、全件ではなく一致している件数に比例して済む。
+ *
+ * 検索キーは名前、説明、ベースパスを NFKC で正規化して大文字小文字を
+ * 畳み込んだもの。全角と半角の英数字やカナは同じ文字として扱われる。
+ * 更新日時は文字列ではなく数値で持ち、期間で絞り込む。期間を変えた時は
+ * 積んである段を捨てて全件を調べ直す。
+ *
+ * 照合は fzf と同様のあいまい検索で、検索語の文字がこの順に現れれば
+ * 一致とし、語の先頭や連続した一致ほど高い点を付ける。各キーに含まれる
+ * 文字の種類を 64bit のマスクとして連続した配列に持ち、検索語の文字を
+ * 含まないキーは照合の前に一括で除く (このループはベクトル化される)。
+ * 照合そのものは memchr で次の文字へ飛びながら進む。
+ */
+
+#ifdef HAVE_CONFIG_H
+#   include "config.h"
+#endif
+
+#include <math.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include "searchindex.h"
+
+#define FIELD_SEPARATOR '\x1f'      // フィールドの区切り
+#define ENTRY_FREE      G_MAXUINT
+#define MAX_LEVELS      32          // 保持する検索語の段数
+
+/*
+ * 点数
+ */
+#define SCORE_MATCH         16      // 1文字の一致
+#define BONUS_BOUNDARY      8       // 語の先頭での一致
+#define BONUS_FIRST_CHAR    8       // 検索語の先頭がキーの先頭で一致
+#define BONUS_CONSECUTIVE   8       // 直前の文字に続く一致
+#define BONUS_NAME          2       // 名前の中での一致
+#define PENALTY_GAP_START   5       // 一致の間が空いた
+#define PENALTY_GAP_EXTEND  1       // 空いたバイト数ごと
+#define BOOST_SCALE         8       // よく使うプロジェクトへの加点
+#define BOOST_MAX           48      // (一致 3 文字分程度まで)
+
+typedef struct {
+    guint offset;           // keys の中での位置
+    guint len;              // ENTRY_FREE なら未使用の id
+} SearchEntry;
+
+/*
+ * ある検索語に一致した id の一覧
+ * 最上段の ids には削除済みや重複した id が残っていることがあるので、
+ * 使う時は visible で確かめる。
+ */
+typedef struct {
+    gchar *query;           // 正規化済みの検索語
+    GArray *ids;
+} SearchLevel;
+
+struct _SearchIndex {
+    GString *keys;          // 検索キーを '\0' 区切りで連結したもの
+    GArray *entries;        // id → SearchEntry
+    GArray *masks;          // id → キーに含まれる文字の種類 (guint64)
+    GArray *mtimes;         // id → 更新日時 (gint64)
+    GArray *scores;         // id → 現在の検索語での点数 (gint)
+    GByteArray *scratch;    // 絞り込みの作業用
+    GArray *free_ids;       // 再利用できる id
+    GByteArray *visible;    // id → 現在の検索語で表示するか
+    GPtrArray *levels;      // SearchLevel の段。最後が現在の検索語
+    gchar *query;           // 現在の検索語 (正規化済み, 空なら NULL)
+    guint64 qmask;          // 検索語に含まれる文字の種類
+    GArray *qchars;         // 検索語の各文字のバイト数 (guint8)
+    gint64 since, until;    // 更新日時の期間 (両端を含む)
+    gsize dead;             // keys の中の使われていないバイト数
+};
+
+static void search_level_free (SearchLevel *level)
+{
+    g_free (level->query);
+    g_array_unref (level->ids);
+    g_free (level);
+}
+
+static SearchLevel *search_index_top (const SearchIndex *idx)
+{
+    return (idx->levels->len != 0) ?
+        g_ptr_array_index (idx->levels, idx->levels->len - 1) : NULL;
+}
+
+/*
+ * 索引の内容が変わったので、現在の段以外は使えなくなる
+ */
+static void search_index_drop_levels (SearchIndex *idx)
+{
+    if (idx->levels->len > 1) {
+        g_ptr_array_remove_range (idx->levels, 0, idx->levels->len - 1);
+    }
+}
+
+/*
+ * 検索用に文字列を正規化する (NFKC + 大文字小文字の畳み込み)
+ */
+gchar *search_normalize (const gchar *s)
+{
+    gchar *valid, *nfkc, *folded;
+
+    if (s == NULL) return g_strdup ("");
+
+    valid = g_utf8_validate (s, -1, NULL) ? NULL : g_utf8_make_valid (s, -1);
+    nfkc = g_utf8_normalize ((valid != NULL) ? valid : s, -1,
+                                                    G_NORMALIZE_NFKC);
+    folded = g_utf8_casefold (nfkc, -1);
+    g_free (nfkc);
+    g_free (valid);
+    return folded;
+}
+
+SearchIndex *search_index_new (void)
+{
+    SearchIndex *idx = g_new0 (SearchIndex, 1);
+
+    idx->keys = g_string_new (NULL);
+    idx->entries = g_array_new (FALSE, FALSE, sizeof(SearchEntry));
+    idx->free_ids = g_array_new (FALSE, FALSE, sizeof(guint));
+    idx->visible = g_byte_array_new ();
+    idx->masks = g_array_new (FALSE, TRUE, sizeof(guint64));
+    idx->mtimes = g_array_new (FALSE, TRUE, sizeof(gint64));
+    idx->scores = g_array_new (FALSE, TRUE, sizeof(gint));
+    idx->scratch = g_byte_array_new ();
+    idx->qchars = g_array_new (FALSE, FALSE, sizeof(guint8));
+    idx->levels = g_ptr_array_new_with_free_func (
+                                (GDestroyNotify)search_level_free);
+    idx->since = SEARCH_TIME_MIN;
+    idx->until = SEARCH_TIME_MAX;
+    return idx;
+}
+
+void search_index_free (SearchIndex *idx)
+{
+    if (idx != NULL) {
+        g_string_free (idx->keys, TRUE);
+        g_array_unref (idx->entries);
+        g_array_unref (idx->free_ids);
+        g_byte_array_unref (idx->visible);
+        g_array_unref (idx->masks);
+        g_array_unref (idx->mtimes);
+        g_array_unref (idx->scores);
+        g_byte_array_unref (idx->scratch);
+        g_array_unref (idx->qchars);
+        g_ptr_array_unref (idx->levels);
+        g_free (idx->query);
+        g_free (idx);
+    }
+}
+
+/*
+ * バイトの種類をマスクのビットに対応させる
+ * 英小文字と数字はそれぞれ1ビット、その他は数ビットを共有する。
+ */
+static inline guint64 byte_mask (guchar c)
+{
+    if (c >= 'a' && c <= 'z') return G_GUINT64_CONSTANT(1) << (c - 'a');
+    if (c >= '0' && c <= '9') return G_GUINT64_CONSTANT(1) << (26 + c - '0');
+    if (c < 0x80) return G_GUINT64_CONSTANT(1) << (36 + (c & 7));
+    return G_GUINT64_CONSTANT(1) << (44 + (c % 20));
+}
+
+static guint64 string_mask (const gchar *s, gsize len)
+{
+    guint64 mask = 0;
+    gsize i;
+
+    for (i = 0; i < len; i++) mask |= byte_mask ((guchar)s[i]);
+    return mask;
+}
+
+/*
+ * [p, end) で最初に現れる文字 c (clen バイト) の位置
+ */
+static inline const gchar *find_char (const gchar *p, const gchar *end,
+                                        const gchar *c, guint clen)
+{
+    while (p < end) {
+        p = memchr (p, c[0], end - p);
+        if (p == NULL || (gsize)(end - p) < clen) return NULL;
+        if (clen == 1 || !memcmp (p, c, clen)) return p;
+        p++;
+    }
+    return NULL;
+}
+
+/*
+ * [start, p) で最後に現れる文字 c の位置
+ */
+static inline const gchar *rfind_char (const gchar *start, const gchar *p,
+                                        const gchar *c, guint clen)
+{
+    for (p -= clen; p >= start; p--) {
+        if (*p == c[0] && (clen == 1 || !memcmp (p, c, clen))) return p;
+    }
+    return NULL;
+}
+
+static inline gboolean is_boundary (gchar c)
+{
+    return c == FIELD_SEPARATOR || c == ' ' || c == '/' || c == '_' ||
+           c == '-' || c == '.' || c == ':' || c == '\t' || c == '\n';
+}
+
+/*
+ * キーを検索語で照合し点数を返す。一致しなければ -1。
+ * 前から検索語の文字を順に探して一致の終わりを決め、そこから後ろへ
+ * 探し直して最も短い範囲を得てから点数を付ける (fzf の v1 と同じ)。
+ */
+static gint fuzzy_score (const SearchIndex *idx, const gchar *key, gsize klen)
+{
+    const gchar *end = key + klen, *p, *hit, *c, *name_end, *prev = NULL;
+    const guint8 *clen = (const guint8 *)idx->qchars->data;
+    guint n = idx->qchars->len, i;
+    gint score = 0, s;
+
+    // 前方: 検索語の最後の文字が一致する位置を探す
+    for (p = key, c = idx->query, i = 0; i < n; c += clen[i], i++) {
+        hit = find_char (p, end, c, clen[i]);
+        if (hit == NULL) return -1;
+        p = hit + clen[i];
+    }
+    end = p;
+
+    // 後方: 一致の範囲をできるだけ短くする
+    for (i = n; i-- > 0; ) {
+        c -= clen[i];
+        p = rfind_char (key, p, c, clen[i]);
+    }
+
+    // 範囲の中で点数を付ける
+    name_end = memchr (key, FIELD_SEPARATOR, klen);
+    if (name_end == NULL) name_end = key + klen;
+    for (c = idx->query, i = 0; i < n; c += clen[i], i++) {
+        hit = find_char (p, end, c, clen[i]);
+        s = SCORE_MATCH;
+        if (hit == key || is_boundary (hit[-1])) {
+            s += BONUS_BOUNDARY;
+            if (i == 0 && hit == key) s += BONUS_FIRST_CHAR;
+        }
+        if (prev != NULL) {
+            if (hit == prev) {
+                s += BONUS_CONSECUTIVE;
+            }
+            else {
+                s -= PENALTY_GAP_START + PENALTY_GAP_EXTEND * (hit - prev - 1);
+            }
+        }
+        if (hit < name_end) s += BONUS_NAME;
+        score += s;
+        prev = hit + clen[i];
+        p = prev;
+    }
+    return MAX (score, 0);
+}
+
+/*
+ * 現在の検索語で id を照合し、点数を記録する
+ */
+static gboolean entry_matches (const SearchIndex *idx, guint id)
+{
+    const SearchEntry *e = &g_array_index (idx->entries, SearchEntry, id);
+    gint score;
+
+    gint64 mtime = g_array_index (idx->mtimes, gint64, id);
+
+    if (e->len == ENTRY_FREE) return FALSE;
+    if (idx->query == NULL) return TRUE;
+    if (mtime < idx->since || mtime > idx->until) return FALSE;
+    if ((g_array_index (idx->masks, guint64, id) & idx->qmask) != idx->qmask) {
+        return FALSE;
+    }
+    score = fuzzy_score (idx, idx->keys->str + e->offset, e->len);
+    g_array_index (idx->scores, gint, id) = score;
+    return score >= 0;
+}
+
+/*
+ * 検索語を設定し、照合用に文字ごとのバイト数とマスクを作る
+ */
+static void search_index_set_query (SearchIndex *idx, const gchar *query)
+{
+    const gchar *p;
+    guint8 n;
+
+    g_free (idx->query);
+    idx->query = g_strdup (query);
+    g_array_set_size (idx->qchars, 0);
+    idx->qmask = 0;
+    if (query == NULL) return;
+
+    idx->qmask = string_mask (query, strlen (query));
+    for (p = query; *p != '\0'; p = g_utf8_next_char (p)) {
+        n = g_utf8_next_char (p) - p;
+        g_array_append_val (idx->qchars, n);
+    }
+}
+
+/*
+ * 使われなくなった領域が半分を超えたら詰め直す
+ */
+static void search_index_compact (SearchIndex *idx)
+{
+    GString *keys;
+    SearchEntry *e;
+    guint i;
+
+    if (idx->dead < 4096 || idx->dead * 2 < idx->keys->len) return;
+
+    keys = g_string_sized_new (idx->keys->len - idx->dead);
+    for (i = 0; i < idx->entries->len; i++) {
+        e = &g_array_index (idx->entries, SearchEntry, i);
+        if (e->len == ENTRY_FREE) continue;
+        g_string_append_len (keys, idx->keys->str + e->offset, e->len + 1);
+        e->offset = keys->len - e->len - 1;
+    }
+    g_string_free (idx->keys, TRUE);
+    idx->keys = keys;
+    idx->dead = 0;
+}
+
+/*
+ * id の検索キーを作り直す。表示フラグも現在の検索語で更新する。
+ */
+void search_index_set (SearchIndex *idx, guint id, const gchar *name,
+                        const gchar *description, const gchar *base_path,
+                        gint64 mtime)
+{
+    SearchEntry *e;
+    SearchLevel *top;
+    gchar *key;
+    gsize start;
+    gboolean was_visible;
+
+    g_return_if_fail (id < idx->entries->len);
+
+    e = &g_array_index (idx->entries, SearchEntry, id);
+    if (e->len != ENTRY_FREE) idx->dead += e->len + 1;
+
+    start = idx->keys->len;
+    key = search_normalize (name);
+    g_string_append (idx->keys, key);
+    g_free (key);
+    g_string_append_c (idx->keys, FIELD_SEPARATOR);
+    key = search_normalize (description);
+    g_string_append (idx->keys, key);
+    g_free (key);
+    g_string_append_c (idx->keys, FIELD_SEPARATOR);
+    key = search_normalize (base_path);
+    g_string_append (idx->keys, key);
+    g_free (key);
+    // 各キーは '\0' で区切る
+    g_string_append_c (idx->keys, '\0');
+
+    e->offset = start;
+    e->len = idx->keys->len - start - 1;
+    g_array_index (idx->masks, guint64, id) =
+                        string_mask (idx->keys->str + start, e->len);
+    g_array_index (idx->mtimes, gint64, id) = mtime;
+
+    // 現在の段だけは最新に保つ
+    search_index_drop_levels (idx);
+    was_visible = idx->visible->data[id];
+    idx->visible->data[id] = entry_matches (idx, id);
+    top = search_index_top (idx);
+    if (top != NULL && idx->visible->data[id] && !was_visible) {
+        g_array_append_val (top->ids, id);
+    }
+
+    search_index_compact (idx);
+}
+
+guint search_index_add (SearchIndex *idx, const gchar *name,
+                        const gchar *description, const gchar *base_path,
+                        gint64 mtime)
+{
+    SearchEntry e = { 0, ENTRY_FREE };
+    guint8 zero = 0;
+    guint id;
+
+    if (idx->free_ids->len != 0) {
+        id = g_array_index (idx->free_ids, guint, idx->free_ids->len - 1);
+        g_array_set_size (idx->free_ids, idx->free_ids->len - 1);
+    }
+    else {
+        id = idx->entries->len;
+        g_array_append_val (idx->entries, e);
+        g_byte_array_append (idx->visible, &zero, 1);
+        g_array_set_size (idx->masks, id + 1);
+        g_array_set_size (idx->mtimes, id + 1);
+        g_array_set_size (idx->scores, id + 1);
+    }
+    search_index_set (idx, id, name, description, base_path, mtime);
+    return id;
+}
+
+void search_index_remove (SearchIndex *idx, guint id)
+{
+    SearchEntry *e;
+
+    g_return_if_fail (id < idx->entries->len);
+
+    e = &g_array_index (idx->entries, SearchEntry, id);
+    if (e->len == ENTRY_FREE) return;
+    idx->dead += e->len + 1;
+    e->len = ENTRY_FREE;
+    g_array_index (idx->masks, guint64, id) = 0;
+    idx->visible->data[id] = FALSE;
+    g_array_append_val (idx->free_ids, id);
+    search_index_drop_levels (idx);
+}
+
+/*
+ * 表示中の id の表示フラグを落とす
+ */
+static void search_index_clear_visible (SearchIndex *idx)
+{
+    SearchLevel *top = search_index_top (idx);
+    guint i;
+
+    if (top == NULL) {
+        memset (idx->visible->data, 0, idx->visible->len);
+        return;
+    }
+    for (i = 0; i < top->ids->len; i++) {
+        idx->visible->data[g_array_index (top->ids, guint, i)] = FALSE;
+    }
+}
+
+/*
+ * 現在の段の id のうち query にも一致するものを新しい段にする。
+ * 段が無ければ全件を調べる。
+ */
+static void search_index_narrow (SearchIndex *idx, gchar *query)
+{
+    SearchLevel *top = search_index_top (idx), *level;
+    guint i, id;
+
+    level = g_new (SearchLevel, 1);
+    level->query = query;
+    level->ids = g_array_new (FALSE, FALSE, sizeof(guint));
+    search_index_set_query (idx, query);
+
+    if (top == NULL) {
+        // 期間内で、検索語の文字を全て含むキーだけを先に選ぶ。
+        // 分岐の無いループなのでコンパイラがベクトル化できる。
+        const guint64 *masks = (const guint64 *)idx->masks->data;
+        const gint64 *mtimes = (const gint64 *)idx->mtimes->data;
+        const guint64 qmask = idx->qmask;
+        const gint64 since = idx->since, until = idx->until;
+        guint8 *cand;
+        guint n = idx->entries->len;
+
+        g_byte_array_set_size (idx->scratch, n);
+        cand = idx->scratch->data;
+        for (id = 0; id < n; id++) {
+            cand[id] = ((masks[id] & qmask) == qmask) &
+                       (mtimes[id] >= since) & (mtimes[id] <= until);
+        }
+        for (id = 0; id < n; id++) {
+            if (cand[id] && entry_matches (idx, id)) {
+                g_array_append_val (level->ids, id);
+            }
+        }
+    }
+    else {
+        // 削除済みや重複した id はここで落とし、現在の段も詰めておく
+        // (検索語を戻した時にそのまま使えるように)
+        guint n = 0;
+        for (i = 0; i < top->ids->len; i++) {
+            id = g_array_index (top->ids, guint, i);
+            if (idx->visible->data[id] == FALSE) continue;
+            idx->visible->data[id] = FALSE;
+            g_array_index (top->ids, guint, n++) = id;
+            if (entry_matches (idx, id)) g_array_append_val (level->ids, id);
+        }
+        g_array_set_size (top->ids, n);
+    }
+    for (i = 0; i < level->ids->len; i++) {
+        idx->visible->data[g_array_index (level->ids, guint, i)] = TRUE;
+    }
+
+    if (idx->levels->len >= MAX_LEVELS) {
+        g_ptr_array_remove_index (idx->levels, 0);
+    }
+    g_ptr_array_add (idx->levels, level);
+}
+
+/*
+ * 検索語 (正規化前) と更新日時の期間 (両端を含む) に合わせて
+ * 表示フラグを作り直す。期間を限らない側は SEARCH_TIME_MIN または
+ * SEARCH_TIME_MAX を渡す。
+ */
+void search_index_filter (SearchIndex *idx, const gchar *query,
+                                            gint64 since, gint64 until)
+{
+    SearchLevel *top;
+    gchar *q;
+    guint i, id;
+
+    if (since != idx->since || until != idx->until) {
+        // 期間が変わると積んである段は使えない
+        search_index_clear_visible (idx);
+        g_ptr_array_set_size (idx->levels, 0);
+        search_index_set_query (idx, NULL);
+        idx->since = since;
+        idx->until = until;
+    }
+
+    q = (query != NULL && *query != '\0') ? search_normalize (query) : NULL;
+    if (q == NULL && (since != SEARCH_TIME_MIN || until != SEARCH_TIME_MAX)) {
+        // 期間だけで絞り込む。空の検索語は全てに一致する
+        q = g_strdup ("");
+    }
+    top = search_index_top (idx);
+    if (q == NULL) {
+        // 検索語が空なら全て表示する
+        g_ptr_array_set_size (idx->levels, 0);
+        search_index_set_query (idx, NULL);
+        return;
+    }
+    if (top != NULL && !strcmp (top->query, q)) {
+        g_free (q);
+        return;
+    }
+
+    // 前方一致する段まで戻る
+    if (top != NULL && !g_str_has_prefix (q, top->query)) {
+        search_index_clear_visible (idx);
+        do {
+            g_ptr_array_remove_index (idx->levels, idx->levels->len - 1);
+            top = search_index_top (idx);
+        } while (top != NULL && !g_str_has_prefix (q, top->query));
+
+        if (top != NULL) {
+            // 点数もこの検索語で付け直す
+            search_index_set_query (idx, top->query);
+            for (i = 0; i < top->ids->len; i++) {
+                id = g_array_index (top->ids, guint, i);
+                idx->visible->data[id] = entry_matches (idx, id);
+            }
+        }
+        else {
+            search_index_set_query (idx, NULL);
+        }
+    }
+    else if (top == NULL) {
+        search_index_clear_visible (idx);
+    }
+
+    if (top != NULL && !strcmp (top->query, q)) {
+        g_free (q);
+        return;
+    }
+    search_index_narrow (idx, q);
+}
+
+/*
+ * 現在の検索語に一致する id の一覧。検索語が空なら NULL (全て一致する)。
+ * 段に残っている削除済みや重複した id はここで詰めるので、一致した
+ * 件数に比例して済む。次に索引を変更するまで使える。
+ */
+const GArray *search_index_get_matches (SearchIndex *idx)
+{
+    SearchLevel *top = search_index_top (idx);
+    guint i, n = 0, id;
+
+    if (idx->query == NULL || top == NULL) return NULL;
+    for (i = 0; i < top->ids->len; i++) {
+        id = g_array_index (top->ids, guint, i);
+        if (idx->visible->data[id] == FALSE) continue;
+        idx->visible->data[id] = FALSE;
+        g_array_index (top->ids, guint, n++) = id;
+    }
+    g_array_set_size (top->ids, n);
+    for (i = 0; i < n; i++) {
+        idx->visible->data[g_array_index (top->ids, guint, i)] = TRUE;
+    }
+    return top->ids;
+}
+
+gboolean search_index_is_visible (const SearchIndex *idx, guint id)
+{
+    if (id >= idx->visible->len) return FALSE;
+    if (idx->query == NULL) {
+        return g_array_index (idx->entries, SearchEntry, id).len != ENTRY_FREE;
+    }
+    return idx->visible->data[id] != 0;
+}
+
+/*
+ * 現在の検索語での点数。検索語が空なら 0。
+ */
+gint search_index_get_score (const SearchIndex *idx, guint id)
+{
+    if (idx->query == NULL || id >= idx->scores->len) return 0;
+    return g_array_index (idx->scores, gint, id);
+}
+
+/*
+ * よく使うプロジェクト (frecency が大きい) への加点。
+ * 一致の良さを覆さない程度にとどめる。
+ */
+gint search_frecency_boost (gdouble frecency)
+{
+    if (frecency <= 0) return 0;
+    return MIN ((gint)(BOOST_SCALE * log2 (1 + frecency)), BOOST_MAX);
+}
@@ -0,0 +1,54 @@
+/*
+ * Geany プロジェクト一覧 - 検索用の索引
+ *
+ * Copylight by Sakai Satoru 2018
+ *
+ * endeavor2wako@gmail.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+
+#ifndef SEARCHINDEX_H
+#define SEARCHINDEX_H
+
+#include <glib.h>
+
+typedef struct _SearchIndex SearchIndex;
+
+#define SEARCH_TIME_MIN     G_MININT64  // 更新日時の期間を限らない
+#define SEARCH_TIME_MAX     G_MAXINT64
+
+gchar *search_normalize (const gchar *s);
+
+SearchIndex *search_index_new (void);
+void search_index_free (SearchIndex *idx);
+guint search_index_add (SearchIndex *idx, const gchar *name,
+                        const gchar *description, const gchar *base_path,
+                        gint64 mtime);
+void search_index_set (SearchIndex *idx, guint id, const gchar *name,
+                        const gchar *description, const gchar *base_path,
+                        gint64 mtime);
+void search_index_remove (SearchIndex *idx, guint id);
+void search_index_filter (SearchIndex *idx, const gchar *query,
+                                            gint64 since, gint64 until);
+const GArray *search_index_get_matches (SearchIndex *idx);
+gboolean search_index_is_visible (const SearchIndex *idx, guint id);
+gint search_index_get_score (const SearchIndex *idx, guint id);
+gint search_frecency_boost (gdouble frecency);
+
+#endif /* SEARCHINDEX_H */
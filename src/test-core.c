@@ -0,0 +1,565 @@
+/*
+ * Geany プロジェクト一覧 - 中核部分のテスト
+ *
+ * Copylight by Sakai Satoru 2018
+ *
+ * endeavor2wako@gmail.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+
+/*
+ * libgeanyproject-core の単体テスト。一時ディレクトリに .geany や
+ * ディレクトリの木を作り、読み込み、検索、走査、索引を確かめる。
+ * --list だけは作ったプログラムを起動して確かめる。
+ *
+ *   make check
+ */
+
+#ifdef HAVE_CONFIG_H
+#   include "config.h"
+#endif
+
+#include <string.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "ownerindex.h"
+#include "projectinfo.h"
+#include "scanner.h"
+#include "searchindex.h"
+#include "textindex.h"
+
+typedef struct {
+    gchar *dir;
+} Fixture;
+
+static void fixture_setup (Fixture *f, gconstpointer data)
+{
+    GError *err = NULL;
+
+    f->dir = g_dir_make_tmp ("geanyproject-XXXXXX", &err);
+    g_assert_no_error (err);
+}
+
+static void remove_tree (const gchar *path)
+{
+    GDir *dir = g_dir_open (path, 0, NULL);
+    const gchar *name;
+
+    while (dir != NULL && (name = g_dir_read_name (dir)) != NULL) {
+        gchar *child = g_build_filename (path, name, NULL);
+        if (g_file_test (child, G_FILE_TEST_IS_DIR) &&
+                !g_file_test (child, G_FILE_TEST_IS_SYMLINK)) {
+            remove_tree (child);
+        }
+        else {
+            g_unlink (child);
+        }
+        g_free (child);
+    }
+    if (dir != NULL) g_dir_close (dir);
+    g_rmdir (path);
+}
+
+static void fixture_teardown (Fixture *f, gconstpointer data)
+{
+    remove_tree (f->dir);
+    g_free (f->dir);
+}
+
+/*
+ * dir の下に相対パス name のファイルを作り、その絶対パスを返す
+ */
+static gchar *write_file (const gchar *dir, const gchar *name,
+                                            const gchar *contents)
+{
+    gchar *path = g_build_filename (dir, name, NULL);
+    gchar *parent = g_path_get_dirname (path);
+    GError *err = NULL;
+
+    g_mkdir_with_parents (parent, 0700);
+    g_file_set_contents (path, contents, -1, &err);
+    g_assert_no_error (err);
+    g_free (parent);
+    return path;
+}
+
+/*
+ * base のプロジェクトで、files を開いていて、ビルドコマンドが command の
+ * .geany を作る
+ */
+static gchar *write_project (const gchar *dir, const gchar *name,
+                        const gchar *base, const gchar *file,
+                        const gchar *command)
+{
+    GString *s = g_string_new (NULL);
+    gchar *uri, *path, *filename;
+
+    g_string_append (s, "[editor]\nline_wrapping=false\n\n");
+    g_string_append_printf (s, "[project]\nname=%s\n"
+                            "description=説明\\n2行目\nbase_path=%s\n\n",
+                            name, base);
+    if (file != NULL) {
+        uri = g_uri_escape_string (file, "/", FALSE);
+        g_string_append_printf (s,
+                    "[files]\ncurrent_page=0\n"
+                    "FILE_NAME_0=0;C;0;EUTF-8;0;1;0;%s;0;4\n\n", uri);
+        g_free (uri);
+    }
+    if (command != NULL) {
+        g_string_append_printf (s, "[build-menu]\nEX_00_LB=_Run\n"
+                                    "EX_00_CM=%s\n", command);
+    }
+    filename = g_strdup_printf ("%s/%s.geany", name, name);
+    path = write_file (dir, filename, s->str);
+    g_free (filename);
+    g_string_free (s, TRUE);
+    return path;
+}
+
+static void test_read_header (Fixture *f, gconstpointer data)
+{
+    Projectinfo *prj;
+    gchar *path;
+
+    path = write_project (f->dir, "alpha", "/srv/alpha/", NULL, NULL);
+    prj = projectinfo_read_header (path, NULL);
+    g_assert_nonnull (prj);
+    g_assert_cmpstr (prj->name, ==, "alpha");
+    g_assert_cmpstr (prj->description, ==, "説明\n2行目");
+    g_assert_cmpstr (prj->base_path, ==, "/srv/alpha/");
+    g_assert_cmpstr (prj->prjfilename, ==, path);
+    g_assert_cmpint (prj->size, >, 0);
+    projectinfo_free (prj);
+    g_free (path);
+
+    // 読めない形なら NULL (呼び出し側は GKeyFile で読み直す)
+    path = write_file (f->dir, "broken.geany",
+                        "[project]\nname=a\\qb\n");
+    g_assert_null (projectinfo_read_header (path, NULL));
+    g_free (path);
+    path = write_file (f->dir, "nogroup.geany", "name=a\n");
+    g_assert_null (projectinfo_read_header (path, NULL));
+    g_free (path);
+    path = g_build_filename (f->dir, "missing.geany", NULL);
+    g_assert_null (projectinfo_read_header (path, NULL));
+    g_free (path);
+}
+
+static void test_search_filter (void)
+{
+    SearchIndex *idx = search_index_new ();
+    guint a, b, c;
+
+    a = search_index_add (idx, "geany-project", "一覧", "/x", 100);
+    b = search_index_add (idx, "web front", NULL, "/y", 200);
+    c = search_index_add (idx, "カタカナ", NULL, NULL, 300);
+
+    search_index_filter (idx, "", SEARCH_TIME_MIN, SEARCH_TIME_MAX);
+    g_assert_true (search_index_is_visible (idx, a));
+    g_assert_true (search_index_is_visible (idx, b));
+    g_assert_true (search_index_is_visible (idx, c));
+
+    // 文字がこの順に現れれば一致する
+    search_index_filter (idx, "gpj", SEARCH_TIME_MIN, SEARCH_TIME_MAX);
+    g_assert_true (search_index_is_visible (idx, a));
+    g_assert_false (search_index_is_visible (idx, b));
+    g_assert_false (search_index_is_visible (idx, c));
+    g_assert_cmpint (search_index_get_score (idx, a), >, 0);
+
+    // 伸ばした検索語と縮めた検索語
+    search_index_filter (idx, "gpjz", SEARCH_TIME_MIN, SEARCH_TIME_MAX);
+    g_assert_false (search_index_is_visible (idx, a));
+    search_index_filter (idx, "g", SEARCH_TIME_MIN, SEARCH_TIME_MAX);
+    g_assert_true (search_index_is_visible (idx, a));
+
+    // 全角と半角、大文字と小文字
+    search_index_filter (idx, "ＷＥＢ", SEARCH_TIME_MIN, SEARCH_TIME_MAX);
+    g_assert_false (search_index_is_visible (idx, a));
+    g_assert_true (search_index_is_visible (idx, b));
+    search_index_filter (idx, "ｶﾀｶﾅ", SEARCH_TIME_MIN, SEARCH_TIME_MAX);
+    g_assert_true (search_index_is_visible (idx, c));
+
+    // 更新日時の期間 (両端を含む)
+    search_index_filter (idx, "", 200, 300);
+    g_assert_false (search_index_is_visible (idx, a));
+    g_assert_true (search_index_is_visible (idx, b));
+    g_assert_true (search_index_is_visible (idx, c));
+
+    search_index_free (idx);
+}
+
+typedef struct {
+    GMutex lock;
+    GPtrArray *files;
+    GPtrArray *dirs;
+} WalkResult;
+
+static void cb_walk_file (const gchar *path, const GStatBuf *st,
+                                                    gpointer data)
+{
+    WalkResult *r = data;
+
+    g_mutex_lock (&r->lock);
+    g_ptr_array_add (r->files, g_strdup (path));
+    g_mutex_unlock (&r->lock);
+}
+
+static void cb_walk_dir (const gchar *path, gint level, gpointer data)
+{
+    WalkResult *r = data;
+
+    g_mutex_lock (&r->lock);
+    g_ptr_array_add (r->dirs, g_strdup (path));
+    g_mutex_unlock (&r->lock);
+}
+
+static gboolean walk_found (GPtrArray *array, const gchar *dir,
+                                                const gchar *name)
+{
+    gchar *path = g_build_filename (dir, name, NULL);
+    gboolean found = FALSE;
+    guint i;
+
+    for (i = 0; i < array->len && found == FALSE; i++) {
+        found = (strcmp (g_ptr_array_index (array, i), path) == 0);
+    }
+    g_free (path);
+    return found;
+}
+
+static void test_scanner_walk (Fixture *f, gconstpointer data)
+{
+    static gchar *skip[] = { "node_*", NULL };
+    WalkResult r;
+    ScanOptions *opt;
+    GPtrArray *roots;
+    gint i;
+
+    g_free (write_file (f->dir, "top.geany", "[project]\nname=top\n"));
+    g_free (write_file (f->dir, "a/a.geany", "[project]\nname=a\n"));
+    g_free (write_file (f->dir, "a/readme.txt", "text\n"));
+    g_free (write_file (f->dir, "b/c/deep.geany", "[project]\nname=deep\n"));
+    g_free (write_file (f->dir, "node_modules/x.geany", "[project]\n"));
+    for (i = 0; i < 20; i++) {
+        gchar *name = g_strdup_printf ("many/p%02d/p%02d.geany", i, i);
+        g_free (write_file (f->dir, name, "[project]\n"));
+        g_free (name);
+    }
+
+    g_mutex_init (&r.lock);
+    r.files = g_ptr_array_new_with_free_func (g_free);
+    r.dirs = g_ptr_array_new_with_free_func (g_free);
+    roots = g_ptr_array_new_with_free_func ((GDestroyNotify)scan_dir_free);
+    g_ptr_array_add (roots, scan_dir_new (f->dir, 0));
+
+    // 起点から1段下まで
+    opt = scan_options_new (1, 4, skip);
+    scanner_walk (opt, roots, cb_walk_file, cb_walk_dir, &r, NULL);
+    g_assert_true (walk_found (r.files, f->dir, "top.geany"));
+    g_assert_true (walk_found (r.files, f->dir, "a/a.geany"));
+    g_assert_false (walk_found (r.files, f->dir, "b/c/deep.geany"));
+    g_assert_false (walk_found (r.files, f->dir, "node_modules/x.geany"));
+    g_assert_false (walk_found (r.files, f->dir, "a/readme.txt"));
+    g_assert_cmpuint (r.files->len, ==, 2);
+    g_assert_true (walk_found (r.dirs, f->dir, "b"));
+    g_assert_false (walk_found (r.dirs, f->dir, "b/c"));
+    scan_options_free (opt);
+
+    // 2段下まで。並列に辿っても全て1回ずつ見つかる
+    g_ptr_array_set_size (r.files, 0);
+    opt = scan_options_new (2, 4, skip);
+    scanner_walk (opt, roots, cb_walk_file, NULL, &r, NULL);
+    g_assert_true (walk_found (r.files, f->dir, "b/c/deep.geany"));
+    g_assert_true (walk_found (r.files, f->dir, "many/p07/p07.geany"));
+    g_assert_false (walk_found (r.files, f->dir, "node_modules/x.geany"));
+    g_assert_cmpuint (r.files->len, ==, 23);
+    scan_options_free (opt);
+
+    g_ptr_array_unref (roots);
+    g_ptr_array_unref (r.dirs);
+    g_ptr_array_unref (r.files);
+    g_mutex_clear (&r.lock);
+}
+
+/*
+ * 起点が複数ある時。先の起点を辿り終えてから次の起点を積むことがあっても、
+ * 全ての起点を辿り終えるまで戻らない。
+ */
+static void test_scanner_walk_roots (Fixture *f, gconstpointer data)
+{
+    WalkResult r;
+    ScanOptions *opt;
+    GPtrArray *roots;
+    gchar *root, *name;
+    gint i, n;
+
+    g_mutex_init (&r.lock);
+    r.files = g_ptr_array_new_with_free_func (g_free);
+    r.dirs = NULL;
+    roots = g_ptr_array_new_with_free_func ((GDestroyNotify)scan_dir_free);
+    for (i = 0; i < 8; i++) {
+        name = g_strdup_printf ("root%d/p/q/r%d.geany", i, i);
+        g_free (write_file (f->dir, name, "[project]\n"));
+        g_free (name);
+        root = g_strdup_printf ("%s/root%d", f->dir, i);
+        g_ptr_array_add (roots, scan_dir_new (root, 0));
+        g_free (root);
+    }
+    // 深さの上限を超えた起点は辿らない
+    root = g_build_filename (f->dir, "root0", "p", NULL);
+    g_ptr_array_add (roots, scan_dir_new (root, 3));
+    g_free (root);
+
+    opt = scan_options_new (2, 4, NULL);
+    for (n = 0; n < 50; n++) {
+        g_ptr_array_set_size (r.files, 0);
+        scanner_walk (opt, roots, cb_walk_file, NULL, &r, NULL);
+        g_assert_cmpuint (r.files->len, ==, 8);
+        g_assert_true (walk_found (r.files, f->dir, "root7/p/q/r7.geany"));
+    }
+    scan_options_free (opt);
+
+    g_ptr_array_unref (roots);
+    g_ptr_array_unref (r.files);
+    g_mutex_clear (&r.lock);
+}
+
+static void test_owner_lookup (Fixture *f, gconstpointer data)
+{
+    OwnerIndex *idx;
+    Projectinfo *prj;
+    GPtrArray *owners;
+    gchar *base, *notes, *path, *cache, *lookup;
+
+    base = g_build_filename (f->dir, "work", "alpha", NULL);
+    notes = g_build_filename (f->dir, "notes", "todo.txt", NULL);
+    path = write_project (f->dir, "alpha", base, notes, NULL);
+    prj = projectinfo_read_header (path, NULL);
+    g_assert_nonnull (prj);
+    cache = g_build_filename (f->dir, "owners.cache", NULL);
+
+    idx = owner_index_new (cache);
+    owner_index_begin_sync (idx);
+    owner_index_update (idx, prj);
+    owner_index_end_sync (idx);
+
+    // ベースパスの下
+    lookup = g_build_filename (base, "src", "main.c", NULL);
+    owners = owner_index_lookup (idx, lookup);
+    g_assert_cmpuint (owners->len, ==, 1);
+    g_assert_cmpstr (g_ptr_array_index (owners, 0), ==, path);
+    g_ptr_array_unref (owners);
+    g_free (lookup);
+
+    // ベースパスの外でも開いていたファイル
+    owners = owner_index_lookup (idx, notes);
+    g_assert_cmpuint (owners->len, ==, 1);
+    g_ptr_array_unref (owners);
+
+    // 持ち主の無いパス
+    owners = owner_index_lookup (idx, f->dir);
+    g_assert_cmpuint (owners->len, ==, 0);
+    g_ptr_array_unref (owners);
+
+    // 保存したものを読み直しても同じ
+    owner_index_save (idx);
+    owner_index_free (idx);
+    idx = owner_index_new (cache);
+    owners = owner_index_lookup (idx, notes);
+    g_assert_cmpuint (owners->len, ==, 1);
+    g_assert_cmpstr (g_ptr_array_index (owners, 0), ==, path);
+    g_ptr_array_unref (owners);
+
+    // 一覧から消えたプロジェクト
+    owner_index_begin_sync (idx);
+    owner_index_end_sync (idx);
+    owners = owner_index_lookup (idx, notes);
+    g_assert_cmpuint (owners->len, ==, 0);
+    g_ptr_array_unref (owners);
+    owner_index_free (idx);
+
+    projectinfo_free (prj);
+    g_free (cache);
+    g_free (path);
+    g_free (notes);
+    g_free (base);
+}
+
+static void assert_text_query (TextIndex *idx, const gchar *query,
+                                const gchar *expect)
+{
+    GHashTable *found = text_index_query (idx, query);
+
+    g_assert_nonnull (found);
+    if (expect == NULL) {
+        g_assert_cmpuint (g_hash_table_size (found), ==, 0);
+    }
+    else {
+        g_assert_cmpuint (g_hash_table_size (found), ==, 1);
+        g_assert_true (g_hash_table_contains (found, expect));
+    }
+    g_hash_table_unref (found);
+}
+
+static void test_text_query (Fixture *f, gconstpointer data)
+{
+    TextIndex *idx;
+    GPtrArray *projects;
+    Projectinfo *alpha, *beta;
+    GError *err = NULL;
+    gchar *path, *filename;
+
+    path = write_project (f->dir, "alpha", "/srv/alpha",
+                          "/srv/alpha/src/parser.c", "make run-server");
+    alpha = projectinfo_read_header (path, NULL);
+    g_free (path);
+    path = write_project (f->dir, "beta", "/srv/beta",
+                          "/srv/beta/設計メモ.txt", NULL);
+    beta = projectinfo_read_header (path, NULL);
+    g_free (path);
+    g_assert_nonnull (alpha);
+    g_assert_nonnull (beta);
+
+    projects = g_ptr_array_new ();
+    g_ptr_array_add (projects, alpha);
+    g_ptr_array_add (projects, beta);
+    filename = g_build_filename (f->dir, "text.index", NULL);
+    idx = text_index_open (filename);
+    g_assert_true (text_index_update (idx, projects, TRUE, &err));
+    g_assert_no_error (err);
+
+    // 開いていたファイル、ビルドコマンド、日本語、全角
+    assert_text_query (idx, "parser.c", alpha->prjfilename);
+    assert_text_query (idx, "run-server", alpha->prjfilename);
+    assert_text_query (idx, "RUN SERVER", alpha->prjfilename);
+    assert_text_query (idx, "設計", beta->prjfilename);
+    assert_text_query (idx, "ｐａｒｓｅｒ", alpha->prjfilename);
+    assert_text_query (idx, "nothing", NULL);
+    // bigram が無い1文字の語は全件を調べる
+    assert_text_query (idx, "メ", beta->prjfilename);
+    g_assert_null (text_index_query (idx, "  "));
+
+    // 書いたものを開き直しても同じ
+    text_index_close (idx);
+    idx = text_index_open (filename);
+    assert_text_query (idx, "run-server", alpha->prjfilename);
+
+    // 一覧から消えたものは prune で消える
+    g_ptr_array_remove (projects, alpha);
+    g_assert_true (text_index_update (idx, projects, FALSE, &err));
+    assert_text_query (idx, "run-server", alpha->prjfilename);
+    g_assert_true (text_index_update (idx, projects, TRUE, &err));
+    assert_text_query (idx, "run-server", NULL);
+    assert_text_query (idx, "設計", beta->prjfilename);
+
+    text_index_close (idx);
+    g_ptr_array_unref (projects);
+    projectinfo_free (alpha);
+    projectinfo_free (beta);
+    g_free (filename);
+}
+
+/*
+ * 名前の無い .geany を含む一覧を --list で表示する。
+ * make check では GEANYPROJECT に作ったプログラムのパスが入る。
+ */
+static void test_list_nameless (Fixture *f, gconstpointer data)
+{
+    const gchar *prog = g_getenv ("GEANYPROJECT");
+    GError *err = NULL;
+    gchar **envp, *conf, *projects, *dir, *out = NULL, *errout = NULL;
+    gchar *argv[] = { NULL, "--list", "--refresh", NULL };
+    gint status;
+
+    if (prog == NULL) {
+        g_test_skip ("GEANYPROJECT is not set");
+        return;
+    }
+    // name の無いものと読めないもの (同点になり名前で比べられる)
+    g_free (write_file (f->dir, "projects/a/a.geany",
+                        "[project]\nbase_path=/srv/a\n"));
+    g_free (write_file (f->dir, "projects/b/b.geany", "name\n"));
+    g_free (write_file (f->dir, "projects/c/c.geany",
+                        "[project]\nname=c\n"));
+    projects = g_build_filename (f->dir, "projects", NULL);
+    conf = g_strdup_printf ("[scan]\nroots=%s\nmax_depth=1\n", projects);
+    g_free (write_file (f->dir, "config/geanyproject/geanyproject.conf",
+                        conf));
+
+    envp = g_get_environ ();
+    dir = g_build_filename (f->dir, "config", NULL);
+    envp = g_environ_setenv (envp, "XDG_CONFIG_HOME", dir, TRUE);
+    g_free (dir);
+    dir = g_build_filename (f->dir, "cache", NULL);
+    envp = g_environ_setenv (envp, "XDG_CACHE_HOME", dir, TRUE);
+    g_free (dir);
+    dir = g_build_filename (f->dir, "data", NULL);
+    envp = g_environ_setenv (envp, "XDG_DATA_HOME", dir, TRUE);
+    g_free (dir);
+    envp = g_environ_setenv (envp, "G_DEBUG", "fatal-criticals", TRUE);
+
+    argv[0] = (gchar *)prog;
+    g_spawn_sync (NULL, argv, envp, G_SPAWN_DEFAULT, NULL, NULL,
+                    &out, &errout, &status, &err);
+    g_assert_no_error (err);
+    g_spawn_check_exit_status (status, &err);
+    g_assert_no_error (err);
+    g_assert_nonnull (strstr (out, "c\n"));
+    // 名前の無い2つは空の行になる
+    g_assert_cmpuint (strlen (out), ==, strlen ("c\n\n\n"));
+
+    // キャッシュから読む時も同じ
+    argv[2] = NULL;
+    g_free (out);
+    g_free (errout);
+    g_spawn_sync (NULL, argv, envp, G_SPAWN_DEFAULT, NULL, NULL,
+                    &out, &errout, &status, &err);
+    g_assert_no_error (err);
+    g_spawn_check_exit_status (status, &err);
+    g_assert_no_error (err);
+    g_assert_cmpuint (strlen (out), ==, strlen ("c\n\n\n"));
+
+    g_free (out);
+    g_free (errout);
+    g_strfreev (envp);
+    g_free (conf);
+    g_free (projects);
+}
+
+int main (int argc, char *argv[])
+{
+    g_test_init (&argc, &argv, NULL);
+
+    g_test_add ("/projectinfo/read-header", Fixture, NULL,
+                fixture_setup, test_read_header, fixture_teardown);
+    g_test_add_func ("/searchindex/filter", test_search_filter);
+    g_test_add ("/scanner/walk", Fixture, NULL,
+                fixture_setup, test_scanner_walk, fixture_teardown);
+    g_test_add ("/scanner/walk-roots", Fixture, NULL,
+                fixture_setup, test_scanner_walk_roots, fixture_teardown);
+    g_test_add ("/ownerindex/lookup", Fixture, NULL,
+                fixture_setup, test_owner_lookup, fixture_teardown);
+    g_test_add ("/textindex/query", Fixture, NULL,
+                fixture_setup, test_text_query, fixture_teardown);
+    g_test_add ("/list/nameless", Fixture, NULL,
+                fixture_setup, test_list_nameless, fixture_teardown);
+    return g_test_run ();
+}
@@ -0,0 +1,187 @@
+/*
+ * Geany プロジェクト一覧 - geany のソケットのテスト
+ *
+ * Copylight by Sakai Satoru 2018
+ *
+ * endeavor2wako@gmail.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+
+/*
+ * GEANYPROJECT_GEANY_SOCKET_DIR に geany の代わりのソケットを置き、
+ * geany_socket_open_files() が送るコマンドを受け取って確かめる。
+ *
+ *   make check
+ */
+
+#ifdef HAVE_CONFIG_H
+#   include "config.h"
+#endif
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "geanysocket.h"
+
+typedef struct {
+    gchar *dir;
+    gchar *path;
+} Fixture;
+
+static void fixture_setup (Fixture *f, gconstpointer data)
+{
+    GError *err = NULL;
+
+    f->dir = g_dir_make_tmp ("geanysocket-XXXXXX", &err);
+    g_assert_no_error (err);
+    g_setenv ("GEANYPROJECT_GEANY_SOCKET_DIR", f->dir, TRUE);
+    f->path = geany_socket_get_path (":0.0");
+}
+
+static void fixture_teardown (Fixture *f, gconstpointer data)
+{
+    g_unlink (f->path);
+    g_rmdir (f->dir);
+    g_unsetenv ("GEANYPROJECT_GEANY_SOCKET_DIR");
+    g_free (f->path);
+    g_free (f->dir);
+}
+
+/*
+ * geany の代わり。1回だけ接続を受け、閉じられるまでに届いたものを返す
+ */
+static int stub_listen (const gchar *path)
+{
+    struct sockaddr_un addr;
+    int fd;
+
+    memset (&addr, 0, sizeof (addr));
+    addr.sun_family = AF_UNIX;
+    g_assert_cmpuint (strlen (path), <, sizeof (addr.sun_path));
+    strcpy (addr.sun_path, path);
+    fd = socket (AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    g_assert_cmpint (fd, >=, 0);
+    g_assert_cmpint (bind (fd, (struct sockaddr *)&addr, sizeof (addr)), ==, 0);
+    g_assert_cmpint (listen (fd, 1), ==, 0);
+    return fd;
+}
+
+static gpointer stub_accept (gpointer data)
+{
+    int fd = GPOINTER_TO_INT (data), conn;
+    GString *received = g_string_new (NULL);
+    gchar buf[256];
+    ssize_t n;
+
+    conn = accept (fd, NULL, NULL);
+    if (conn >= 0) {
+        while ((n = read (conn, buf, sizeof (buf))) != 0) {
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                break;
+            }
+            g_string_append_len (received, buf, n);
+        }
+        close (conn);
+    }
+    return g_string_free (received, FALSE);
+}
+
+static void test_socket_path (Fixture *f, gconstpointer data)
+{
+    gchar *expect, *path;
+
+    // 画面番号を除き、: は _ にする
+    expect = g_strdup_printf ("%s%cgeany_socket_%s__0", f->dir,
+                                    G_DIR_SEPARATOR, g_get_host_name ());
+    g_assert_cmpstr (f->path, ==, expect);
+    g_free (expect);
+
+    path = geany_socket_get_path (NULL);
+    g_assert_true (g_str_has_suffix (path, "_NODISPLAY"));
+    g_free (path);
+}
+
+static void test_open_files (Fixture *f, gconstpointer data)
+{
+    const gchar *files[] = { "/home/user/a.geany", "/tmp/日本語.c", NULL };
+    GError *err = NULL;
+    GThread *thread;
+    gchar *received;
+    int fd;
+
+    fd = stub_listen (f->path);
+    thread = g_thread_new ("stub", stub_accept, GINT_TO_POINTER (fd));
+    g_assert_true (geany_socket_open_files (f->path, files, &err));
+    g_assert_no_error (err);
+    received = g_thread_join (thread);
+    close (fd);
+
+    g_assert_cmpstr (received, ==,
+                "open\n/home/user/a.geany\n/tmp/日本語.c\n.\n");
+    g_free (received);
+}
+
+/*
+ * geany が動いていなければ FALSE になり、呼び出し側が geany を起動する
+ */
+static void test_no_socket (Fixture *f, gconstpointer data)
+{
+    const gchar *files[] = { "/home/user/a.geany", NULL };
+    GError *err = NULL;
+
+    g_assert_false (geany_socket_open_files (f->path, files, &err));
+    g_assert_error (err, G_FILE_ERROR, G_FILE_ERROR_NOENT);
+    g_clear_error (&err);
+}
+
+/*
+ * geany が異常終了して残ったソケット
+ */
+static void test_stale_socket (Fixture *f, gconstpointer data)
+{
+    const gchar *files[] = { "/home/user/a.geany", NULL };
+    GError *err = NULL;
+
+    close (stub_listen (f->path));
+    g_assert_false (geany_socket_open_files (f->path, files, &err));
+    g_assert_nonnull (err);
+    g_clear_error (&err);
+}
+
+int main (int argc, char *argv[])
+{
+    g_test_init (&argc, &argv, NULL);
+
+    g_test_add ("/geanysocket/path", Fixture, NULL,
+                fixture_setup, test_socket_path, fixture_teardown);
+    g_test_add ("/geanysocket/open-files", Fixture, NULL,
+                fixture_setup, test_open_files, fixture_teardown);
+    g_test_add ("/geanysocket/no-socket", Fixture, NULL,
+                fixture_setup, test_no_socket, fixture_teardown);
+    g_test_add ("/geanysocket/stale-socket", Fixture, NULL,
+                fixture_setup, test_stale_socket, fixture_teardown);
+    return g_test_run ();
+}
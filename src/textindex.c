@@ -0,0 +1,626 @@
+/*
+ * Geany プロジェクト一覧 - 全文検索の索引
+ *
+ * Copylight by Sakai Satoru 2018
+ *
+ * endeavor2wako@gmail.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+
+/*
+ * プロジェクトの名前、説明、ベースパスに加えて、開いていたファイルの
+ * パスとビルドコマンドを検索するための転置索引。
+ *
+ * 文字列は search_normalize() で正規化し、続く2文字 (bigram) ごとに
+ * それを含むプロジェクトの番号の並び (差分を varint で詰めたもの) を
+ * 持つ。日本語のように語の区切りが無くても、2文字以上の検索語は
+ * その全ての bigram の並びの共通部分に絞ってから、保存してある
+ * 正規化した文字列で部分一致を確かめる。
+ *
+ * 索引はファイルに書き、mmap して読む。プロジェクトファイルの更新日時と
+ * 大きさを一緒に保存し、変わったものだけを読み直して書き直す。
+ *
+ * ファイルの形:
+ *   TextHeader | TextDoc * n_docs | TextTerm * n_terms | 並び | 文字列
+ * 位置は全てファイルの先頭からのバイト数。TextDoc はパス順、TextTerm は
+ * key 順に並べる。
+ */
+
+#ifdef HAVE_CONFIG_H
+#   include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "projectinfo.h"
+#include "searchindex.h"
+#include "textindex.h"
+
+#define TEXT_DIR        "geanyproject"
+#define TEXT_FILE       "text.index"
+#define TEXT_MAGIC      "GPTEXT01"
+
+typedef struct {
+    gchar magic[8];
+    guint32 n_docs;
+    guint32 n_terms;
+    guint32 docs;                   // TextDoc の位置
+    guint32 terms;                  // TextTerm の位置
+    guint32 postings;
+    guint32 strings;
+} TextHeader;
+
+typedef struct {
+    gint64 mtime;                   // 読んだ時のプロジェクトファイル
+    gint64 size;
+    guint32 path, path_len;         // プロジェクトファイル名
+    guint32 text, text_len;         // 正規化した検索対象の文字列
+} TextDoc;
+
+typedef struct {
+    guint64 key;                    // bigram (前の文字 << 32 | 後の文字)
+    guint32 postings;               // 番号の並びの位置
+    guint32 n;                      // 並びの長さ
+} TextTerm;
+
+struct _TextIndex {
+    gchar *filename;
+    GMappedFile *mf;
+    const gchar *data;
+    gsize size;
+    const TextHeader *hdr;          // 索引が無いか壊れていれば NULL
+    const TextDoc *docs;
+    const TextTerm *terms;
+};
+
+// 作り直す時のプロジェクト
+typedef struct {
+    gchar *path;
+    gint64 mtime, size;
+    gchar *text;
+} BuildDoc;
+
+typedef struct {
+    guint64 key;
+    guint32 doc;
+} BuildPair;
+
+gchar *text_index_get_filename (void)
+{
+    return g_build_filename (g_get_user_cache_dir (),
+                                TEXT_DIR, TEXT_FILE, NULL);
+}
+
+/*
+ * 索引の中の文字列。範囲外なら NULL
+ */
+static const gchar *text_string (const TextIndex *idx, guint32 off,
+                                                        guint32 len)
+{
+    if ((gsize)off + len > idx->size) return NULL;
+    return idx->data + off;
+}
+
+static void text_index_map (TextIndex *idx)
+{
+    const TextHeader *hdr;
+
+    if (idx->mf != NULL) g_mapped_file_unref (idx->mf);
+    idx->mf = g_mapped_file_new (idx->filename, FALSE, NULL);
+    idx->hdr = NULL;
+    idx->docs = NULL;
+    idx->terms = NULL;
+    if (idx->mf == NULL) return;
+
+    idx->data = g_mapped_file_get_contents (idx->mf);
+    idx->size = g_mapped_file_get_length (idx->mf);
+    hdr = (const TextHeader *)idx->data;
+    if (idx->size < sizeof (*hdr) ||
+            memcmp (hdr->magic, TEXT_MAGIC, sizeof (hdr->magic)) != 0 ||
+            hdr->docs % 8 != 0 || hdr->terms % 8 != 0 ||
+            (gsize)hdr->docs + (gsize)hdr->n_docs * sizeof (TextDoc) > idx->size ||
+            (gsize)hdr->terms + (gsize)hdr->n_terms * sizeof (TextTerm) > idx->size ||
+            hdr->postings > idx->size || hdr->strings > idx->size) {
+        g_warning ("%s: broken index", idx->filename);
+        return;
+    }
+    idx->hdr = hdr;
+    idx->docs = (const TextDoc *)(idx->data + hdr->docs);
+    idx->terms = (const TextTerm *)(idx->data + hdr->terms);
+}
+
+/*
+ * filename (NULL なら text_index_get_filename()) の索引を開く。
+ * 無ければ空の索引になる。
+ */
+TextIndex *text_index_open (const gchar *filename)
+{
+    TextIndex *idx = g_new0 (TextIndex, 1);
+
+    idx->filename = (filename != NULL) ?
+                    g_strdup (filename) : text_index_get_filename ();
+    text_index_map (idx);
+    return idx;
+}
+
+void text_index_close (TextIndex *idx)
+{
+    if (idx == NULL) return;
+
+    if (idx->mf != NULL) g_mapped_file_unref (idx->mf);
+    g_free (idx->filename);
+    g_free (idx);
+}
+
+static void put_varint (GByteArray *b, guint32 v)
+{
+    guint8 c;
+
+    while (v >= 0x80) {
+        c = (v & 0x7f) | 0x80;
+        g_byte_array_append (b, &c, 1);
+        v >>= 7;
+    }
+    c = v;
+    g_byte_array_append (b, &c, 1);
+}
+
+static gboolean get_varint (const guchar **p, const guchar *end, guint32 *v)
+{
+    guint shift = 0;
+
+    *v = 0;
+    while (*p < end && shift < 32) {
+        guchar c = *(*p)++;
+        *v |= (guint32)(c & 0x7f) << shift;
+        if ((c & 0x80) == 0) return TRUE;
+        shift += 7;
+    }
+    return FALSE;
+}
+
+/*
+ * 正規化した文字列の bigram を順に func に渡す。改行を跨ぐものは除く。
+ */
+static void text_bigrams (const gchar *text,
+                          void (*func) (guint64 key, gpointer data),
+                          gpointer data)
+{
+    const gchar *p = text;
+    gunichar prev = 0, c;
+
+    for (; *p != '\0'; p = g_utf8_next_char (p)) {
+        c = g_utf8_get_char (p);
+        if (prev != 0 && prev != '\n' && c != '\n') {
+            func ((guint64)prev << 32 | c, data);
+        }
+        prev = c;
+    }
+}
+
+static gchar *text_for_project (const Projectinfo *prj)
+{
+    gchar *session, *raw, *text;
+
+    session = projectinfo_read_session_text (prj->prjfilename);
+    raw = g_strjoin ("\n", (prj->name != NULL) ? prj->name : "",
+                    (prj->description != NULL) ? prj->description : "",
+                    (prj->base_path != NULL) ? prj->base_path : "",
+                    session, NULL);
+    text = search_normalize (raw);
+    g_free (raw);
+    g_free (session);
+    return text;
+}
+
+static gint build_doc_compare (gconstpointer a, gconstpointer b)
+{
+    return strcmp (((const BuildDoc *)a)->path, ((const BuildDoc *)b)->path);
+}
+
+static gint build_pair_compare (gconstpointer a, gconstpointer b)
+{
+    const BuildPair *x = a, *y = b;
+
+    if (x->key != y->key) return (x->key > y->key) ? 1 : -1;
+    return (x->doc > y->doc) - (x->doc < y->doc);
+}
+
+typedef struct {
+    GArray *pairs;
+    guint32 doc;
+} PairCollector;
+
+static void cb_collect_pair (guint64 key, gpointer data)
+{
+    PairCollector *c = data;
+    BuildPair pair = { key, c->doc };
+
+    g_array_append_val (c->pairs, pair);
+}
+
+/*
+ * docs から索引のファイルを作って書く
+ */
+static gboolean text_index_write (TextIndex *idx, GArray *docs,
+                                                    GError **error)
+{
+    TextHeader hdr;
+    GArray *pairs, *terms, *tdocs;
+    GByteArray *postings, *out;
+    GString *strings;
+    PairCollector collector;
+    gboolean ok;
+    gchar *dir;
+    guint i, j;
+
+    g_array_sort (docs, build_doc_compare);
+
+    // (bigram, 番号) の組を集めて並べる
+    pairs = g_array_new (FALSE, FALSE, sizeof (BuildPair));
+    collector.pairs = pairs;
+    tdocs = g_array_sized_new (FALSE, TRUE, sizeof (TextDoc), docs->len);
+    strings = g_string_new (NULL);
+    for (i = 0; i < docs->len; i++) {
+        BuildDoc *d = &g_array_index (docs, BuildDoc, i);
+        TextDoc td = { d->mtime, d->size, strings->len, strlen (d->path), 0, 0 };
+
+        g_string_append (strings, d->path);
+        td.text = strings->len;
+        td.text_len = strlen (d->text);
+        g_string_append (strings, d->text);
+        g_array_append_val (tdocs, td);
+        collector.doc = i;
+        text_bigrams (d->text, cb_collect_pair, &collector);
+    }
+    g_array_sort (pairs, build_pair_compare);
+
+    // bigram ごとに番号の差分を詰める
+    terms = g_array_new (FALSE, FALSE, sizeof (TextTerm));
+    postings = g_byte_array_new ();
+    for (i = 0; i < pairs->len; i = j) {
+        BuildPair *first = &g_array_index (pairs, BuildPair, i);
+        TextTerm t = { first->key, postings->len, 0 };
+        guint32 last = 0;
+
+        for (j = i; j < pairs->len &&
+                    g_array_index (pairs, BuildPair, j).key == t.key; j++) {
+            guint32 doc = g_array_index (pairs, BuildPair, j).doc;
+            if (t.n > 0 && doc == last) continue;
+            put_varint (postings, (t.n > 0) ? doc - last : doc);
+            last = doc;
+            t.n++;
+        }
+        g_array_append_val (terms, t);
+    }
+
+    memset (&hdr, 0, sizeof (hdr));
+    memcpy (hdr.magic, TEXT_MAGIC, sizeof (hdr.magic));
+    hdr.n_docs = tdocs->len;
+    hdr.n_terms = terms->len;
+    hdr.docs = sizeof (hdr);
+    hdr.terms = hdr.docs + tdocs->len * sizeof (TextDoc);
+    hdr.postings = hdr.terms + terms->len * sizeof (TextTerm);
+    hdr.strings = hdr.postings + postings->len;
+    for (i = 0; i < tdocs->len; i++) {
+        g_array_index (tdocs, TextDoc, i).path += hdr.strings;
+        g_array_index (tdocs, TextDoc, i).text += hdr.strings;
+    }
+    for (i = 0; i < terms->len; i++) {
+        g_array_index (terms, TextTerm, i).postings += hdr.postings;
+    }
+
+    out = g_byte_array_sized_new (hdr.strings + strings->len);
+    g_byte_array_append (out, (const guint8 *)&hdr, sizeof (hdr));
+    g_byte_array_append (out, (const guint8 *)tdocs->data,
+                                        tdocs->len * sizeof (TextDoc));
+    g_byte_array_append (out, (const guint8 *)terms->data,
+                                        terms->len * sizeof (TextTerm));
+    g_byte_array_append (out, postings->data, postings->len);
+    g_byte_array_append (out, (const guint8 *)strings->str, strings->len);
+
+    dir = g_path_get_dirname (idx->filename);
+    g_mkdir_with_parents (dir, 0700);
+    g_free (dir);
+    ok = g_file_set_contents (idx->filename, (const gchar *)out->data,
+                                                    out->len, error);
+
+    g_byte_array_unref (out);
+    g_string_free (strings, TRUE);
+    g_byte_array_unref (postings);
+    g_array_unref (terms);
+    g_array_unref (tdocs);
+    g_array_unref (pairs);
+    if (ok) text_index_map (idx);
+    return ok;
+}
+
+static void build_doc_clear (gpointer data)
+{
+    BuildDoc *d = data;
+
+    g_free (d->path);
+    g_free (d->text);
+}
+
+/*
+ * 索引の中で path のプロジェクトの番号。無ければ -1
+ */
+static gint text_find_doc (const TextIndex *idx, const gchar *path)
+{
+    const TextDoc *td;
+    const gchar *p;
+    gsize len = strlen (path);
+    guint lo = 0, hi = (idx->hdr != NULL) ? idx->hdr->n_docs : 0, mid;
+    gint cmp;
+
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        td = &idx->docs[mid];
+        p = text_string (idx, td->path, td->path_len);
+        if (p == NULL) return -1;
+        cmp = memcmp (p, path, MIN (td->path_len, len));
+        if (cmp == 0) cmp = (td->path_len > len) - (td->path_len < len);
+        if (cmp == 0) return mid;
+        if (cmp < 0) lo = mid + 1;
+        else hi = mid;
+    }
+    return -1;
+}
+
+/*
+ * projects (Projectinfo の配列) に合わせて索引を書き直す。
+ * 更新日時と大きさが前と同じプロジェクトは保存してある文字列を使い、
+ * ファイルを読まない。prune なら projects に無いものを消す。
+ * 変わったものが無ければ、索引を引いて比べるだけで何もしない。
+ */
+gboolean text_index_update (TextIndex *idx, GPtrArray *projects,
+                                        gboolean prune, GError **error)
+{
+    GHashTable *seen;
+    GArray *docs;
+    const TextDoc *td;
+    const gchar *path, *text;
+    gboolean changed = FALSE, ok = TRUE;
+    guint8 *matched;                // 番号 → projects にあった
+    gint *found;                    // projects の添字 → 番号 (-1 は無し)
+    guint i, n_matched = 0, n_old = (idx->hdr != NULL) ? idx->hdr->n_docs : 0;
+
+    // まず索引と比べる
+    matched = g_new0 (guint8, n_old + 1);
+    found = g_new (gint, projects->len + 1);
+    for (i = 0; i < projects->len; i++) {
+        const Projectinfo *prj = g_ptr_array_index (projects, i);
+
+        found[i] = -1;
+        if (prj->prjfilename == NULL) continue;
+        found[i] = text_find_doc (idx, prj->prjfilename);
+        if (found[i] < 0) {
+            changed = TRUE;
+            continue;
+        }
+        if (matched[found[i]]) continue;
+        matched[found[i]] = TRUE;
+        n_matched++;
+        td = &idx->docs[found[i]];
+        if (td->mtime != prj->mtime || td->size != prj->size) changed = TRUE;
+    }
+    if (prune && n_matched < n_old) changed = TRUE;
+    if (changed == FALSE) {
+        g_free (found);
+        g_free (matched);
+        return TRUE;
+    }
+
+    docs = g_array_new (FALSE, FALSE, sizeof (BuildDoc));
+    g_array_set_clear_func (docs, build_doc_clear);
+    seen = g_hash_table_new (g_str_hash, g_str_equal);
+    for (i = 0; i < projects->len; i++) {
+        const Projectinfo *prj = g_ptr_array_index (projects, i);
+        BuildDoc d;
+
+        if (prj->prjfilename == NULL ||
+                    g_hash_table_contains (seen, prj->prjfilename)) {
+            continue;
+        }
+        g_hash_table_add (seen, prj->prjfilename);
+        d.path = g_strdup (prj->prjfilename);
+        d.mtime = prj->mtime;
+        d.size = prj->size;
+        d.text = NULL;
+        if (found[i] >= 0) {
+            td = &idx->docs[found[i]];
+            text = text_string (idx, td->text, td->text_len);
+            if (text != NULL && td->mtime == d.mtime && td->size == d.size &&
+                        g_utf8_validate (text, td->text_len, NULL)) {
+                d.text = g_strndup (text, td->text_len);
+            }
+        }
+        if (d.text == NULL) d.text = text_for_project (prj);
+        g_array_append_val (docs, d);
+    }
+
+    // projects に無いもの
+    for (i = 0; prune == FALSE && i < n_old; i++) {
+        BuildDoc d;
+
+        if (matched[i]) continue;
+        td = &idx->docs[i];
+        path = text_string (idx, td->path, td->path_len);
+        text = text_string (idx, td->text, td->text_len);
+        // 文書の文字列は bigram に分けるので、壊れていれば捨てる
+        if (path == NULL || text == NULL ||
+                !g_utf8_validate (text, td->text_len, NULL)) {
+            continue;
+        }
+        d.path = g_strndup (path, td->path_len);
+        d.mtime = td->mtime;
+        d.size = td->size;
+        d.text = g_strndup (text, td->text_len);
+        g_array_append_val (docs, d);
+    }
+
+    ok = text_index_write (idx, docs, error);
+    g_hash_table_unref (seen);
+    g_array_unref (docs);
+    g_free (found);
+    g_free (matched);
+    return ok;
+}
+
+/*
+ * bigram を含むプロジェクトの番号の並び。無ければ NULL
+ */
+static GArray *text_postings (const TextIndex *idx, guint64 key)
+{
+    const TextTerm *t;
+    const guchar *p, *end = (const guchar *)idx->data + idx->size;
+    GArray *list;
+    guint32 lo = 0, hi = idx->hdr->n_terms, mid, v, doc = 0, i;
+
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (idx->terms[mid].key < key) lo = mid + 1;
+        else hi = mid;
+    }
+    if (lo >= idx->hdr->n_terms || idx->terms[lo].key != key) return NULL;
+
+    t = &idx->terms[lo];
+    if (t->postings > idx->size) return NULL;
+    p = (const guchar *)idx->data + t->postings;
+    // 壊れた n で大きく確保しない (番号は1つ1バイト以上)
+    list = g_array_sized_new (FALSE, FALSE, sizeof (guint32),
+                                        MIN (t->n, (gsize)(end - p)));
+    for (i = 0; i < t->n && get_varint (&p, end, &v); i++) {
+        doc = (i > 0) ? doc + v : v;
+        g_array_append_val (list, doc);
+    }
+    return list;
+}
+
+/*
+ * 並べてある a と b の共通部分を a に残す
+ */
+static void text_intersect (GArray *a, const GArray *b)
+{
+    guint i = 0, j = 0, n = 0;
+
+    while (i < a->len && j < b->len) {
+        guint32 x = g_array_index (a, guint32, i);
+        guint32 y = g_array_index (b, guint32, j);
+        if (x < y) i++;
+        else if (x > y) j++;
+        else {
+            g_array_index (a, guint32, n++) = x;
+            i++;
+            j++;
+        }
+    }
+    g_array_set_size (a, n);
+}
+
+typedef struct {
+    const TextIndex *idx;
+    GArray *candidates;             // NULL なら全て
+    gboolean empty;                 // 一致するものが無いと分かった
+} QueryState;
+
+static void cb_query_bigram (guint64 key, gpointer data)
+{
+    QueryState *q = data;
+    GArray *list;
+
+    if (q->empty) return;
+    list = text_postings (q->idx, key);
+    if (list == NULL) {
+        q->empty = TRUE;
+    }
+    else if (q->candidates == NULL) {
+        q->candidates = list;
+    }
+    else {
+        text_intersect (q->candidates, list);
+        g_array_unref (list);
+        if (q->candidates->len == 0) q->empty = TRUE;
+    }
+}
+
+/*
+ * 空白で区切った全ての語を含むプロジェクトのファイル名の集合を返す。
+ * 語が無ければ NULL。
+ */
+GHashTable *text_index_query (TextIndex *idx, const gchar *query)
+{
+    QueryState q = { idx, NULL, FALSE };
+    GHashTable *result;
+    gchar *norm, **words, **w;
+    guint i, n;
+
+    norm = search_normalize (query);
+    words = g_strsplit_set (norm, " \t", -1);
+    g_free (norm);
+    for (w = words, n = 0; *w != NULL; w++) {
+        if (**w != '\0') n++;
+    }
+    if (n == 0) {
+        g_strfreev (words);
+        return NULL;
+    }
+
+    result = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+    if (idx->hdr == NULL) {
+        g_strfreev (words);
+        return result;
+    }
+
+    // 2文字以上の語は bigram の並びで候補を絞る
+    for (w = words; *w != NULL && q.empty == FALSE; w++) {
+        text_bigrams (*w, cb_query_bigram, &q);
+    }
+
+    n = (q.candidates != NULL) ? q.candidates->len : idx->hdr->n_docs;
+    for (i = 0; i < n && q.empty == FALSE; i++) {
+        guint32 doc = (q.candidates != NULL) ?
+                            g_array_index (q.candidates, guint32, i) : i;
+        const TextDoc *td;
+        const gchar *path, *text;
+        gboolean match = TRUE;
+
+        if (doc >= idx->hdr->n_docs) continue;
+        td = &idx->docs[doc];
+        path = text_string (idx, td->path, td->path_len);
+        text = text_string (idx, td->text, td->text_len);
+        if (path == NULL || text == NULL) continue;
+        for (w = words; *w != NULL && match; w++) {
+            if (**w != '\0') {
+                match = (g_strstr_len (text, td->text_len, *w) != NULL);
+            }
+        }
+        if (match) {
+            g_hash_table_add (result, g_strndup (path, td->path_len));
+        }
+    }
+    if (q.candidates != NULL) g_array_unref (q.candidates);
+    g_strfreev (words);
+    return result;
+}
@@ -0,0 +1,40 @@
+/*
+ * Geany プロジェクト一覧 - 全文検索の索引
+ *
+ * Copylight by Sakai Satoru 2018
+ *
+ * endeavor2wako@gmail.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+
+#ifndef TEXTINDEX_H
+#define TEXTINDEX_H
+
+#include <glib.h>
+
+typedef struct _TextIndex TextIndex;
+
+gchar *text_index_get_filename (void);
+TextIndex *text_index_open (const gchar *filename);
+void text_index_close (TextIndex *idx);
+gboolean text_index_update (TextIndex *idx, GPtrArray *projects,
+                                        gboolean prune, GError **error);
+GHashTable *text_index_query (TextIndex *idx, const gchar *query);
+
+#endif /* TEXTINDEX_H */
@@ -0,0 +1,339 @@
+/*
+ * Geany プロジェクト一覧 - 使用履歴
+ *
+ * Copylight by Sakai Satoru 2018
+ *
+ * endeavor2wako@gmail.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+
+/*
+ * プロジェクトを開いた回数を、時間と共に減衰する点数 (frecency) として
+ * ファイルに記録する。
+ *
+ * ファイルはプロジェクトファイル名の hash を鍵とする固定長の
+ * 開番地法の表で、mmap して直接書き換える。1回の記録は表の1要素を
+ * 書き換えるだけなので、ファイル全体を書き直すことはない。
+ *
+ * 書き込みは flock で排他する。読み出しはロックしない (並べ替えの
+ * 途中で値が古くても構わない)。表が埋まってきたら倍の大きさの
+ * ファイルを作って rename し、古い方には moved を立てる。他の
+ * プロセスはそれを見てファイルを開き直す。
+ */
+
+#ifdef HAVE_CONFIG_H
+#   include "config.h"
+#endif
+
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "usage.h"
+
+#define USAGE_DIR           "geanyproject"
+#define USAGE_FILE          "usage.db"
+#define USAGE_MAGIC         "GPUSAGE1"
+#define USAGE_INITIAL_SLOTS 1024        // 2 の冪
+#define USAGE_HALF_LIFE     (7 * 24 * 3600)     // 点数が半分になる秒数
+
+typedef struct {
+    gchar magic[8];
+    guint32 n_slots;
+    guint32 n_used;
+    guint32 moved;                  // 大きいファイルに移った
+    guint32 reserved[3];
+} UsageHeader;
+
+typedef struct {
+    guint64 key;                    // prjfilename の hash。0 は空き
+    gint64 last;                    // 最後に開いた時刻 (秒)
+    gdouble score;                  // last の時点での点数
+    guint32 count;                  // 開いた回数
+    guint32 reserved;
+} UsageSlot;
+
+struct _UsageStore {
+    gchar *filename;
+    gint fd;
+    UsageHeader *hdr;
+    gsize size;
+};
+
+#define USAGE_SIZE(n)       (sizeof (UsageHeader) + (gsize)(n) * sizeof (UsageSlot))
+#define USAGE_SLOTS(hdr)    ((UsageSlot *)((hdr) + 1))
+
+gchar *usage_store_get_filename (void)
+{
+    return g_build_filename (g_get_user_data_dir (),
+                                USAGE_DIR, USAGE_FILE, NULL);
+}
+
+static guint64 usage_hash (const gchar *s)
+{
+    guint64 h = G_GUINT64_CONSTANT (0xcbf29ce484222325);    // FNV-1a
+
+    for (; *s != '\0'; s++) {
+        h ^= (guchar)*s;
+        h *= G_GUINT64_CONSTANT (0x100000001b3);
+    }
+    return (h != 0) ? h : 1;
+}
+
+/*
+ * key の要素、なければ入れるべき空きの要素を返す
+ */
+static UsageSlot *usage_lookup (UsageHeader *hdr, guint64 key)
+{
+    UsageSlot *slots = USAGE_SLOTS (hdr);
+    guint32 mask = hdr->n_slots - 1, i;
+
+    for (i = key & mask; ; i = (i + 1) & mask) {
+        if (slots[i].key == key || slots[i].key == 0) return &slots[i];
+    }
+}
+
+static gdouble usage_decay (const UsageSlot *slot, gint64 now)
+{
+    gint64 age = MAX (now - slot->last, 0);
+
+    return slot->score * exp2 (-(gdouble)age / USAGE_HALF_LIFE);
+}
+
+static void usage_unmap (UsageStore *store)
+{
+    if (store->hdr != NULL) munmap (store->hdr, store->size);
+    if (store->fd >= 0) close (store->fd);
+    store->hdr = NULL;
+    store->fd = -1;
+}
+
+static gboolean usage_valid (const UsageHeader *hdr, gsize size)
+{
+    return memcmp (hdr->magic, USAGE_MAGIC, sizeof (hdr->magic)) == 0 &&
+           hdr->n_slots != 0 && (hdr->n_slots & (hdr->n_slots - 1)) == 0 &&
+           USAGE_SIZE (hdr->n_slots) == size;
+}
+
+static gboolean usage_map (UsageStore *store, GError **error)
+{
+    struct stat st;
+    UsageHeader hdr;
+    gint saved;
+
+    store->fd = g_open (store->filename, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (store->fd < 0) goto fail;
+
+    // 新しいファイルか壊れていれば作り直す
+    if (flock (store->fd, LOCK_EX) != 0 || fstat (store->fd, &st) != 0) {
+        goto fail;
+    }
+    if (st.st_size < (goffset)sizeof (hdr) ||
+            pread (store->fd, &hdr, sizeof (hdr), 0) != sizeof (hdr) ||
+            usage_valid (&hdr, st.st_size) == FALSE) {
+        memset (&hdr, 0, sizeof (hdr));
+        memcpy (hdr.magic, USAGE_MAGIC, sizeof (hdr.magic));
+        hdr.n_slots = USAGE_INITIAL_SLOTS;
+        if (ftruncate (store->fd, 0) != 0 ||
+                ftruncate (store->fd, USAGE_SIZE (hdr.n_slots)) != 0 ||
+                pwrite (store->fd, &hdr, sizeof (hdr), 0) != sizeof (hdr)) {
+            goto fail;
+        }
+    }
+    store->size = USAGE_SIZE (hdr.n_slots);
+    store->hdr = mmap (NULL, store->size, PROT_READ | PROT_WRITE,
+                                            MAP_SHARED, store->fd, 0);
+    if (store->hdr == MAP_FAILED) {
+        store->hdr = NULL;
+        goto fail;
+    }
+    flock (store->fd, LOCK_UN);
+    return TRUE;
+
+fail:
+    saved = errno;
+    usage_unmap (store);
+    g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (saved),
+                    "%s: %s", store->filename, g_strerror (saved));
+    return FALSE;
+}
+
+/*
+ * 他のプロセスが大きいファイルに移していたら開き直す
+ */
+static gboolean usage_sync (UsageStore *store)
+{
+    if (store->hdr == NULL) return FALSE;
+    if (g_atomic_int_get ((gint *)&store->hdr->moved) == 0) return TRUE;
+    usage_unmap (store);
+    return usage_map (store, NULL);
+}
+
+static gboolean usage_lock (UsageStore *store)
+{
+    while (usage_sync (store)) {
+        if (flock (store->fd, LOCK_EX) != 0) return FALSE;
+        if (store->hdr->moved == 0) return TRUE;
+        flock (store->fd, LOCK_UN);
+    }
+    return FALSE;
+}
+
+/*
+ * 倍の大きさのファイルに写して置き換える。ロックしたまま呼ぶ。
+ */
+static gboolean usage_grow (UsageStore *store)
+{
+    UsageHeader *hdr, *old = store->hdr;
+    UsageSlot *from = USAGE_SLOTS (old), *to;
+    gchar *tmp;
+    gsize size;
+    guint32 i;
+    gint fd;
+
+    tmp = g_strconcat (store->filename, ".XXXXXX", NULL);
+    fd = g_mkstemp_full (tmp, O_RDWR | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        g_free (tmp);
+        return FALSE;
+    }
+    size = USAGE_SIZE (old->n_slots * 2);
+    hdr = MAP_FAILED;
+    if (flock (fd, LOCK_EX) == 0 && ftruncate (fd, size) == 0) {
+        hdr = mmap (NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    if (hdr == MAP_FAILED) {
+        close (fd);
+        g_unlink (tmp);
+        g_free (tmp);
+        return FALSE;
+    }
+    memcpy (hdr->magic, USAGE_MAGIC, sizeof (hdr->magic));
+    hdr->n_slots = old->n_slots * 2;
+    hdr->n_used = old->n_used;
+    for (i = 0; i < old->n_slots; i++) {
+        if (from[i].key == 0) continue;
+        to = usage_lookup (hdr, from[i].key);
+        *to = from[i];
+    }
+    if (g_rename (tmp, store->filename) != 0) {
+        munmap (hdr, size);
+        close (fd);
+        g_unlink (tmp);
+        g_free (tmp);
+        return FALSE;
+    }
+    g_free (tmp);
+
+    // 古い方を待っているプロセスはこれを見て開き直す
+    g_atomic_int_set ((gint *)&old->moved, 1);
+    usage_unmap (store);
+    store->fd = fd;
+    store->hdr = hdr;
+    store->size = size;
+    return TRUE;
+}
+
+/*
+ * filename が NULL なら usage_store_get_filename() のファイル
+ */
+UsageStore *usage_store_open (const gchar *filename, GError **error)
+{
+    UsageStore *store = g_new0 (UsageStore, 1);
+    gchar *dir;
+
+    store->filename = (filename != NULL) ?
+                    g_strdup (filename) : usage_store_get_filename ();
+    store->fd = -1;
+    dir = g_path_get_dirname (store->filename);
+    g_mkdir_with_parents (dir, 0700);
+    g_free (dir);
+    if (usage_map (store, error) == FALSE) {
+        usage_store_close (store);
+        return NULL;
+    }
+    return store;
+}
+
+void usage_store_close (UsageStore *store)
+{
+    if (store == NULL) return;
+
+    usage_unmap (store);
+    g_free (store->filename);
+    g_free (store);
+}
+
+/*
+ * prjfilename を now (秒) に開いたことを記録する
+ */
+gboolean usage_store_record (UsageStore *store, const gchar *prjfilename,
+                                                            gint64 now)
+{
+    guint64 key = usage_hash (prjfilename);
+    UsageSlot *slot;
+
+    if (usage_lock (store) == FALSE) return FALSE;
+
+    slot = usage_lookup (store->hdr, key);
+    if (slot->key == 0 &&
+            (store->hdr->n_used + 1) * 4 > store->hdr->n_slots * 3) {
+        // 表が 3/4 を越えるなら広げる。できなければ今の表に入れる
+        if (usage_grow (store)) slot = usage_lookup (store->hdr, key);
+    }
+    if (slot->key == 0) {
+        if (store->hdr->n_used + 1 >= store->hdr->n_slots) {
+            flock (store->fd, LOCK_UN);
+            return FALSE;
+        }
+        slot->score = 0;
+        slot->count = 0;
+        slot->last = now;
+        store->hdr->n_used++;
+    }
+    slot->score = usage_decay (slot, now) + 1;
+    slot->last = MAX (slot->last, now);
+    slot->count++;
+    // 鍵は最後に書く (ロックしない読み手が書きかけの要素を見ないように)
+    __atomic_store_n (&slot->key, key, __ATOMIC_RELEASE);
+    flock (store->fd, LOCK_UN);
+    return TRUE;
+}
+
+/*
+ * now の時点での点数。開いたことがなければ 0
+ */
+gdouble usage_store_get (UsageStore *store, const gchar *prjfilename,
+                                                            gint64 now)
+{
+    UsageSlot *slot;
+
+    if (store == NULL || prjfilename == NULL || !usage_sync (store)) return 0;
+    slot = usage_lookup (store->hdr, usage_hash (prjfilename));
+    return (__atomic_load_n (&slot->key, __ATOMIC_ACQUIRE) != 0) ?
+                                        usage_decay (slot, now) : 0;
+}
@@ -0,0 +1,45 @@
+/*
+ * Geany プロジェクト一覧 - 使用履歴
+ *
+ * Copylight by Sakai Satoru 2018
+ *
+ * endeavor2wako@gmail.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+
+#ifndef USAGE_H
+#define USAGE_H
+
+#include <glib.h>
+
+/*
+ * プロジェクトを開いた履歴 (frecency)。
+ * 複数のプロセスから同時に更新してよい。
+ */
+typedef struct _UsageStore UsageStore;
+
+gchar *usage_store_get_filename (void);
+UsageStore *usage_store_open (const gchar *filename, GError **error);
+void usage_store_close (UsageStore *store);
+gboolean usage_store_record (UsageStore *store, const gchar *prjfilename,
+                                                            gint64 now);
+gdouble usage_store_get (UsageStore *store, const gchar *prjfilename,
+                                                            gint64 now);
+
+#endif /* USAGE_H */